@@ -27,20 +27,90 @@
 // 2 0  : ok
 // 2 1  : ok
 // 2 2  : ok
-// 2 2  : ok
 //
 // in this simpole case all routes will be comma-free but in slightly harder 
 // cases (try ./cf_all_path 3) percent of comma-free routes will be lower:
-// about 427/6562
+// 42/6561
+//
+// option --symmetry enumerates only canonical accepted routes under
+// permutations of alphabet and reversal (see cf_symmetry.hpp), every
+// printed route has its orbit size and totals stay exact:
+// 0 0  : ok x2
+// ...
+//
+// option --stats (or --stats=secs for periodic reports) prints latency of
+// every route check to stderr, see cf_stats.hpp
+//
+// option --sample (uniform random routes) or --importance (routes grown
+// class by class among rotations which keep code comma-free) estimates
+// accepted fraction by Monte Carlo on all cores, when k^N routes can not
+// be walked, see cf_sample.hpp. Estimate and its confidence interval go
+// to stderr every second:
+//
+// ./cf_gen 3 4 | ./cf_all_paths --importance --error 0.02 4
+// 1.00s samples 8192 fraction 1.773e-09 [1.047e-09 .. 2.500e-09] err 41.0%
+// 2.01s samples 18688 fraction 1.897e-09 [1.466e-09 .. 2.328e-09] err 22.7%
+// ...
+//
+// option --exact counts accepted routes exactly without walking them:
+// conflicts of rotations are compiled into decision diagram whose nodes
+// are shared by routes with same constraints left (see cf_count.hpp), so
+// any k^N is fine while diagram stays small (beyond 2^128 it is printed as
+// power of ten); --uniform S also prints S uniform random accepted routes
+// (--seed S)
+//
+// ./cf_gen 3 4 | ./cf_all_paths --exact --uniform 2 4
+// Exact count: 66 pairs, 7116 triples of conflicting rotations, 1301 nodes
+// 0 0 3 3 3 3 3 2 3 2 3 2 3 2 3 0 3 2  : ok
+// ...
+// 144 from 68719476736 accepted
+//
+// Exhaustive walk might be split and checkpointed:
+//
+// --count            print only summary, not every route
+// --shard i/N        walk only part i (0 .. N-1) of all routes
+// --checkpoint file  save position and counters to file every --every
+//                    seconds (default 60) and on SIGINT / SIGTERM; run
+//                    with same arguments resumes from it, complete run
+//                    leaves it as shard result
+// --merge file...    sums shard results into total, checks that all
+//                    shards of same input are present exactly once
+//
+// ./cf_gen 2 5 | ./cf_all_paths --count --shard 0/2 --checkpoint s0 5
+// ./cf_gen 2 5 | ./cf_all_paths --count --shard 1/2 --checkpoint s1 5
+// ./cf_all_paths --merge s0 s1
+// 86 from 15625 accepted
+//
+// routes printed after last checkpoint are printed again on resume
+//
+// Sampling options:
+//
+// --threads N    number of workers (default: number of cores)
+// --time secs    time limit (default 10)
+// --error rel    stop when half of interval is below rel * estimate
+//                (default 0.01)
+// --samples N    stop after N samples
+// --seed S       random seed
 //
 //===----------------------------------------------------------------------===//
 
 #include <vector>
+#include <string>
+#include <thread>
 #include <algorithm>
 #include <iostream>
+#include <iomanip>
 #include <sstream>
+#include <memory>
+#include <cmath>
+#include <cstdlib>
 
 #include "tuples.hpp"
+#include "cf_stats.hpp"
+#include "cf_symmetry.hpp"
+#include "cf_sample.hpp"
+#include "cf_checkpoint.hpp"
+#include "cf_count.hpp"
 
 using std::cout;
 using std::cerr;
@@ -48,6 +118,19 @@ using std::cin;
 using std::endl;
 using std::vector;
 
+struct Options
+{
+  int k = 0;
+  bool stats = false, symmetry = false, sample = false, importance = false;
+  bool count = false, merge = false, exact = false;
+  double interval = 0.0, seconds = 10.0, error = 0.01, every = 60.0;
+  unsigned threads = 0;
+  uint64_t samples = ~uint64_t(0), seed = 1, uniform = 0;
+  Shard shard;
+  std::string checkpoint;
+  vector<std::string> files;
+};
+
 static size_t
 gcd (size_t a, size_t b)
 {
@@ -105,60 +188,356 @@ display_all_perms (const vector<int> &in)
   cout << endl;
 }
 
+/* checkpoint of exhaustive walk: shard, input and counters */
 static void
-display_all_routes (const vector< vector<int> > &out, int k)
+save_routes (Checkpoint &cp, const Options &opts, uint64_t digest,
+             uint64_t total, uint64_t next, uint64_t nall, uint64_t nok,
+             bool done)
 {
+  cp.set("tool", "cf_all_paths");
+  cp.set("k", opts.k);
+  cp.set("digest", digest);
+  cp.set("shard", opts.shard.str());
+  cp.set("total", total);
+  cp.set("next", next);
+  cp.set("all", nall);
+  cp.set("ok", nok);
+  cp.set("done", done ? 1 : 0);
+  cp.save();
+}
+
+/* returns false if interrupted by signal, checkpoint is saved then */
+static bool
+display_all_routes (const vector< vector<int> > &out, const Options &opts,
+                    OpStats *st)
+{
+  int k = opts.k;
   vector<int> config(out.size(), k - 1);
   Tuples t(config);
+  uint64_t total = t.count(), digest = words_digest(out);
+
+  if (total == 0)
+    throw std::runtime_error("Too many routes to walk");
+
+  uint64_t pos = opts.shard.lo(total), hi = opts.shard.hi(total);
+  uint64_t nall = 0, nok = 0;
+  Checkpoint cp(opts.checkpoint);
+
+  if (cp.enabled() && cp.load())
+    {
+      if ((cp.get("tool") != "cf_all_paths") || (cp.get_u64("k") != uint64_t(k))
+          || (cp.get_u64("digest") != digest)
+          || (cp.get("shard") != opts.shard.str())
+          || (cp.get_u64("total") != total))
+        throw std::runtime_error("Checkpoint " + cp.path()
+                                 + " is for other input or shard");
+      uint64_t next = cp.get_u64("next");
+      if ((next < pos) || (next > hi))
+        throw std::runtime_error("Checkpoint " + cp.path() + " is damaged");
+      pos = next;
+      nall = cp.get_u64("all");
+      nok = cp.get_u64("ok");
+      cerr << "resuming from route " << pos << endl;
+    }
 
-  bool ok = true, ok2 = true;
-  int nall = 0, nok = 0;
-  vector<int> nxt;
   cout << "All routes:" << endl;
 
-  do {
-    if (!ok) 
-      ok2 = false;
-
-    if (ok2)
-      ok = t.get_next(nxt);
-
-    Cfdict d (k);
-    bool xfail = false;
-    size_t j, nxsz = nxt.size();
-    for (j = 0; j != nxsz; ++j)
-      {
-        vector<int> perm = out[j];
-        make_cperm(perm, nxt[j]);
-
-        cout << nxt[j] << " ";
-        if (0 != d.add_tuple (perm, true))
-          xfail = true;
-      }
-    nall += 1; 
-    if (!xfail)
-      {
-        cout << " : ok";
+  /* signals are caught only to save checkpoint, otherwise they stop
+     tool as usual */
+  std::unique_ptr<CheckpointSignals> sig;
+  if (cp.enabled())
+    sig.reset(new CheckpointSignals);
+  auto every = std::chrono::duration<double>(opts.every);
+  auto next_save = std::chrono::steady_clock::now() + every;
+
+  t.seek(pos);
+  for (const vector<int> &nxt : t.range(hi - pos))
+    {
+      OpStats::clock::time_point t0;
+      if (st)
+        t0 = OpStats::now();
+
+      Cfdict d (k);
+      bool xfail = false;
+      size_t j, nxsz = nxt.size();
+      for (j = 0; j != nxsz; ++j)
+        {
+          vector<int> perm = out[j];
+          make_cperm(perm, nxt[j]);
+
+          if (!opts.count)
+            cout << nxt[j] << " ";
+          if (0 != d.add_tuple (perm, true))
+            xfail = true;
+        }
+      if (st)
+        st->record(t0);
+
+      pos += 1;
+      nall += 1;
+      if (!xfail)
         nok += 1;
-      }
-    else
-      cout << " : fail";
+      if (!opts.count)
+        cout << (xfail ? " : fail" : " : ok") << endl;
 
-    cout << endl;
-  } while (ok2);
+      /* printed routes are flushed before checkpoint covers them */
+      if (sig && ((nall & 1023) == 0 || sig->raised()))
+        {
+          bool stop = sig->raised();
+          if (stop || (std::chrono::steady_clock::now() >= next_save))
+            {
+              cout.flush();
+              save_routes (cp, opts, digest, total, pos, nall, nok, false);
+              next_save = std::chrono::steady_clock::now() + every;
+            }
+          if (stop)
+            {
+              cerr << "interrupted at route " << pos << ", checkpoint "
+                   << cp.path() << " saved" << endl;
+              return false;
+            }
+        }
+    }
+
+  if (cp.enabled())
+    save_routes (cp, opts, digest, total, pos, nall, nok, true);
+
+  cout << nok << " from " << nall << " accepted";
+  if (opts.shard.count > 1)
+    cout << " (shard " << opts.shard.str() << " of " << total << ")";
+  cout << endl;
+  return true;
+}
+
+/* sums results of all shards, as single run would print them */
+static void
+merge_shards (const Options &opts)
+{
+  uint64_t nall = 0, nok = 0, total = 0, count = 0;
+  std::string first;
+  vector<bool> seen;
+
+  for (const auto &f : opts.files)
+    {
+      Checkpoint cp(f);
+      if (!cp.load() || (cp.get("tool") != "cf_all_paths"))
+        throw std::runtime_error("Not a cf_all_paths shard: " + f);
+
+      Shard sh;
+      if (!sh.parse(cp.get("shard")))
+        throw std::runtime_error("Incorrect shard in " + f);
+      if (cp.get_u64("done") != 1)
+        throw std::runtime_error("Shard " + sh.str() + " is not complete: "
+                                 + f);
+
+      std::string id = cp.get("k") + " " + cp.get("digest") + " "
+                       + cp.get("total");
+      if (first.empty())
+        {
+          first = id;
+          count = sh.count;
+          total = cp.get_u64("total");
+          seen.assign(count, false);
+        }
+      else if ((id != first) || (sh.count != count))
+        throw std::runtime_error("Shard of other run: " + f);
+
+      if (seen[sh.index])
+        throw std::runtime_error("Shard " + sh.str() + " repeated: " + f);
+      seen[sh.index] = true;
+
+      if (cp.get_u64("all") != sh.hi(total) - sh.lo(total))
+        throw std::runtime_error("Shard " + sh.str() + " is damaged: " + f);
+      nall += cp.get_u64("all");
+      nok += cp.get_u64("ok");
+    }
+
+  for (uint64_t i = 0; i != count; ++i)
+    if (!seen[i])
+      throw std::runtime_error("Shard " + std::to_string(i) + "/"
+                               + std::to_string(count) + " is missing");
 
   cout << nok << " from " << nall << " accepted" << endl;
 }
 
-void process_command_line (int argc, char **argv, int &k);
+/* depth-first walk over canonical routes only, see cf_symmetry.hpp
+   route prefix is extended while code stays comma-free, so rejected
+   subtrees are cut as well; accepted routes are weighted by orbit size */
+struct CanonicalRoutes
+{
+  const vector< vector<int> > &out;
+  int k;
+  ClassSymmetry sym;
+  vector<int> route;
+  vector<Cfdict> dicts;
+  unsigned long long nok, ncanon;
+  OpStats *st;
+
+  CanonicalRoutes (const vector< vector<int> > &o, int kk, OpStats *s) :
+    out(o), k(kk), sym(o), route(o.size()), dicts(o.size() + 1, Cfdict(kk)),
+    nok(0), ncanon(0), st(s) {}
+
+  void walk (size_t p)
+    {
+      if (!sym.maybe_canonical (route, p))
+        return;
+
+      if (p == out.size())
+        {
+          size_t w = sym.orbit (route);
+          for (auto r : route)
+            cout << r << " ";
+          cout << " : ok x" << w << endl;
+          nok += w;
+          ncanon += 1;
+          return;
+        }
+
+      for (int r = 0; r != k; ++r)
+        {
+          OpStats::clock::time_point t0;
+          if (st)
+            t0 = OpStats::now();
+
+          vector<int> perm = out[p];
+          make_cperm(perm, r);
+          dicts[p + 1] = dicts[p];
+          int res = dicts[p + 1].add_tuple (perm, true);
+
+          if (st)
+            st->record(t0);
+
+          route[p] = r;
+          if (res == 0)
+            walk (p + 1);
+        }
+    }
+};
+
+static void
+display_canonical_routes (const vector< vector<int> > &out, int k,
+                          OpStats *st)
+{
+  unsigned long long nall = 1;
+  size_t i;
+
+  for (i = 0; i != out.size(); ++i)
+    {
+      if (nall > ~0ull / k)
+        throw std::runtime_error("Too many routes to count");
+      nall *= k;
+    }
+
+  CanonicalRoutes cr (out, k, st);
+  cout << "Canonical accepted routes (" << cr.sym.size()
+       << " symmetries):" << endl;
+  cr.walk (0);
+  cout << cr.nok << " from " << nall << " accepted, "
+       << cr.ncanon << " canonical" << endl;
+}
+
+static void
+print_estimate (std::ostream &os, const SampleEstimate &e)
+{
+  os << std::setprecision(3) << std::scientific << "fraction "
+     << (double) e.fraction << " [" << (double) e.lo << " .. "
+     << (double) e.hi << "]" << std::defaultfloat;
+}
+
+static void
+sample_routes (const vector< vector<int> > &out, const Options &opts)
+{
+  unsigned threads = opts.threads;
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+
+  RouteSampler rs (out, opts.importance);
+  SampleEstimate e = rs.run (threads, opts.seconds, opts.error, opts.samples,
+                             opts.seed, 1.0,
+    [] (double elapsed, const SampleEstimate &est) {
+      cerr << std::fixed << std::setprecision(2) << elapsed << "s samples "
+           << est.samples << " ";
+      print_estimate (cerr, est);
+      cerr << " err " << std::setprecision(1) << std::fixed
+           << 100 * est.rel_error() << "%" << std::defaultfloat << endl;
+    });
+
+  double lr = rs.log10_routes ();
+  cout << (opts.importance ? "Importance" : "Uniform") << " sampling, "
+       << e.samples << " samples: ";
+  print_estimate (cout, e);
+  cout << " (95% confidence)" << endl;
+  cout << std::fixed << std::setprecision(2);
+  if (e.fraction > 0)
+    cout << "about 10^" << std::log10((double) e.fraction) + lr;
+  else
+    cout << "none seen, at most 10^" << std::log10((double) e.hi) + lr;
+  cout << " from 10^" << lr << " routes accepted" << std::defaultfloat
+       << endl;
+}
+
+/* exact count by decision diagram and uniform accepted routes; false if
+   accepted count does not fit into 128 bits */
+static bool
+count_routes (const vector< vector<int> > &out, const Options &opts)
+{
+  RouteCounter rc (out, opts.k);
+  RouteCounter::count_t nok;
+
+  try
+    {
+      nok = rc.accepted ();
+    }
+  catch (std::runtime_error &e)
+    {
+      cerr << e.what() << ": more than 2^128 of 10^" << std::fixed
+           << std::setprecision(2) << rc.log10_routes () << std::defaultfloat
+           << " routes, try --sample" << endl;
+      return false;
+    }
+
+  cout << "Exact count: " << rc.pairs() << " pairs, " << rc.triples()
+       << " triples of conflicting rotations, " << rc.nodes() << " nodes"
+       << endl;
+
+  std::mt19937_64 rng (opts.seed);
+  vector<int> route;
+  for (uint64_t i = 0; (i != opts.uniform) && rc.sample (rng, route); ++i)
+    {
+      for (auto r : route)
+        cout << r << " ";
+      cout << " : ok" << endl;
+    }
+
+  /* k^N beyond 128 bits as power of ten, as --sample prints it */
+  cout << RouteCounter::str(nok) << " from ";
+  if (rc.routes_fit ())
+    cout << RouteCounter::str(rc.routes ());
+  else
+    cout << "10^" << std::fixed << std::setprecision(2) << rc.log10_routes ()
+         << std::defaultfloat;
+  cout << " accepted" << endl;
+  return true;
+}
+
+void process_command_line (int argc, char **argv, Options &opts);
 
 int 
 main (int argc, char **argv)
 {
-  int k;
+  Options opts;
   vector< vector<int> > out;
 
-  process_command_line (argc, argv, k);
+  process_command_line (argc, argv, opts);
+
+  if (opts.merge)
+    {
+      merge_shards (opts);
+      return 0;
+    }
+
+  int k = opts.k;
+  bool stats = opts.stats, symmetry = opts.symmetry;
 
   cout << "All permutations:" << endl;
 
@@ -192,26 +571,107 @@ main (int argc, char **argv)
       display_all_perms (nxt);
     }
 
-  display_all_routes (out, k);
+  if (opts.sample || opts.importance)
+    {
+      sample_routes (out, opts);
+      return 0;
+    }
+
+  if (opts.exact)
+    return count_routes (out, opts) ? 0 : 1;
+
+  OpStats st(symmetry ? "extend" : "route", opts.interval);
+  if (symmetry)
+    display_canonical_routes (out, k, stats ? &st : nullptr);
+  else
+    {
+      if (!display_all_routes (out, opts, stats ? &st : nullptr))
+        return 1;
+    }
+
+  if (stats)
+    st.finish();
 
   return 0;
 }
 
 void
-process_command_line (int argc, char **argv, int &k)
+process_command_line (int argc, char **argv, Options &opts)
 {
-  if (argc < 2)
+  int idx;
+  const char *kpos = nullptr;
+
+  for (idx = 1; idx < argc; ++idx)
+    {
+      std::string arg = argv[idx];
+      bool has_val = (idx + 1 < argc);
+
+      if (parse_stats_option (argv[idx], opts.stats, opts.interval))
+        continue;
+      if (arg == "--symmetry")
+        opts.symmetry = true;
+      else if (arg == "--sample")
+        opts.sample = true;
+      else if (arg == "--importance")
+        opts.importance = true;
+      else if (arg == "--threads" && has_val)
+        opts.threads = atoi(argv[++idx]);
+      else if (arg == "--time" && has_val)
+        opts.seconds = atof(argv[++idx]);
+      else if (arg == "--error" && has_val)
+        opts.error = atof(argv[++idx]);
+      else if (arg == "--samples" && has_val)
+        opts.samples = std::strtoull(argv[++idx], nullptr, 10);
+      else if (arg == "--seed" && has_val)
+        opts.seed = std::strtoull(argv[++idx], nullptr, 10);
+      else if (arg == "--count")
+        opts.count = true;
+      else if (arg == "--exact")
+        opts.exact = true;
+      else if (arg == "--uniform" && has_val)
+        opts.uniform = std::strtoull(argv[++idx], nullptr, 10);
+      else if (arg == "--checkpoint" && has_val)
+        opts.checkpoint = argv[++idx];
+      else if (arg == "--every" && has_val)
+        opts.every = atof(argv[++idx]);
+      else if (arg == "--shard" && has_val)
+        {
+          if (!opts.shard.parse(argv[++idx]))
+            {
+              cerr << "shard shall be i/N, 0 <= i < N" << endl;
+              throw std::runtime_error("incorrect command line");
+            }
+        }
+      else if (arg == "--merge")
+        opts.merge = true;
+      else if (opts.merge)
+        opts.files.push_back(arg);
+      else if (kpos == nullptr)
+        kpos = argv[idx];
+      else
+        kpos = "";
+    }
+
+  if (opts.merge && !opts.files.empty())
+    return;
+
+  if ((kpos == nullptr) || (*kpos == 0))
     {
-      cerr << "usage: \"" << argv[0] << " k\" where k is position count" << endl;
+      cerr << "usage: \"" << argv[0] << " [--stats[=secs]] [--symmetry] k\" "
+              "or \"" << argv[0] << " --sample|--importance [--threads N]"
+              " [--time secs] [--error rel] [--samples N] [--seed S] k\" "
+              "or \"" << argv[0] << " [--count] [--shard i/N] [--checkpoint"
+              " file] [--every secs] k\" or \"" << argv[0] << " --exact"
+              " [--uniform S] [--seed S] k\" or \"" << argv[0] << " --merge"
+              " file...\" where k is position count" << endl;
       throw std::runtime_error("incorrect command line");
     }
 
-  k = atoi (argv[1]);
+  opts.k = atoi (kpos);
 
-  if (k <= 0)
+  if (opts.k <= 0)
     {
       cerr << "k shall be > 0" << endl;
       throw std::runtime_error("incorrect command line");
     }
 }
-
@@ -0,0 +1,245 @@
+//===------- cf_alloc.hpp -- allocation accounting ------------------------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains opt-in allocation tracker: global operator new/delete
+// replacement which counts allocations and bytes, attributed to innermost
+// public operation marked by CF_ALLOC_SCOPE("name")
+//
+// Build flags:
+//
+// -DCF_ALLOC_TRACKER   enables CF_ALLOC_SCOPE markers in library code,
+//                      without it markers expand to nothing
+//
+// and exactly one translation unit of executable shall define
+// CF_ALLOC_TRACKER_IMPL before including this file: it gets counters
+// storage and operator new/delete replacement
+//
+// Zero allocations on hot path might be asserted:
+//
+// {
+//   AllocForbid guard("PrimeGen::get_next");
+//   pg.get_next(res);
+// } <-- guard destructor reports and aborts if something was allocated
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_ALLOC_GUARD_
+#define CF_ALLOC_GUARD_
+
+#include <new>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+
+/* counters of one operation */
+struct AllocOpStats
+{
+  const char *name;
+  std::atomic<uint64_t> calls, allocs, bytes;
+};
+
+/* fixed storage: registration of operation shall not allocate itself */
+struct AllocRegistry
+{
+  enum { maxops = 64 };
+  AllocOpStats ops[maxops];
+  std::atomic<int> nops;
+  std::atomic<uint64_t> allocs, bytes, frees;
+};
+
+AllocRegistry &alloc_registry ();
+
+/* innermost active operation of current thread, nullptr if none */
+AllocOpStats *&alloc_current ();
+
+/* finds or registers operation by name, names are expected to be literals */
+inline AllocOpStats *
+alloc_op (const char *name)
+{
+  AllocRegistry &r = alloc_registry();
+  int i, n = r.nops.load();
+
+  for (i = 0; i != n; ++i)
+    if (r.ops[i].name == name || std::strcmp(r.ops[i].name, name) == 0)
+      return &r.ops[i];
+
+  /* registration happens from few threads at most, spin is fine here */
+  static std::atomic<bool> lock(false);
+  while (lock.exchange(true))
+    ;
+
+  n = r.nops.load();
+  for (i = 0; i != n; ++i)
+    if (std::strcmp(r.ops[i].name, name) == 0)
+      break;
+
+  if (i == n)
+    {
+      if (n == AllocRegistry::maxops)
+        {
+          lock = false;
+          std::fprintf(stderr, "alloc tracker: too many operations\n");
+          std::abort();
+        }
+      r.ops[n].name = name;
+      r.nops.store(n + 1);
+    }
+
+  lock = false;
+  return &r.ops[i];
+}
+
+/* marks operation for attribution while alive */
+class AllocScope
+{
+  AllocOpStats *m_prev;
+
+public:
+  explicit AllocScope (AllocOpStats *op)
+    {
+      /* calls are not exact under contention, but cheap */
+      op->calls.store(op->calls.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
+      m_prev = alloc_current();
+      alloc_current() = op;
+    }
+
+  ~AllocScope () { alloc_current() = m_prev; }
+
+  AllocScope (const AllocScope &) = delete;
+  AllocScope &operator= (const AllocScope &) = delete;
+};
+
+inline uint64_t
+alloc_total_count ()
+{
+  return alloc_registry().allocs.load(std::memory_order_relaxed);
+}
+
+inline uint64_t
+alloc_total_bytes ()
+{
+  return alloc_registry().bytes.load(std::memory_order_relaxed);
+}
+
+/* aborts if current thread allocated anything during guard lifetime */
+class AllocForbid
+{
+  const char *m_what;
+  uint64_t m_start;
+  static thread_local uint64_t thread_allocs;
+
+public:
+  explicit AllocForbid (const char *what) :
+    m_what(what), m_start(thread_allocs) {}
+
+  ~AllocForbid ()
+    {
+      if (thread_allocs != m_start)
+        {
+          std::fprintf(stderr, "alloc tracker: %llu allocations in %s, "
+                       "which shall not allocate\n",
+                       (unsigned long long)(thread_allocs - m_start), m_what);
+          std::abort();
+        }
+    }
+
+  /* called from operator new */
+  static void note () { thread_allocs += 1; }
+
+  AllocForbid (const AllocForbid &) = delete;
+  AllocForbid &operator= (const AllocForbid &) = delete;
+};
+
+/* prints per-operation table, sorted by registration order */
+inline void
+alloc_report (FILE *f)
+{
+  AllocRegistry &r = alloc_registry();
+  int i, n = r.nops.load();
+
+  std::fprintf(f, "%-32s %12s %12s %14s %12s\n",
+               "operation", "calls", "allocs", "bytes", "allocs/call");
+  for (i = 0; i != n; ++i)
+    {
+      const AllocOpStats &op = r.ops[i];
+      uint64_t calls = op.calls.load(), allocs = op.allocs.load();
+      std::fprintf(f, "%-32s %12llu %12llu %14llu %12.2f\n", op.name,
+                   (unsigned long long)calls, (unsigned long long)allocs,
+                   (unsigned long long)op.bytes.load(),
+                   calls ? double(allocs) / calls : 0.0);
+    }
+  std::fprintf(f, "%-32s %12s %12llu %14llu\n", "total", "",
+               (unsigned long long)r.allocs.load(),
+               (unsigned long long)r.bytes.load());
+}
+
+#ifdef CF_ALLOC_TRACKER_IMPL
+
+AllocRegistry &
+alloc_registry ()
+{
+  /* zero-initialized static storage, no constructor ordering problems */
+  static AllocRegistry r;
+  return r;
+}
+
+AllocOpStats *&
+alloc_current ()
+{
+  static thread_local AllocOpStats *cur = nullptr;
+  return cur;
+}
+
+thread_local uint64_t AllocForbid::thread_allocs = 0;
+
+/* noinline keeps gcc from pairing inlined free with new expressions */
+__attribute__((noinline)) void *
+operator new (std::size_t sz)
+{
+  AllocRegistry &r = alloc_registry();
+  AllocOpStats *op = alloc_current();
+
+  r.allocs.fetch_add(1, std::memory_order_relaxed);
+  r.bytes.fetch_add(sz, std::memory_order_relaxed);
+  if (op)
+    {
+      op->allocs.fetch_add(1, std::memory_order_relaxed);
+      op->bytes.fetch_add(sz, std::memory_order_relaxed);
+    }
+  AllocForbid::note();
+
+  if (void *p = std::malloc(sz ? sz : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void
+operator delete (void *p) noexcept
+{
+  if (p)
+    alloc_registry().frees.fetch_add(1, std::memory_order_relaxed);
+  std::free(p);
+}
+
+#endif
+
+#ifdef CF_ALLOC_TRACKER
+#define CF_ALLOC_CONCAT2(a, b) a##b
+#define CF_ALLOC_CONCAT(a, b) CF_ALLOC_CONCAT2(a, b)
+#define CF_ALLOC_SCOPE(name) \
+  static AllocOpStats *CF_ALLOC_CONCAT(cf_alloc_op_, __LINE__) = \
+    alloc_op(name); \
+  AllocScope CF_ALLOC_CONCAT(cf_alloc_scope_, __LINE__)( \
+    CF_ALLOC_CONCAT(cf_alloc_op_, __LINE__))
+#else
+#define CF_ALLOC_SCOPE(name) do {} while (0)
+#endif
+
+#endif
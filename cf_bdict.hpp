@@ -0,0 +1,408 @@
+//===------- cf_bdict.hpp -- comma-free dictionary of byte strings --------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains definition and implementation of ByteCfdict class:
+// comma-free dictionary of text words (n bytes each, n is not limited)
+// for commafree_check. It accepts, rejects and explains exactly as
+// Cfdict::add_tuple(w, true) on same letters does, but every insert costs
+// O(n) hash lookups instead of O(size^2 * n^2) comparisons
+//
+// Words are kept as bytes in one arena. Keys of word parts are WordKeys
+// ones (rolling hash mixed with length, see cf_cdict.hpp) and every key
+// maps to chain of words which have such part, in insertion order:
+//
+// - rotation: key of least rotation, finds rotation of candidate
+// - prefix u of length 1 .. n-1 (and key of rest v of word u . v)
+// - suffix v of length 1 .. n-1 (and key of rest u of word u . v)
+//
+// so pair of words around z at any split is two lookups, and every hit
+// is confirmed by memcmp, key collision costs time only
+//
+// Cfdict reports first conflict in order of its loops: outer dictionary
+// index i, then z = w inside D[i] . D[j] or D[j] . D[i] (j > i), then
+// w around w with D[i], then D[i] inside w . D[j] or D[j] . w. Every
+// conflict gets such key (i, phase, j, side) and least one is reported.
+// Chains are sorted, so for every split few first words of chains give
+// least key of that split
+//
+// Last phase (w is x or y around older z = u . v) uses least z for every
+// u whose v is prefix of some word (and least z for every v whose u is
+// suffix of some word), like B and C sets of ConcurrentCfdict. Such z
+// only appear, so insert updates them: once some v becomes prefix for
+// the first time, chain of words with suffix v is walked once. Tables
+// are keyed by u (v) only: key collision might explain conflict by other
+// words than Cfdict does (probability about 2^-64 per lookup)
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_BDICT_GUARD_
+#define CF_BDICT_GUARD_
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+
+#include "cf_alloc.hpp"
+#include "cf_canon.hpp"
+#include "cf_cdict.hpp"
+
+class ByteCfdict
+{
+  typedef unsigned char byte;
+  enum : uint32_t { none = 0xffffffffu };
+
+  /* key -> chain of words in insertion order, node keeps key of the rest
+     of word (v for prefix u, u for suffix v) */
+  class ChainTable
+  {
+    struct Slot
+    {
+      uint64_t key;
+      uint32_t head, tail;
+    };
+
+    struct Node
+    {
+      uint32_t word, next;
+      uint64_t rest;
+    };
+
+    vector<Slot> m_slots;
+    vector<Node> m_nodes;
+    size_t m_used;
+
+    size_t find_slot (uint64_t key) const
+      {
+        size_t mask = m_slots.size() - 1, s;
+        for (s = key_slot(key) & mask; ; s = (s + 1) & mask)
+          if ((m_slots[s].key == key) || (m_slots[s].key == 0))
+            return s;
+      }
+
+    void grow ()
+      {
+        vector<Slot> old(2 * m_slots.size(), Slot{0, none, none});
+        old.swap(m_slots);
+        for (const Slot &x : old)
+          if (x.key != 0)
+            m_slots[find_slot(x.key)] = x;
+      }
+
+  public:
+    ChainTable () : m_slots(64, Slot{0, none, none}), m_used(0) {}
+
+    /* first node of chain of key or none */
+    uint32_t first (uint64_t key) const
+      {
+        const Slot &x = m_slots[find_slot(key)];
+        return (x.key == key) ? x.head : none;
+      }
+
+    uint32_t next (uint32_t node) const { return m_nodes[node].next; }
+    uint32_t word (uint32_t node) const { return m_nodes[node].word; }
+    uint64_t rest (uint32_t node) const { return m_nodes[node].rest; }
+
+    void add (uint64_t key, uint32_t word, uint64_t rest = 0)
+      {
+        /* load at most 1/2 */
+        if (2 * (m_used + 1) > m_slots.size())
+          grow ();
+
+        uint32_t node = m_nodes.size();
+        m_nodes.push_back(Node{word, none, rest});
+
+        Slot &x = m_slots[find_slot(key)];
+        if (x.key == 0)
+          {
+            x.key = key;
+            x.head = node;
+            m_used += 1;
+          }
+        else
+          m_nodes[x.tail].next = node;
+        x.tail = node;
+      }
+  };
+
+  /* key -> least word index and key of the rest of that word */
+  class MinTable
+  {
+    struct Slot
+    {
+      uint64_t key, rest;
+      uint32_t word;
+    };
+
+    vector<Slot> m_slots;
+    size_t m_used;
+
+    size_t find_slot (uint64_t key) const
+      {
+        size_t mask = m_slots.size() - 1, s;
+        for (s = key_slot(key) & mask; ; s = (s + 1) & mask)
+          if ((m_slots[s].key == key) || (m_slots[s].key == 0))
+            return s;
+      }
+
+  public:
+    MinTable () : m_slots(64, Slot{0, 0, none}), m_used(0) {}
+
+    /* least word of key or none */
+    uint32_t find (uint64_t key, uint64_t &rest) const
+      {
+        const Slot &x = m_slots[find_slot(key)];
+        rest = x.rest;
+        return (x.key == key) ? x.word : none;
+      }
+
+    void lower (uint64_t key, uint32_t word, uint64_t rest)
+      {
+        if (2 * (m_used + 1) > m_slots.size())
+          {
+            vector<Slot> old(2 * m_slots.size(), Slot{0, 0, none});
+            old.swap(m_slots);
+            for (const Slot &x : old)
+              if (x.key != 0)
+                m_slots[find_slot(x.key)] = x;
+          }
+
+        Slot &x = m_slots[find_slot(key)];
+        if (x.key == 0)
+          {
+            x = Slot{key, rest, word};
+            m_used += 1;
+          }
+        else if (word < x.word)
+          {
+            x.word = word;
+            x.rest = rest;
+          }
+      }
+  };
+
+  /* conflict in order of Cfdict loops; fst, snd are words around z,
+     none means candidate */
+  struct Conflict
+  {
+    uint32_t i, phase, j, side, fst, snd;
+
+    bool operator< (const Conflict &c) const
+      {
+        if (i != c.i)
+          return i < c.i;
+        if (phase != c.phase)
+          return phase < c.phase;
+        if (j != c.j)
+          return j < c.j;
+        return side < c.side;
+      }
+  };
+
+  enum { pair_phase = 0, self_phase = 1, around_phase = 2 };
+
+  size_t m_n;
+  WordKeys m_keys;
+  std::string m_words;
+  vector<uint32_t> m_canon;       /* offset of least rotation of word */
+  ChainTable m_rot, m_pref, m_suf;
+  MinTable m_left;                /* u -> least z = u . v, v in prefixes */
+  MinTable m_right;               /* v -> least z = u . v, u in suffixes */
+  std::string m_cand;             /* candidate doubled */
+
+  const byte *at (uint32_t idx) const
+    {
+      return reinterpret_cast<const byte *>(m_words.data()) + idx * m_n;
+    }
+
+  /* first words of chain of key whose part [a, a + len) equals s, at most
+     cnt of them; returns how many were found */
+  size_t first_words (const ChainTable &t, uint64_t key, size_t a,
+                      const byte *s, size_t len, uint32_t *res,
+                      size_t cnt) const
+    {
+      size_t found = 0;
+      for (uint32_t x = t.first(key); (x != none) && (found != cnt);
+           x = t.next(x))
+        if (0 == memcmp(at(t.word(x)) + a, s, len))
+          res[found++] = t.word(x);
+      return found;
+    }
+
+  /* least conflict of candidate w (z = u . v, |v| = off), see above */
+  void split_conflict (const byte *w, const WordKeys::Parts &p, size_t off,
+                       Conflict &best) const
+    {
+      size_t n = m_n, a = n - off;
+      uint32_t xs[2], ys[2];
+      size_t nx, ny, i, j;
+
+      /* z = w: x has suffix w[0 .. a), y has prefix w[a .. n) */
+      nx = first_words(m_suf, p.part(0, a), off, w, a, xs, 2);
+      ny = first_words(m_pref, p.part(a, n), 0, w + a, off, ys, 2);
+      for (i = 0; i != nx; ++i)
+        for (j = 0; j != ny; ++j)
+          if (xs[i] != ys[j])
+            {
+              bool lt = xs[i] < ys[j];
+              Conflict c = { lt ? xs[i] : ys[j], pair_phase,
+                             lt ? ys[j] : xs[i], lt ? 0u : 1u, xs[i], ys[j] };
+              if (c < best)
+                best = c;
+            }
+
+      /* z = w and y = w (x = w) if w has border of length off (a) */
+      if ((nx != 0) && (0 == memcmp(w, w + a, off)))
+        {
+          Conflict c = { xs[0], self_phase, 0, 0, xs[0], none };
+          if (c < best)
+            best = c;
+        }
+      if ((ny != 0) && (0 == memcmp(w, w + off, a)))
+        {
+          Conflict c = { ys[0], self_phase, 0, 1, none, ys[0] };
+          if (c < best)
+            best = c;
+        }
+
+      /* x = w, z has prefix w[off .. n), y has prefix z[a .. n) */
+      uint64_t rest;
+      uint32_t z = m_left.find(p.part(off, n), rest);
+      if ((z != none) && (z <= best.i) && (0 == memcmp(at(z), w + off, a))
+          && first_words(m_pref, rest, 0, at(z) + a, off, ys, 1))
+        {
+          Conflict c = { z, around_phase, ys[0], 0, none, ys[0] };
+          if (c < best)
+            best = c;
+        }
+
+      /* y = w, z has suffix w[0 .. off), x has suffix z[0 .. a) */
+      z = m_right.find(p.part(0, off), rest);
+      if ((z != none) && (z <= best.i) && (0 == memcmp(at(z) + a, w, off))
+          && first_words(m_suf, rest, off, at(z), a, xs, 1))
+        {
+          Conflict c = { z, around_phase, xs[0], 1, xs[0], none };
+          if (c < best)
+            best = c;
+        }
+    }
+
+  /* w = at(idx) is inserted: its parts go to chains, and words z = u . v
+     which got v as prefix (or u as suffix) for the first time, w too,
+     go to m_left (m_right) */
+  void insert (uint32_t idx, const WordKeys::Parts &p)
+    {
+      const byte *w = at(idx);
+      size_t n = m_n, k;
+      uint32_t dummy;
+
+      for (k = 1; k < n; ++k)
+        {
+          uint64_t v = p.part(0, k);
+          bool fresh = !first_words(m_pref, v, 0, w, k, &dummy, 1);
+
+          m_pref.add(v, idx, p.part(k, n));
+          if (fresh)
+            for (uint32_t z = m_suf.first(v); z != none; z = m_suf.next(z))
+              if (0 == memcmp(at(m_suf.word(z)) + n - k, w, k))
+                m_left.lower(m_suf.rest(z), m_suf.word(z), v);
+        }
+
+      for (k = 1; k < n; ++k)
+        {
+          uint64_t u = p.part(n - k, n);
+          bool fresh = !first_words(m_suf, u, n - k, w + n - k, k, &dummy, 1);
+
+          m_suf.add(u, idx, p.part(0, n - k));
+          if (fresh)
+            for (uint32_t z = m_pref.first(u); z != none; z = m_pref.next(z))
+              if (0 == memcmp(at(m_pref.word(z)), w + n - k, k))
+                m_right.lower(m_pref.rest(z), m_pref.word(z), u);
+        }
+
+      /* w as z: v (u) might be part of w itself */
+      for (k = 1; k < n; ++k)
+        {
+          if (first_words(m_pref, p.part(k, n), 0, w + k, n - k, &dummy, 1))
+            m_left.lower(p.part(0, k), idx, p.part(k, n));
+          if (first_words(m_suf, p.part(0, k), n - k, w, k, &dummy, 1))
+            m_right.lower(p.part(k, n), idx, p.part(0, k));
+        }
+    }
+
+public:
+  explicit ByteCfdict (size_t n) : m_n(n), m_keys(n) {}
+
+  size_t length () const { return m_n; }
+  size_t size () const { return m_canon.size(); }
+
+  /* letters of idx-th word */
+  std::string word (size_t idx) const { return m_words.substr(idx * m_n, m_n); }
+
+  /* return 0 on success, -1 if candidate is cyclic itself, otherwise
+     number of conflicting word + 1, as Cfdict::add_tuple(w, true) */
+  int add_word (const char *s, size_t len)
+    {
+      CF_ALLOC_SCOPE("ByteCfdict::add_word");
+      const byte *w = reinterpret_cast<const byte *>(s);
+      size_t n = m_n, k;
+
+      m_lasterr.clear();
+
+      if (len != n)
+        throw std::runtime_error("Incorrect size of candidate");
+
+      Canon cw = canonical_rotation(w, n);
+      if (!cw.primitive)
+        return -1;
+
+      WordKeys::Parts p(m_keys, w);
+
+      /* rotation of candidate is in dictionary: it equals m_cand shifted */
+      m_cand.assign(s, n);
+      m_cand.append(s, n);
+      for (uint32_t x = m_rot.first(p.rotation(cw.offset)); x != none;
+           x = m_rot.next(x))
+        {
+          uint32_t idx = m_rot.word(x);
+          size_t off = (cw.offset + n - m_canon[idx]) % n;
+          if (0 == memcmp(m_cand.data() + off, at(idx), n))
+            {
+              m_lasterr = word(idx) + word(idx);
+              return idx + 1;
+            }
+        }
+
+      Conflict best = { none, 0, 0, 0, none, none };
+      for (k = 1; k < n; ++k)
+        split_conflict (w, p, k, best);
+
+      if (best.i != none)
+        {
+          m_lasterr = (best.fst == none) ? std::string(s, n) : word(best.fst);
+          m_lasterr += (best.snd == none) ? std::string(s, n) : word(best.snd);
+          return best.i + 1;
+        }
+
+      uint32_t idx = size();
+      m_words.append(s, n);
+      m_canon.push_back(cw.offset);
+      m_rot.add(p.rotation(cw.offset), idx);
+      insert (idx, p);
+
+      return 0;
+    }
+
+  int add_word (const std::string &s) { return add_word(s.data(), s.size()); }
+
+  /* not part of model, pure error reporting: letters of words around
+     conflict (or doubled rotation of candidate), as Cfdict::m_lasterr */
+  std::string m_lasterr;
+};
+
+#endif
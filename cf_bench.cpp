@@ -0,0 +1,1316 @@
+//===-- cf_bench.cpp -- benchmarks for generators, dictionary and Eastman -===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains an executable programm which measures:
+//
+// PrimeGen::get_next, Tuples::get_next          -- micro, per call, and
+//                                                  same by range views
+// Lyndon words -> Eastman -> count             -- per word, get_next and
+//                                                  range pipelines
+// Cfdict::add_tuple strict and non-strict       -- per insert, growing dict
+// ByteCfdict::add_word vs Cfdict strict         -- per word of whole list,
+//                                                  same results verified
+// ConcurrentCfdict::check and insert_all        -- per candidate, greedy
+//                                                  code on 1 and all threads,
+//                                                  explain vs Cfdict verified
+// do_eastman (basin-range) and do_eastman_dip   -- random, adversarial and
+//                                                  long words
+// do_eastman_batch                              -- per word, same words in
+//                                                  lanes (CF_EASTMAN_BATCH
+//                                                  forces instruction set)
+// EastmanScheduler vs do_eastman in arrival     -- per word, words of mixed
+// order                                         -- lengths and of one
+//                                                  length, order verified
+// SlidingEastman vs do_eastman of every window -- per window of random
+//                                                  stream, shifts verified
+// EastmanPrimeGen vs PrimeGen + do_eastman    -- per word of exhaustive
+//                                                  sweep, words verified
+// TrieCfdict::find, check vs ConcurrentCfdict  -- per candidate against
+// check                                         -- half of large Eastman
+//                                                  code, results verified,
+//                                                  bytes per word in params
+// canonical_rotation vs search in doubled word -- per word
+// CfDecoder::decode_bytes and decode            -- per letter of stream of
+//                                                  random code words
+// CfEncoder and CfBlockDecoder                  -- per byte of random data,
+//                                                  round trip is verified
+// FixedCode::rank vs CfDecoder::lookup          -- per random word, every
+//                                                  code of cf_tables.inc is
+//                                                  verified against PrimeGen
+//                                                  + do_eastman
+// code setup, compiled in vs runtime            -- per code
+// RouteCounter::accepted                        -- per count of all routes
+//                                                  of Lyndon classes, small
+//                                                  ones verified by walk
+//
+// Usage:
+//
+// ./cf_bench [--csv | --json] [--out file] [--filter substr] [--min-ms ms]
+//            [--compare baseline.csv] [--tolerance percent]
+//            [--alloc-report] [--check-alloc]
+//
+// --alloc-report prints allocations attributed to every public operation
+// --check-alloc only runs hot paths which shall not allocate and aborts
+// if some of them allocates
+//
+// Typical regression workflow:
+//
+// ./cf_bench --csv --out baseline.csv
+// ... change something ...
+// ./cf_bench --compare baseline.csv
+//
+// Exit code is 1 if some case is slower than baseline above tolerance
+//
+//===----------------------------------------------------------------------===//
+
+#include <new>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <random>
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+#define CF_ALLOC_TRACKER_IMPL
+#include "cf_alloc.hpp"
+#include "cf_bench.hpp"
+#include "tuples.hpp"
+#include "cf_dict.hpp"
+#include "cf_cdict.hpp"
+#include "cf_bdict.hpp"
+#include "cf_canon.hpp"
+#include "cf_decode.hpp"
+#include "cf_encode.hpp"
+#include "cf_sliding.hpp"
+#include "cf_primes.hpp"
+#include "cf_trie.hpp"
+#include "cf_fixed.hpp"
+#include "cf_count.hpp"
+#include "cf_schedule.hpp"
+#include "cf_eastman.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::vector;
+using std::string;
+
+/* prevents compiler from throwing away computed values */
+static volatile int sink;
+
+struct Options
+{
+  bool csv = false, json = false, alloc_report = false, check_alloc = false;
+  string out, filter, baseline;
+  double min_ms = 200.0, tolerance = 10.0;
+};
+
+void process_command_line (int argc, char **argv, Options &opts);
+
+static string
+params (int m, int n)
+{
+  return "m=" + std::to_string(m) + " n=" + std::to_string(n);
+}
+
+/* x shall be not equal to any of its cyclic shifts */
+static bool
+is_primitive (const vector<int> &x)
+{
+  return canonical_rotation(x).primitive;
+}
+
+static vector< vector<int> >
+random_words (std::mt19937 &rng, int m, int n, size_t count)
+{
+  vector< vector<int> > res;
+  std::uniform_int_distribution<int> letter(0, m - 1);
+
+  while (res.size() != count)
+    {
+      vector<int> w(n);
+      for (auto &x : w)
+        x = letter(rng);
+      if (is_primitive(w))
+        res.push_back(w);
+    }
+
+  return res;
+}
+
+/* words which produce long chains of equal subwords in Eastman phases:
+   single defect in constant word, alternating word with defect and
+   odd prefix of Thue-Morse sequence */
+static vector< vector<int> >
+adversarial_words (int n)
+{
+  vector< vector<int> > res;
+  vector<int> w(n, 0);
+  int i;
+
+  w[n - 1] = 1;
+  res.push_back(w);
+
+  for (i = 0; i < n; ++i)
+    w[i] = i % 2;
+  w[n - 1] = 1;
+  if (is_primitive(w))
+    res.push_back(w);
+
+  for (i = 0; i < n; ++i)
+    w[i] = __builtin_popcount(i) % 2;
+  if (is_primitive(w))
+    res.push_back(w);
+
+  return res;
+}
+
+static void
+bench_primegen (Bench &b, int m, int n)
+{
+  b.run("primegen_get_next", params(m, n), [m, n](uint64_t iters) {
+    vector<int> res(n);
+    PrimeGen pg(m, n);
+    int acc = 0;
+    for (uint64_t i = 0; i != iters; ++i)
+      {
+        if (!pg.get_next(res))
+          pg = PrimeGen(m, n);
+        acc += res[n - 1];
+      }
+    sink = acc;
+  });
+
+  b.run("primegen_range", params(m, n), [m, n](uint64_t iters) {
+    PrimeGen pg(m, n);
+    auto r = pg.range();
+    auto it = r.begin();
+    int acc = 0;
+    for (uint64_t i = 0; i != iters; ++i, ++it)
+      {
+        if (it == r.end())
+          {
+            pg = PrimeGen(m, n);
+            r = pg.range();
+            it = r.begin();
+          }
+        acc += (*it)[n - 1];
+      }
+    sink = acc;
+  });
+}
+
+static void
+bench_tuples (Bench &b, int k, int m)
+{
+  b.run("tuples_get_next", params(k, m), [k, m](uint64_t iters) {
+    vector<int> config(m, k - 1), nxt;
+    Tuples t(config);
+    int acc = 0;
+    for (uint64_t i = 0; i != iters; ++i)
+      {
+        if (!t.get_next(nxt))
+          t = Tuples(config);
+        acc += nxt[m - 1];
+      }
+    sink = acc;
+  });
+
+  b.run("tuples_range", params(k, m), [k, m](uint64_t iters) {
+    vector<int> config(m, k - 1);
+    Tuples t(config);
+    int acc = 0;
+    while (iters > 0)
+      {
+        uint64_t left = iters;
+        for (const vector<int> &nxt : t.range(iters))
+          {
+            acc += nxt[m - 1];
+            --left;
+          }
+        iters = left;
+      }
+    sink = acc;
+  });
+}
+
+/* Lyndon words -> Eastman -> filter -> count, per word: words copied out
+   by get_next, and viewed by range with standard count_if */
+static void
+bench_pipeline (Bench &b, int m, int n)
+{
+  PrimeGen all(m, n);
+  auto ra = all.range();
+  uint64_t words = std::distance(ra.begin(), ra.end());
+
+  b.run("pipeline_get_next", params(m, n), [m, n, words](uint64_t iters) {
+    vector<int> w(n), x;
+    size_t cnt = 0;
+    while (iters > 0)
+      {
+        PrimeGen pg(m, n);
+        while (pg.get_next(w))
+          {
+            x = w;
+            cnt += (do_eastman(x) == 0);
+          }
+        iters -= std::min(iters, words);
+      }
+    sink = cnt;
+  });
+
+  b.run("pipeline_range", params(m, n), [m, n, words](uint64_t iters) {
+    vector<int> x;
+    size_t cnt = 0;
+    while (iters > 0)
+      {
+        PrimeGen pg(m, n);
+        auto r = pg.range();
+        cnt += std::count_if(r.begin(), r.end(), [&x](const vector<int> &w) {
+          x = w;
+          return do_eastman(x) == 0;
+        });
+        iters -= std::min(iters, words);
+      }
+    sink = cnt;
+  });
+}
+
+/* Eastman code of (m, n) is comma-free, so all inserts succeed */
+static vector< vector<int> >
+eastman_code (int m, int n)
+{
+  vector< vector<int> > code;
+  PrimeGen pg(m, n);
+
+  for (const vector<int> &p : pg.range())
+    {
+      vector<int> w(p), x(p);
+      int s = do_eastman(x);
+      std::rotate(w.begin(), w.begin() + s, w.end());
+      code.push_back(w);
+    }
+
+  return code;
+}
+
+/* measures insert of (size + 1)-th word into dictionary of size words */
+static void
+bench_add_tuple (Bench &b, const vector< vector<int> > &code, size_t size,
+                 bool strict)
+{
+  int n = code[0].size();
+  Cfdict base(n);
+  size_t i;
+
+  for (i = 0; i != size; ++i)
+    base.add_tuple(code[i], strict);
+
+  string name = strict ? "cfdict_add_strict" : "cfdict_add";
+  string p = "n=" + std::to_string(n) + " size=" + std::to_string(size);
+
+  /* copy of dictionary is inevitable, it is measured separately */
+  b.run(name, p, [&](uint64_t iters) {
+    int acc = 0;
+    for (uint64_t it = 0; it != iters; ++it)
+      {
+        Cfdict d(base);
+        acc += d.add_tuple(code[size], strict);
+      }
+    sink = acc;
+  });
+
+  b.run(name + "_copy", p, [&](uint64_t iters) {
+    for (uint64_t it = 0; it != iters; ++it)
+      {
+        Cfdict d(base);
+        sink = d.m_lasterr.size();
+      }
+  });
+}
+
+/* letters of words as text, 'a' is letter 0 */
+static vector<string>
+as_text (const vector< vector<int> > &words)
+{
+  vector<string> res;
+  for (const auto &w : words)
+    {
+      res.emplace_back();
+      for (int x : w)
+        res.back().push_back('a' + x);
+    }
+  return res;
+}
+
+/* ByteCfdict shall answer and explain as Cfdict strict on lists with
+   many conflicts (random words) and with none (Eastman code); then both
+   insert Eastman code, every operation is one word of the list */
+static void
+bench_bdict (Bench &b, std::mt19937 &rng, int m, int n, bool slow)
+{
+  auto code = eastman_code(m, n);
+  auto words = random_words(rng, m, n, 256);
+  words.insert(words.end(), code.begin(), code.end());
+  std::shuffle(words.begin(), words.end(), rng);
+  words.insert(words.end(), code.begin(), code.end());
+
+  vector<string> text = as_text(words), ctext = as_text(code);
+  Cfdict d(n);
+  ByteCfdict bd(n);
+
+  for (size_t i = 0; i != words.size(); ++i)
+    {
+      int res = d.add_tuple(words[i], true);
+      if ((bd.add_word(text[i]) != res) ||
+          (bd.m_lasterr != as_text({ d.m_lasterr })[0]))
+        throw std::runtime_error("ByteCfdict mismatch for " + params(m, n));
+    }
+
+  string p = params(m, n) + " words=" + std::to_string(code.size());
+
+  b.run("bdict_add", p, [&](uint64_t iters) {
+    int acc = 0;
+    while (iters > 0)
+      {
+        ByteCfdict x(n);
+        for (size_t i = 0; (i != code.size()) && (iters > 0); ++i, --iters)
+          acc += x.add_word(ctext[i]);
+      }
+    sink = acc;
+  });
+
+  if (!slow)
+    return;
+
+  b.run("cfdict_add_strict_list", p, [&](uint64_t iters) {
+    int acc = 0;
+    while (iters > 0)
+      {
+        Cfdict x(n);
+        for (size_t i = 0; (i != code.size()) && (iters > 0); ++i, --iters)
+          acc += x.add_tuple(code[i], true);
+      }
+    sink = acc;
+  });
+}
+
+/* ordered insert_all shall answer and explain as Cfdict strict on random
+   words and Eastman code (as cf_check --threads); then check against
+   dictionary of whole code but last word (accepted), and greedy code from
+   all prime words of (m, n) in random order */
+static void
+bench_cdict (Bench &b, std::mt19937 &rng, int m, int n)
+{
+  auto code = eastman_code(m, n);
+  ConcurrentCfdict base(n);
+  vector< vector<int> > cands = random_words(rng, m, n, 256);
+  vector<int> w(n), res;
+  PrimeGen pg(m, n);
+  size_t i, accepted = 0;
+
+  cands.insert(cands.end(), code.begin(), code.end());
+  std::shuffle(cands.begin(), cands.end(), rng);
+  {
+    Cfdict d(n);
+    ConcurrentCfdict cd(n);
+    cd.insert_all(cands, 4, true, &res);
+    for (i = 0; i != cands.size(); ++i)
+      {
+        int r = d.add_tuple(cands[i], true);
+        if ((r == 0) != (res[i] == ConcurrentCfdict::accepted) ||
+            (r == -1) != (res[i] == ConcurrentCfdict::cyclic) ||
+            (r > 0 && cd.explain(cands[i], accepted) != d.m_lasterr))
+          throw std::runtime_error("ConcurrentCfdict mismatch for "
+                                   + params(m, n));
+        accepted += (r == 0);
+      }
+    cands.clear();
+  }
+
+  for (i = 0; i + 1 < code.size(); ++i)
+    base.insert(code[i]);
+
+  string p = "n=" + std::to_string(n) + " size=" + std::to_string(i);
+  b.run("cdict_check", p, [&](uint64_t iters) {
+    int acc = 0;
+    for (uint64_t it = 0; it != iters; ++it)
+      acc += base.check(code.back());
+    sink = acc;
+  });
+
+  while (pg.get_next(w))
+    for (int r = 0; r != n; ++r)
+      {
+        cands.push_back(w);
+        std::rotate(w.begin(), w.begin() + 1, w.end());
+      }
+  std::shuffle(cands.begin(), cands.end(), rng);
+
+  vector<unsigned> counts(1, 1);
+  if (std::thread::hardware_concurrency() > 1)
+    counts.push_back(std::thread::hardware_concurrency());
+
+  for (unsigned threads : counts)
+    {
+      p = "m=" + std::to_string(m) + " n=" + std::to_string(n) + " threads="
+          + std::to_string(threads);
+      b.run("cdict_greedy", p, [&](uint64_t iters) {
+        size_t acc = 0;
+        while (iters > 0)
+          {
+            ConcurrentCfdict d(n);
+            acc += d.insert_all(cands, threads, true);
+            iters -= std::min<uint64_t>(iters, cands.size());
+          }
+        sink = acc;
+      });
+    }
+}
+
+typedef int (*eastman_fn)(vector<int> &);
+
+static void
+bench_eastman (Bench &b, const string &name, const string &p, eastman_fn fn,
+               const vector< vector<int> > &words)
+{
+  b.run(name, p, [&](uint64_t iters) {
+    vector<int> x;
+    int acc = 0;
+    size_t nw = words.size(), cur = 0;
+
+    x.reserve(words[0].size() * 3);
+    for (uint64_t it = 0; it != iters; ++it)
+      {
+        const vector<int> &w = words[cur];
+        if (x.capacity() < w.size() * 3)
+          x.reserve(w.size() * 3);
+        x.assign(w.begin(), w.end());
+        acc += fn(x);
+        cur = (cur + 1 == nw) ? 0 : cur + 1;
+      }
+    sink = acc;
+  });
+}
+
+static void
+bench_eastman_both (Bench &b, const string &kind, int m, int n,
+                    const vector< vector<int> > &words)
+{
+  string p = kind + " " + params(m, n);
+  bench_eastman(b, "eastman", p, do_eastman, words);
+  bench_eastman(b, "eastman_dip", p, do_eastman_dip, words);
+}
+
+/* words in structure-of-arrays layout, results are verified against
+   do_eastman before timing */
+static void
+bench_eastman_batch (Bench &b, const string &kind, int m, int n,
+                     const vector< vector<int> > &words)
+{
+  size_t w = words.size(), l, p;
+  vector<int> soa(n * w), shifts(w);
+
+  for (l = 0; l != w; ++l)
+    for (p = 0; p != size_t(n); ++p)
+      soa[p * w + l] = words[l][p];
+
+  do_eastman_batch(soa.data(), n, w, shifts.data());
+  for (l = 0; l != w; ++l)
+    {
+      vector<int> x(words[l]);
+      if (do_eastman(x) != shifts[l])
+        throw std::runtime_error("do_eastman_batch differs from do_eastman");
+    }
+
+  string desc = kind + " " + params(m, n) + " " + eastman_batch_isa();
+  b.run("eastman_batch", desc, [&](uint64_t iters) {
+    int acc = 0;
+    while (iters > 0)
+      {
+        do_eastman_batch(soa.data(), n, w, shifts.data());
+        acc += shifts[0];
+        iters -= std::min<uint64_t>(iters, w);
+      }
+    sink = acc;
+  });
+}
+
+/* stream of words of mixed lengths through EastmanScheduler, shifts and
+   order first checked against do_eastman; then same with words of one
+   length and do_eastman in arrival order */
+static void
+bench_schedule (Bench &b, const string &kind,
+                const vector< vector<int> > &words)
+{
+  vector<int> ref, got;
+  for (const auto &w : words)
+    {
+      vector<int> x(w);
+      try
+        {
+          ref.push_back(do_eastman(x));
+        }
+      catch (std::runtime_error &)
+        {
+          ref.push_back(-1);
+        }
+    }
+
+  {
+    size_t i = 0;
+    EastmanScheduler check([&](const int *w, size_t n, int shift) {
+      const vector<int> &x = words[i++];
+      if ((n != x.size()) || !std::equal(x.begin(), x.end(), w))
+        throw std::runtime_error("EastmanScheduler order mismatch");
+      got.push_back(shift);
+    });
+    for (const auto &w : words)
+      check.add(w);
+    check.finish();
+  }
+  if (got != ref)
+    throw std::runtime_error("EastmanScheduler differs from do_eastman");
+
+  b.run("eastman_schedule", kind, [&](uint64_t iters) {
+    int acc = 0;
+    EastmanScheduler es([&acc](const int *, size_t, int shift) {
+      acc += shift;
+    });
+    for (uint64_t i = 0; i != iters; ++i)
+      es.add(words[i % words.size()]);
+    es.finish();
+    sink = acc;
+  });
+
+  b.run("eastman_arrival", kind, [&](uint64_t iters) {
+    int acc = 0;
+    vector<int> x;
+    for (uint64_t i = 0; i != iters; ++i)
+      {
+        x = words[i % words.size()];
+        try
+          {
+            acc += do_eastman(x);
+          }
+        catch (std::runtime_error &)
+          {
+            acc -= 1;
+          }
+      }
+    sink = acc;
+  });
+}
+
+/* shift of every window of n letters of random stream of m letters,
+   first checked against do_eastman of window copies */
+static void
+bench_sliding (Bench &b, std::mt19937 &rng, int m, int n)
+{
+  vector<int> stream(1 << 16), w;
+  for (auto &x : stream)
+    x = rng() % m;
+
+  SlidingEastman check(n);
+  for (size_t i = 0; i != stream.size(); ++i)
+    {
+      check.push(stream[i]);
+      if (!check.ready() || (i % 7 != 0))
+        continue;
+      w.assign(stream.begin() + i + 1 - n, stream.begin() + i + 1);
+      int ref;
+      try
+        {
+          ref = do_eastman(w);
+        }
+      catch (std::runtime_error &)
+        {
+          ref = -1;
+        }
+      if (check.shift() != ref)
+        throw std::runtime_error("SlidingEastman mismatch for " + params(m, n));
+    }
+
+  string p = params(m, n);
+
+  b.run("sliding_eastman", p, [&](uint64_t iters) {
+    int acc = 0;
+    while (iters > 0)
+      {
+        SlidingEastman se(n);
+        for (size_t i = 0; (i != stream.size()) && (iters > 0); ++i)
+          {
+            se.push(stream[i]);
+            if (se.ready())
+              {
+                acc += se.shift();
+                iters -= 1;
+              }
+          }
+      }
+    sink = acc;
+  });
+
+  b.run("window_eastman", p, [&](uint64_t iters) {
+    int acc = 0;
+    for (uint64_t it = 0; it != iters; ++it)
+      {
+        size_t i = it % (stream.size() - n);
+        w.assign(stream.begin() + i, stream.begin() + i + n);
+        try
+          {
+            acc += do_eastman(w);
+          }
+        catch (std::runtime_error &)
+          {
+            acc -= 1;
+          }
+      }
+    sink = acc;
+  });
+}
+
+/* succinct trie of every second word of Eastman code against hash keys
+   of ConcurrentCfdict: same verdicts, few bytes per word */
+static void
+bench_trie (Bench &b, std::mt19937 &rng, int m, int n)
+{
+  auto code = eastman_code(m, n);
+  vector< vector<int> > cands = random_words(rng, m, n, 4096), sorted;
+  vector<int> flat;
+  ConcurrentCfdict cd(n);
+  size_t i;
+
+  for (i = 0; i != code.size(); ++i)
+    if (i % 2 == 0)
+      {
+        flat.insert(flat.end(), code[i].begin(), code[i].end());
+        sorted.push_back(code[i]);
+        cd.insert(code[i]);
+      }
+    else if (cands.size() < 8192)
+      cands.push_back(code[i]);
+  std::shuffle(cands.begin(), cands.end(), rng);
+  std::sort(sorted.begin(), sorted.end());
+
+  TrieCfdict t(n, flat);
+  for (i = 0; i < sorted.size(); i += 7)
+    if ((t.find(sorted[i]) != long(i)) || (t.word(i) != sorted[i]))
+      throw std::runtime_error("TrieCfdict find mismatch for "
+                               + params(m, n));
+  for (const auto &w : cands)
+    if (t.check(w) != cd.check(w))
+      throw std::runtime_error("TrieCfdict check mismatch for "
+                               + params(m, n));
+  for (size_t len = 0; len <= size_t(n); len += 3)
+    {
+      vector<int> s(cands[len].begin(), cands[len].begin() + len);
+      size_t cnt = 0;
+      t.enumerate(s, [&cnt] (const int *) { cnt += 1; });
+      if (cnt != t.count(s))
+        throw std::runtime_error("TrieCfdict count mismatch for "
+                                 + params(m, n));
+    }
+
+  char bpw[32];
+  snprintf(bpw, sizeof(bpw), " %.2fB/word", double(t.bytes()) / t.size());
+  string p = params(m, n) + bpw;
+
+  b.run("trie_find", p, [&](uint64_t iters) {
+    long acc = 0;
+    for (uint64_t it = 0; it != iters; ++it)
+      acc += t.find(cands[it % cands.size()]);
+    sink = acc;
+  });
+
+  b.run("trie_check", p, [&](uint64_t iters) {
+    int acc = 0;
+    for (uint64_t it = 0; it != iters; ++it)
+      acc += t.check(cands[it % cands.size()]);
+    sink = acc;
+  });
+
+  b.run("cdict_check", params(m, n), [&](uint64_t iters) {
+    int acc = 0;
+    for (uint64_t it = 0; it != iters; ++it)
+      acc += cd.check(cands[it % cands.size()]);
+    sink = acc;
+  });
+}
+
+/* Eastman code words of exhaustive sweep: fused generator sharing phases
+   of common prefixes, against PrimeGen and do_eastman word by word */
+static void
+bench_primes (Bench &b, int m, int n)
+{
+  {
+    EastmanPrimeGen eg(m, n);
+    PrimeGen pg(m, n);
+    vector<int> w;
+    while (eg.advance())
+      {
+        if (!pg.advance())
+          throw std::runtime_error("EastmanPrimeGen has more words for "
+                                   + params(m, n));
+        w = pg.current();
+        if ((eg.prime() != w) || (eg.shift() != do_eastman(w)))
+          throw std::runtime_error("EastmanPrimeGen mismatch for "
+                                   + params(m, n));
+      }
+    if (pg.advance())
+      throw std::runtime_error("EastmanPrimeGen has less words for "
+                               + params(m, n));
+  }
+
+  string p = params(m, n);
+
+  b.run("fused_eastman", p, [m, n](uint64_t iters) {
+    EastmanPrimeGen eg(m, n);
+    int acc = 0;
+    for (uint64_t i = 0; i != iters; ++i)
+      {
+        if (!eg.advance())
+          {
+            eg = EastmanPrimeGen(m, n);
+            eg.advance();
+          }
+        acc += eg.shift();
+      }
+    sink = acc;
+  });
+
+  b.run("primegen_eastman", p, [m, n](uint64_t iters) {
+    PrimeGen pg(m, n);
+    vector<int> w;
+    int acc = 0;
+    for (uint64_t i = 0; i != iters; ++i)
+      {
+        if (!pg.advance())
+          {
+            pg = PrimeGen(m, n);
+            pg.advance();
+          }
+        w = pg.current();
+        acc += do_eastman(w);
+      }
+    sink = acc;
+  });
+}
+
+/* least rotation and primitivity in O(n), against O(n^2) search of word
+   inside its doubled copy (former Cfdict check, primitivity only) */
+static void
+bench_canon (Bench &b, const string &kind, int m, int n,
+             const vector< vector<int> > &words)
+{
+  string p = kind + " " + params(m, n);
+  vector< vector<int> > doubled(words);
+
+  for (auto &w : doubled)
+    w.insert(w.end(), w.begin(), w.end());
+
+  b.run("canon", p, [&](uint64_t iters) {
+    size_t acc = 0, nw = words.size(), cur = 0;
+    for (uint64_t it = 0; it != iters; ++it)
+      {
+        Canon c = canonical_rotation(words[cur]);
+        acc += c.offset + c.primitive;
+        cur = (cur + 1 == nw) ? 0 : cur + 1;
+      }
+    sink = acc;
+  });
+
+  b.run("cyclic_search", p, [&](uint64_t iters) {
+    size_t acc = 0, nw = words.size(), cur = 0;
+    for (uint64_t it = 0; it != iters; ++it)
+      {
+        const vector<int> &w = words[cur], &w2 = doubled[cur];
+        acc += std::search(w2.begin() + 1, w2.end() - 1, w.begin(), w.end())
+               - w2.begin();
+        cur = (cur + 1 == nw) ? 0 : cur + 1;
+      }
+    sink = acc;
+  });
+}
+
+/* stream of random code words with one letter of garbage ahead, every
+   operation is one letter, stream is decoded from start again if needed */
+static void
+bench_decode (Bench &b, std::mt19937 &rng, const vector< vector<int> > &code,
+              size_t nwords)
+{
+  vector<uint8_t> bytes(1, 0);
+  vector<int> letters(1, 0);
+  CfDecoder dec(code);
+  size_t i;
+
+  for (i = 0; i != nwords; ++i)
+    {
+      const vector<int> &w = code[rng() % code.size()];
+      bytes.insert(bytes.end(), w.begin(), w.end());
+      letters.insert(letters.end(), w.begin(), w.end());
+    }
+
+  string p = "n=" + std::to_string(code[0].size()) +
+             " words=" + std::to_string(code.size());
+
+  auto run = [&](uint64_t iters, bool packed) {
+    int32_t acc = 0;
+    auto emit = [&acc](uint64_t, int32_t idx) { acc += idx; };
+    while (iters > 0)
+      {
+        size_t len = std::min<uint64_t>(iters, bytes.size());
+        dec.reset();
+        if (packed)
+          dec.decode_bytes(bytes.data(), len, emit);
+        else
+          dec.decode(letters.data(), len, emit);
+        iters -= len;
+      }
+    sink = acc;
+  };
+
+  b.run("decode_bytes", p, [&](uint64_t iters) { run(iters, true); });
+  b.run("decode", p, [&](uint64_t iters) { run(iters, false); });
+}
+
+/* 1M of random bytes through Eastman code of (m, n) and back, round trip
+   is checked once, every operation is one byte of data */
+static void
+bench_encode (Bench &b, std::mt19937 &rng, int m, int n)
+{
+  CfEncoder enc(m, n);
+  vector<uint8_t> data(1 << 20), letters, back;
+  size_t used;
+
+  for (auto &c : data)
+    c = rng();
+
+  used = enc.encode(data.data(), data.size(), letters);
+  enc.finish(data.data() + used, data.size() - used, letters);
+
+  CfBlockDecoder check(enc);
+  used = check.feed(letters.data(), letters.size(), back);
+  if (!check.finish(letters.size() - used, back) || (back != data))
+    throw std::runtime_error("Encoder round trip failed for " + params(m, n));
+
+  string p = params(m, n) + " words=" + std::to_string(enc.size());
+
+  b.run("encode", p, [&](uint64_t iters) {
+    vector<uint8_t> out;
+    out.reserve(letters.size());
+    while (iters > 0)
+      {
+        size_t len = std::min<uint64_t>(iters, data.size());
+        out.clear();
+        enc.encode(data.data(), len, out);
+        iters -= len;
+      }
+    sink = out.size();
+  });
+
+  CfBlockDecoder dec(enc);
+  b.run("block_decode", p, [&](uint64_t iters) {
+    vector<uint8_t> out;
+    out.reserve(data.size());
+    while (iters > 0)
+      {
+        /* whole stream only, decoder needs final group */
+        dec.reset();
+        out.clear();
+        dec.feed(letters.data(), letters.size(), out);
+        iters -= std::min<uint64_t>(iters, data.size());
+      }
+    sink = out.size();
+  });
+}
+
+/* compiled in code of (M, N) shall be the runtime one: same words in same
+   order, and rank and member agree with it over all M^N words, as rank
+   table CfDecoder and CfEncoder round trip; then rank of random words is
+   measured against hashed CfDecoder::lookup */
+template <int M, int N> static void
+bench_fixed (Bench &b, std::mt19937 &rng)
+{
+  typedef FixedCode<M, N> F;
+  auto code = eastman_code(M, N);
+  CfDecoder dec(code), fdec(M, N, F::ranks(), F::size);
+  FixedCodeRef ref = fixed_code(M, N);
+  string p = params(M, N) + " words=" + std::to_string(code.size());
+  uint8_t w[N];
+
+  if ((code.size() != size_t(F::size)) || (ref.size != code.size())
+      || (ref.code != F::word(0)) || (ref.rank != F::ranks()))
+    throw std::runtime_error("Fixed code size mismatch for " + params(M, N));
+  for (size_t r = 0; r != code.size(); ++r)
+    if (!std::equal(code[r].begin(), code[r].end(), F::word(r)))
+      throw std::runtime_error("Fixed code word mismatch for " + params(M, N));
+
+  for (uint32_t idx = 0; idx != uint32_t(F::space); ++idx)
+    {
+      for (int i = N - 1, x = idx; i >= 0; --i, x /= M)
+        w[i] = x % M;
+      if ((F::index(w) != idx) || (F::rank(w) != dec.lookup(w))
+          || (F::rank(w) != fdec.lookup(w))
+          || (F::member(w) != (F::rank(w) >= 0)))
+        throw std::runtime_error("Fixed code lookup mismatch for "
+                                 + params(M, N));
+    }
+
+  CfEncoder enc(M, N);
+  vector<uint8_t> data(4096), letters, back;
+  for (auto &c : data)
+    c = rng();
+  size_t used = enc.encode(data.data(), data.size(), letters);
+  enc.finish(data.data() + used, data.size() - used, letters);
+  /* two chunks cut at every offset of word, unconsumed tail of first one
+     is prepended to second; stream goes on after first one, so word read
+     past its end would be consumed */
+  for (size_t cut = letters.size() / 2; cut != letters.size() / 2 + N; ++cut)
+    {
+      CfBlockDecoder check(enc);
+      back.clear();
+      size_t used1 = check.feed(letters.data(), cut, back);
+      vector<uint8_t> rest(letters.begin() + used1, letters.end());
+      used = check.feed(rest.data(), rest.size(), back);
+      if (!enc.fixed().code || (used1 > cut)
+          || !check.finish(rest.size() - used, back) || (back != data))
+        throw std::runtime_error("Fixed code round trip failed for "
+                                 + params(M, N));
+    }
+
+  /* rank table decoder finds same words in stream, also damaged one */
+  letters[letters.size() / 2] = M;
+  vector<int32_t> found[2];
+  dec.decode_bytes(letters.data(), letters.size(), [&] (uint64_t, int32_t i) {
+    found[0].push_back(i);
+  });
+  fdec.decode_bytes(letters.data(), letters.size(), [&] (uint64_t, int32_t i) {
+    found[1].push_back(i);
+  });
+  if ((found[0] != found[1]) || (dec.stats().resyncs != 1)
+      || (fdec.stats().skipped != dec.stats().skipped))
+    throw std::runtime_error("Fixed code rank decoder mismatch for "
+                             + params(M, N));
+
+  vector<uint8_t> words(1024 * N);
+  for (auto &x : words)
+    x = rng() % M;
+
+  b.run("fixed_rank", p, [&](uint64_t iters) {
+    int acc = 0;
+    for (uint64_t i = 0; i != iters; ++i)
+      acc += F::rank(&words[(i % 1024) * N]);
+    sink = acc;
+  });
+  b.run("decoder_lookup", p, [&](uint64_t iters) {
+    int acc = 0;
+    for (uint64_t i = 0; i != iters; ++i)
+      acc += dec.lookup(&words[(i % 1024) * N]);
+    sink = acc;
+  });
+  b.run("decoder_rank", p, [&](uint64_t iters) {
+    int acc = 0;
+    for (uint64_t i = 0; i != iters; ++i)
+      acc += fdec.lookup(&words[(i % 1024) * N]);
+    sink = acc;
+  });
+
+  b.run("code_setup", p + " runtime", [&](uint64_t iters) {
+    for (uint64_t i = 0; i != iters; ++i)
+      sink = eastman_code(M, N).size();
+  });
+  b.run("code_setup", p + " fixed", [&](uint64_t iters) {
+    for (uint64_t i = 0; i != iters; ++i)
+      sink = fixed_code(M, N).code[0];
+  });
+}
+
+/* bench_fixed for every code of cf_tables.inc (FIXED_CODES) */
+struct FixedBench
+{
+  Bench &b;
+  std::mt19937 &rng;
+
+  template <int M, int N> void run () { bench_fixed<M, N>(b, rng); }
+};
+
+/* exact count of accepted routes of Lyndon classes of (m, n) (as
+   cf_all_paths --exact), checked by walk of all n^N routes if asked */
+static void
+bench_route_count (Bench &b, int m, int n, bool walk)
+{
+  vector< vector<int> > classes;
+  PrimeGen pg(m, n);
+  for (const vector<int> &w : pg.range())
+    classes.push_back(w);
+
+  RouteCounter::count_t nok = RouteCounter(classes, n).accepted();
+  string p = params(m, n) + " accepted=" + RouteCounter::str(nok);
+
+  if (walk)
+    {
+      vector<int> config(classes.size(), n - 1);
+      Tuples t(config);
+      uint64_t nwalk = 0;
+      for (const vector<int> &route : t.range())
+        {
+          Cfdict d(n);
+          bool ok = true;
+          for (size_t j = 0; ok && (j != route.size()); ++j)
+            {
+              vector<int> w(classes[j]);
+              std::rotate(w.begin(), w.begin() + route[j], w.end());
+              ok = (0 == d.add_tuple(w, true));
+            }
+          nwalk += ok;
+        }
+      if (nwalk != nok)
+        throw std::runtime_error("RouteCounter mismatch for " + params(m, n));
+    }
+
+  b.run("route_count", p, [&](uint64_t iters) {
+    for (uint64_t i = 0; i != iters; ++i)
+      sink = uint64_t(RouteCounter(classes, n).accepted());
+  });
+}
+
+/* hot paths which shall not allocate in steady state */
+static void
+check_alloc ()
+{
+  const int m = 3, n = 9;
+  vector<int> res(n), config(n, m - 1), nxt(n);
+  PrimeGen pg(m, n);
+  Tuples t(config);
+  bool more = true;
+
+  while (more)
+    {
+      AllocForbid guard("PrimeGen::get_next");
+      more = pg.get_next(res);
+    }
+
+  more = true;
+  while (more)
+    {
+      AllocForbid guard("Tuples::get_next");
+      more = t.get_next(nxt);
+    }
+
+  {
+    PrimeGen pv(m, n);
+    AllocForbid guard("PrimeGen::range");
+    for (const vector<int> &w : pv.range())
+      sink += w[0];
+    for (const vector<int> &w : t.range())
+      sink += w[0];
+  }
+
+  for (const auto &w : adversarial_words(255))
+    {
+      AllocForbid guard("canonical_rotation");
+      sink = canonical_rotation(w).offset;
+    }
+
+  {
+    auto code = eastman_code(3, 7);
+    ConcurrentCfdict d(7);
+    for (const auto &x : code)
+      d.insert(x);
+    for (const auto &x : code)
+      {
+        AllocForbid guard("ConcurrentCfdict::check");
+        sink = d.check(x);
+      }
+  }
+
+  {
+    auto code = eastman_code(3, 7);
+    vector<int> flat;
+    for (const auto &x : code)
+      flat.insert(flat.end(), x.begin(), x.end());
+    TrieCfdict t(7, flat);
+    for (const auto &x : code)
+      {
+        AllocForbid guard("TrieCfdict::check");
+        sink = t.check(x) + t.find(x);
+      }
+  }
+
+  cout << "no allocations on hot paths" << endl;
+}
+
+int
+main (int argc, char **argv)
+{
+  Options opts;
+  process_command_line (argc, argv, opts);
+
+  if (opts.check_alloc)
+    {
+      check_alloc ();
+      return 0;
+    }
+
+  Bench b(opts.min_ms, opts.filter);
+  std::mt19937 rng(12345);
+
+  bench_primegen(b, 2, 20);
+  bench_primegen(b, 4, 10);
+  bench_tuples(b, 3, 8);
+  bench_tuples(b, 4, 16);
+  bench_pipeline(b, 2, 15);
+
+  {
+    auto code = eastman_code(3, 7);
+    for (size_t size : {16, 64, 256})
+      bench_add_tuple(b, code, size, false);
+    for (size_t size : {16, 64, 256})
+      bench_add_tuple(b, code, size, true);
+  }
+
+  bench_cdict(b, rng, 3, 7);
+
+  bench_bdict(b, rng, 3, 5, true);
+  bench_bdict(b, rng, 2, 9, true);
+  bench_bdict(b, rng, 2, 13, false);
+
+  bench_eastman_both(b, "random", 4, 15, random_words(rng, 4, 15, 1024));
+  bench_eastman_both(b, "random", 2, 63, random_words(rng, 2, 63, 1024));
+  for (int n : {15, 63, 255})
+    bench_eastman_both(b, "adversarial", 2, n, adversarial_words(n));
+  bench_eastman_both(b, "long", 16, 4095, random_words(rng, 16, 4095, 16));
+
+  bench_eastman_both(b, "random", 2, 7, random_words(rng, 2, 7, 1024));
+  bench_eastman_batch(b, "random", 2, 7, random_words(rng, 2, 7, 1024));
+  bench_eastman_batch(b, "random", 4, 15, random_words(rng, 4, 15, 1024));
+  /* few adversarial words would leave lanes empty, they are repeated */
+  vector< vector<int> > adv = adversarial_words(15), advs;
+  while (advs.size() < 1024)
+    advs.push_back(adv[advs.size() % adv.size()]);
+  bench_eastman_batch(b, "adversarial", 2, 15, advs);
+  bench_eastman_batch(b, "random", 2, 31, random_words(rng, 2, 31, 1024));
+
+  {
+    vector< vector<int> > mixed;
+    const int lens[] = { 7, 15, 31, 9, 63, 15, 7, 31 };
+    while (mixed.size() < 8192)
+      {
+        int n = lens[rng() % 8];
+        mixed.push_back(random_words(rng, 4, n, 1)[0]);
+      }
+    bench_schedule(b, "mixed n=7..63", mixed);
+    bench_schedule(b, "m=4 n=15", random_words(rng, 4, 15, 8192));
+  }
+
+  for (int n : {15, 255, 4095})
+    bench_sliding(b, rng, 4, n);
+
+  bench_primes(b, 2, 21);
+  bench_primes(b, 3, 13);
+
+  bench_trie(b, rng, 4, 9);
+  bench_trie(b, rng, 2, 21);
+
+  bench_canon(b, "random", 4, 15, random_words(rng, 4, 15, 1024));
+  bench_canon(b, "adversarial", 2, 255, adversarial_words(255));
+  bench_canon(b, "long", 16, 4095, random_words(rng, 16, 4095, 16));
+
+  bench_decode(b, rng, eastman_code(2, 7), 1 << 18);
+  bench_decode(b, rng, eastman_code(3, 7), 1 << 18);
+  bench_encode(b, rng, 4, 5);
+  bench_encode(b, rng, 16, 3);
+
+  FixedBench fb = { b, rng };
+  for_each_fixed_code (fb);
+
+  bench_route_count(b, 2, 5, true);
+  bench_route_count(b, 3, 3, true);
+  bench_route_count(b, 2, 6, true);
+  bench_route_count(b, 3, 4, false);
+  bench_route_count(b, 2, 7, false);
+
+  if (b.results().empty())
+    {
+      cerr << "No benchmark matches filter " << opts.filter << endl;
+      return 1;
+    }
+
+  std::ofstream ofs;
+  if (!opts.out.empty())
+    {
+      ofs.open(opts.out);
+      if (!ofs)
+        throw std::runtime_error("Can not open output " + opts.out);
+    }
+  std::ostream &os = opts.out.empty() ? cout : ofs;
+
+  if (opts.csv)
+    b.print_csv(os);
+  else if (opts.json)
+    b.print_json(os);
+  else
+    b.print_table(os);
+
+  if (opts.alloc_report)
+    alloc_report (stdout);
+
+  if (!opts.baseline.empty())
+    return (b.compare(opts.baseline, opts.tolerance, cout) > 0) ? 1 : 0;
+
+  return 0;
+}
+
+void
+process_command_line (int argc, char **argv, Options &opts)
+{
+  int idx;
+
+  for (idx = 1; idx < argc; ++idx)
+    {
+      string arg = argv[idx];
+      bool has_val = (idx + 1 < argc);
+
+      if (arg == "--csv")
+        opts.csv = true;
+      else if (arg == "--json")
+        opts.json = true;
+      else if (arg == "--alloc-report")
+        opts.alloc_report = true;
+      else if (arg == "--check-alloc")
+        opts.check_alloc = true;
+      else if (arg == "--out" && has_val)
+        opts.out = argv[++idx];
+      else if (arg == "--filter" && has_val)
+        opts.filter = argv[++idx];
+      else if (arg == "--compare" && has_val)
+        opts.baseline = argv[++idx];
+      else if (arg == "--min-ms" && has_val)
+        opts.min_ms = atof(argv[++idx]);
+      else if (arg == "--tolerance" && has_val)
+        opts.tolerance = atof(argv[++idx]);
+      else
+        {
+          cerr << "usage: \"" << argv[0] << " [--csv | --json] [--out file]"
+                  " [--filter substr] [--min-ms ms] [--compare baseline.csv]"
+                  " [--tolerance percent] [--alloc-report]"
+                  " [--check-alloc]\"" << endl;
+          throw std::runtime_error("incorrect command line");
+        }
+    }
+
+  if (opts.min_ms <= 0)
+    {
+      cerr << "min-ms shall be > 0" << endl;
+      throw std::runtime_error("incorrect command line");
+    }
+}
@@ -0,0 +1,205 @@
+//===------- cf_bench.hpp -- micro and macro benchmark harness ------------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains definition and implementation of Bench class which
+// runs named cases with automatic iteration calibration and collects
+// ns/op, throughput and allocations per operation
+//
+// Results might be printed as table, CSV or JSON. CSV output of previous run
+// might be used as baseline: every case is compared against baseline and
+// regressions above given tolerance are reported
+//
+// Allocation counts are taken from allocation tracker, see cf_alloc.hpp
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_BENCH_GUARD_
+#define CF_BENCH_GUARD_
+
+#include <vector>
+#include <string>
+#include <map>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdint>
+#include <stdexcept>
+
+#include "cf_alloc.hpp"
+
+using std::vector;
+using std::string;
+
+/* result of single benchmark case */
+struct BenchResult
+{
+  string name;
+  string params;
+  uint64_t ops;
+  double ns_per_op;
+  double ops_per_sec;
+  double allocs_per_op;
+  double bytes_per_op;
+
+  string key () const { return name + "/" + params; }
+};
+
+/* benchmark runner */
+class Bench
+{
+  double m_min_ns;
+  string m_filter;
+  vector<BenchResult> m_results;
+
+public:
+  Bench (double min_ms = 200.0, string filter = "") :
+    m_min_ns(min_ms * 1e6), m_filter(filter) {}
+
+  /* f(iters) shall perform exactly iters operations
+     iteration count doubles until minimal time reached */
+  template <typename F> void
+  run (const string &name, const string &params, F f)
+    {
+      BenchResult r;
+      uint64_t iters = 1;
+
+      if (!m_filter.empty() &&
+          (name + "/" + params).find(m_filter) == string::npos)
+        return;
+
+      for (;;)
+        {
+          uint64_t a0 = alloc_total_count(), b0 = alloc_total_bytes();
+          auto start = std::chrono::steady_clock::now();
+          f(iters);
+          auto fin = std::chrono::steady_clock::now();
+          double ns =
+            std::chrono::duration<double, std::nano>(fin - start).count();
+
+          if ((ns >= m_min_ns) || (iters >= (1ull << 40)))
+            {
+              r.name = name;
+              r.params = params;
+              r.ops = iters;
+              r.ns_per_op = ns / iters;
+              r.ops_per_sec = (ns > 0) ? (iters * 1e9 / ns) : 0.0;
+              r.allocs_per_op = double(alloc_total_count() - a0) / iters;
+              r.bytes_per_op = double(alloc_total_bytes() - b0) / iters;
+              break;
+            }
+
+          /* grow toward minimal time, but not more than 10x per step */
+          double grow = (ns > 0) ? (m_min_ns * 1.2 / ns) : 10.0;
+          if (grow > 10.0) grow = 10.0;
+          if (grow < 2.0) grow = 2.0;
+          iters = static_cast<uint64_t>(iters * grow);
+        }
+
+      m_results.push_back(r);
+    }
+
+  const vector<BenchResult> &results () const { return m_results; }
+
+  void print_table (std::ostream &os) const
+    {
+      os << std::left << std::setw(28) << "case" << std::setw(22) << "params"
+         << std::right << std::setw(14) << "ns/op" << std::setw(16) << "ops/s"
+         << std::setw(12) << "allocs/op" << std::setw(12) << "bytes/op"
+         << std::endl;
+      for (const auto &r : m_results)
+        os << std::left << std::setw(28) << r.name << std::setw(22) << r.params
+           << std::right << std::fixed << std::setprecision(1)
+           << std::setw(14) << r.ns_per_op
+           << std::setw(16) << std::setprecision(0) << r.ops_per_sec
+           << std::setw(12) << std::setprecision(2) << r.allocs_per_op
+           << std::setw(12) << std::setprecision(1) << r.bytes_per_op
+           << std::endl;
+    }
+
+  void print_csv (std::ostream &os) const
+    {
+      os << "name,params,ops,ns_per_op,ops_per_sec,allocs_per_op,bytes_per_op"
+         << std::endl;
+      for (const auto &r : m_results)
+        os << r.name << "," << r.params << "," << r.ops << ","
+           << std::setprecision(6) << r.ns_per_op << "," << r.ops_per_sec
+           << "," << r.allocs_per_op << "," << r.bytes_per_op << std::endl;
+    }
+
+  void print_json (std::ostream &os) const
+    {
+      os << "[" << std::endl;
+      for (size_t i = 0; i != m_results.size(); ++i)
+        {
+          const auto &r = m_results[i];
+          os << "  {\"name\": \"" << r.name << "\", \"params\": \"" << r.params
+             << "\", \"ops\": " << r.ops << std::setprecision(6)
+             << ", \"ns_per_op\": " << r.ns_per_op
+             << ", \"ops_per_sec\": " << r.ops_per_sec
+             << ", \"allocs_per_op\": " << r.allocs_per_op
+             << ", \"bytes_per_op\": " << r.bytes_per_op << "}"
+             << ((i + 1 != m_results.size()) ? "," : "") << std::endl;
+        }
+      os << "]" << std::endl;
+    }
+
+  /* compares with baseline CSV produced by print_csv
+     returns number of cases slower than baseline by more than tolerance % */
+  int compare (const string &baseline, double tolerance,
+               std::ostream &os) const
+    {
+      std::ifstream is(baseline);
+      std::map<string, double> base;
+      string line;
+      int nregr = 0;
+
+      if (!is)
+        throw std::runtime_error("Can not open baseline " + baseline);
+
+      getline(is, line); /* header */
+      while (getline(is, line))
+        {
+          std::istringstream ls(line);
+          string name, params, ops, ns;
+          getline(ls, name, ',');
+          getline(ls, params, ',');
+          getline(ls, ops, ',');
+          getline(ls, ns, ',');
+          if (!ns.empty())
+            base[name + "/" + params] = std::stod(ns);
+        }
+
+      os << "comparison with " << baseline << " (tolerance "
+         << tolerance << "%):" << std::endl;
+      for (const auto &r : m_results)
+        {
+          auto it = base.find(r.key());
+          os << "  " << std::left << std::setw(50) << r.key() << std::right;
+          if (it == base.end())
+            {
+              os << "  (no baseline)" << std::endl;
+              continue;
+            }
+          double delta = (r.ns_per_op - it->second) * 100.0 / it->second;
+          os << std::fixed << std::setprecision(1) << std::setw(12)
+             << it->second << " -> " << std::setw(12) << r.ns_per_op
+             << " ns/op  " << std::showpos << delta << "%" << std::noshowpos;
+          if (delta > tolerance)
+            {
+              os << "  REGRESSION";
+              nregr += 1;
+            }
+          os << std::endl;
+        }
+
+      return nregr;
+    }
+};
+
+#endif
@@ -0,0 +1,124 @@
+//===-- cf_canon.cpp -- canonical rotations of words ---------------------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains an executable programm which reads words (space
+// separated numbers, one word per line, any length) from stdin and
+// outputs least rotation of every word, its offset and primitivity:
+//
+// 1 0 0 2
+// 2 0 2 0
+//
+// gives
+//
+// 0 0 2 1 : 1 primitive
+// 0 2 0 2 : 1 periodic
+//
+// i.e. least rotation starts at x[offset]. Options:
+//
+// --primitive   drop periodic words, output least rotations only
+//               (so output is like cf_gen output)
+// --stats       latency of every word, see cf_stats.hpp
+//
+// see cf_canon.hpp for algorithm
+//
+//===----------------------------------------------------------------------===//
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "cf_canon.hpp"
+#include "cf_stats.hpp"
+
+using std::cout;
+using std::cin;
+using std::cerr;
+using std::endl;
+using std::vector;
+
+void process_command_line (int argc, char **argv, bool &primitive,
+                           bool &stats, double &interval);
+
+int
+main (int argc, char **argv)
+{
+  bool primitive = false, stats = false;
+  double interval = 0.0;
+  std::string line;
+  vector<int> x;
+  uint64_t nperiodic = 0;
+
+  process_command_line (argc, argv, primitive, stats, interval);
+
+  OpStats st("canon", interval);
+  std::ios::sync_with_stdio(false);
+
+  while (getline(cin, line))
+    {
+      int c;
+      x.clear();
+      for (std::istringstream ls(line); ls >> c; )
+        x.push_back(c);
+      if (x.empty())
+        continue;
+
+      OpStats::clock::time_point t0;
+      if (stats)
+        t0 = OpStats::now();
+
+      Canon r = canonical_rotation(x);
+
+      if (stats)
+        st.record(t0);
+
+      if (!r.primitive)
+        nperiodic += 1;
+      if (primitive && !r.primitive)
+        continue;
+
+      size_t n = x.size(), i;
+      for (i = 0; i != n; ++i)
+        cout << x[(r.offset + i) % n] << " ";
+      if (!primitive)
+        cout << ": " << r.offset << (r.primitive ? " primitive" : " periodic");
+      cout << "\n";
+    }
+
+  cout.flush();
+  if (stats)
+    {
+      st.finish();
+      cerr << "periodic words: " << nperiodic << endl;
+    }
+
+  return 0;
+}
+
+void
+process_command_line (int argc, char **argv, bool &primitive, bool &stats,
+                      double &interval)
+{
+  int idx;
+
+  for (idx = 1; idx < argc; ++idx)
+    {
+      std::string arg = argv[idx];
+
+      if (parse_stats_option (arg, stats, interval))
+        continue;
+      if (arg == "--primitive")
+        primitive = true;
+      else
+        {
+          cerr << "usage: \"" << argv[0] << " [--primitive] [--stats[=secs]]\""
+                  " reads words from stdin" << endl;
+          throw std::runtime_error("incorrect command line");
+        }
+    }
+}
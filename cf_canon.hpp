@@ -0,0 +1,89 @@
+//===------- cf_canon.hpp -- linear time canonical rotation ---------------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains routines which find lexicographically least rotation
+// of cyclic word (class representative, as cf_gen outputs) and tell if
+// word is primitive, i.e. not equal to any of its nontrivial rotations
+//
+// Two candidate starts i and j are compared letter by letter (cyclically).
+// On mismatch at distance k, the greater side can not start least
+// rotation at any of its next k + 1 positions: every such rotation is
+// greater than rotation of other side shifted by the same amount. So the
+// greater candidate jumps by k + 1, and every step either grows k or
+// moves some candidate forward: at most 3n comparisons, no memory.
+// Step has no data-dependent branches
+//
+// If k reaches n, rotations at i and j are equal, so word is periodic.
+// For periodic word this always happens: least rotation starts at several
+// positions, none of them is ever jumped over, so both candidates stop at
+// two of them
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_CANON_GUARD_
+#define CF_CANON_GUARD_
+
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+/* offset of least rotation: rotation is x[offset], x[offset+1] ... */
+struct Canon
+{
+  size_t offset;
+  bool primitive;
+};
+
+template <typename T> Canon
+canonical_rotation (const T *x, size_t n)
+{
+  size_t i = 0, j = 1, k = 0;
+  Canon res;
+
+  if (n < 2)
+    {
+      res.offset = 0;
+      res.primitive = (n == 1);
+      return res;
+    }
+
+  /* letters of random words mismatch unpredictably, so step is written
+     without branches, compiler turns it into conditional moves */
+  while ((i < n) && (j < n) && (k < n))
+    {
+      size_t a = i + k, b = j + k, kk = k + 1;
+      a -= (a >= n) ? n : 0;
+      b -= (b >= n) ? n : 0;
+
+      bool eq = (x[a] == x[b]), gt = (x[a] > x[b]);
+      i += gt ? kk : 0;
+      j += (!eq && !gt) ? kk : 0;
+      j += (i == j) ? 1 : 0;
+      k = eq ? kk : 0;
+    }
+
+  res.offset = std::min(i, j);
+  res.primitive = (k < n);
+  return res;
+}
+
+template <typename T> Canon
+canonical_rotation (const std::vector<T> &x)
+{
+  return canonical_rotation (x.data(), x.size());
+}
+
+/* rotates x to its least rotation in place, returns what was found */
+template <typename T> Canon
+canonicalize (std::vector<T> &x)
+{
+  Canon c = canonical_rotation (x.data(), x.size());
+  std::rotate(x.begin(), x.begin() + c.offset, x.end());
+  return c;
+}
+
+#endif
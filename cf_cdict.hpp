@@ -0,0 +1,561 @@
+//===------- cf_cdict.hpp -- concurrent comma-free dictionary -------------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains definition and implementation of ConcurrentCfdict
+// class: comma-free dictionary shared by many threads which test
+// candidates against it while it grows (greedy construction, parallel
+// checking). Accepts same words as Cfdict::add_tuple(w, true), but:
+//
+// - check is lock-free and O(n): only lookups of keys of word parts
+// - inserts are serialized by mutex, candidate which passed check is
+//   validated again only if dictionary changed since check began
+// - result (and conflict explanation) is returned per call, there is no
+//   shared error state
+//
+// For comma-free D adding w gives violation (z inside x . y, split
+// z = u . v, u is suffix of x, v is prefix of y) iff one of:
+//
+// - w is periodic or some rotation of w is in D (x = y = w)
+// - z = w: u in S, v in P, where S, P are proper suffixes and prefixes
+//   of D and w
+// - x = w, z in D: u is suffix of w and is in B = { u : z = u . v in D,
+//   v in P(D) }
+// - y = w, z in D: v is prefix of w and is in C = { v : z = u . v in D,
+//   u in S(D) }
+//
+// so sets W (words), S, P, B, C of 64-bit keys (hash of part mixed with
+// its length, WordKeys, shared with cf_snapshot.hpp) are kept. Insert of
+// w updates B and C also for older words: splits which waited for their
+// v (or u) to appear as prefix (or suffix) are kept in maps, visible to
+// inserting thread only, and move to B (or C) once, when it appears. Key
+// collision (probability about 2^-64 per lookup) might only reject good
+// candidate
+//
+// Key sets are insert-only open addressing tables of atomic slots. Table
+// which needs to grow is rebuilt by writer and published by pointer swap;
+// readers holding old table see consistent older set, replaced tables are
+// kept until dictionary is destroyed (like LocalSearch snapshots). Every
+// set only grows and every key is true fact about some dictionary, and
+// violations only grow with dictionary too, so rejection found on any
+// intermediate state is final
+//
+// insert_all tries list of candidates on several threads; with ordered
+// flag result is the same as sequential insertion in list order:
+// checks run in parallel, commits go in list order
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_CDICT_GUARD_
+#define CF_CDICT_GUARD_
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#include "cf_alloc.hpp"
+#include "cf_canon.hpp"
+
+using std::vector;
+
+/* slot of key in open addressing tables of power of two size, shared
+   with frozen tables of cf_snapshot.hpp */
+inline size_t
+key_slot (uint64_t key)
+{
+  return size_t(key >> 17) ^ size_t(key);
+}
+
+/* 64-bit keys of word parts (hash of part mixed with its length), and
+   check of candidate against sets of keys, whatever tables hold them */
+class WordKeys
+{
+  enum : uint64_t { base = 0x100000001b3ull };
+  enum { stack_len = 64 };
+
+  size_t m_n;
+  vector<uint64_t> m_pow;
+
+public:
+  /* results of check, as Cfdict::add_tuple */
+  enum { accepted = 0, cyclic = -1, conflict = 1 };
+
+  explicit WordKeys (size_t n) : m_n(n), m_pow(n + 1, 1)
+    {
+      for (size_t i = 1; i <= n; ++i)
+        m_pow[i] = m_pow[i - 1] * base;
+    }
+
+  size_t length () const { return m_n; }
+
+  static uint64_t mix (uint64_t k)
+    {
+      k ^= k >> 33;
+      k *= 0xff51afd7ed558ccdull;
+      k ^= k >> 33;
+      k *= 0xc4ceb9fe1a85ec53ull;
+      k ^= k >> 33;
+      return k ? k : 1;
+    }
+
+  static uint64_t key (uint64_t h, size_t len)
+    {
+      return mix(h + len * 0x9e3779b97f4a7c15ull);
+    }
+
+  /* prefix hashes of w, see cf_verify.hpp */
+  class Parts
+  {
+    const WordKeys &m_k;
+    uint64_t m_stack[stack_len + 1];
+    vector<uint64_t> m_heap;
+    uint64_t *m_h;
+
+  public:
+    template <typename L>
+    Parts (const WordKeys &k, const L *w) : m_k(k), m_h(m_stack)
+      {
+        if (k.m_n > stack_len)
+          {
+            m_heap.resize(k.m_n + 1);
+            m_h = m_heap.data();
+          }
+        m_h[0] = 0;
+        for (size_t i = 0; i != k.m_n; ++i)
+          m_h[i + 1] = m_h[i] * base + uint64_t(w[i]) + 1;
+      }
+
+    uint64_t hash (size_t a, size_t b) const
+      {
+        return m_h[b] - m_h[a] * m_k.m_pow[b - a];
+      }
+
+    /* key of w[a .. b) */
+    uint64_t part (size_t a, size_t b) const { return key(hash(a, b), b - a); }
+
+    /* key of w[r .. n) . w[0 .. r) */
+    uint64_t rotation (size_t r) const
+      {
+        size_t n = m_k.m_n;
+        return key(hash(r, n) * m_k.m_pow[r] + m_h[r], n);
+      }
+  };
+
+  /* result of insert of w into dictionary with sets of keys of words W,
+     suffixes S, prefixes P, and B, C (see cf_cdict.hpp); every set has
+     contains (key) */
+  template <typename W, typename S, typename P, typename B, typename C>
+  int check (const W &words, const S &sufs, const P &prefs, const B &left,
+             const C &right, const int *w) const
+    {
+      size_t n = m_n, k;
+
+      if (!canonical_rotation(w, n).primitive)
+        return cyclic;
+
+      Parts p(*this, w);
+
+      for (k = 0; k != n; ++k)
+        if (words.contains(p.rotation(k)))
+          return conflict;
+
+      for (k = 1; k != n; ++k)
+        {
+          uint64_t u = p.part(0, k), v = p.part(k, n);
+
+          /* z = w; u (v) might be suffix (prefix) of w itself */
+          if ((sufs.contains(u) || (u == p.part(n - k, n))) &&
+              (prefs.contains(v) || (v == p.part(0, n - k))))
+            return conflict;
+
+          /* x = w: suffix of w as u; y = w: prefix of w as v */
+          if (left.contains(p.part(n - k, n)) || right.contains(u))
+            return conflict;
+        }
+
+      return accepted;
+    }
+};
+
+/* insert-only set of nonzero 64-bit keys: lock-free contains, insert by
+   single writer */
+class KeyTable
+{
+  struct Table
+  {
+    size_t mask;
+    std::unique_ptr< std::atomic<uint64_t>[] > slots;
+
+    explicit Table (size_t cap) : mask(cap - 1),
+      slots(new std::atomic<uint64_t>[cap])
+      {
+        for (size_t i = 0; i != cap; ++i)
+          slots[i].store(0, std::memory_order_relaxed);
+      }
+  };
+
+  std::atomic<Table *> m_cur;
+  vector< std::unique_ptr<Table> > m_all;  /* current and replaced */
+  size_t m_used;
+
+  static bool put (Table &t, uint64_t key)
+    {
+      for (size_t s = key_slot(key) & t.mask; ; s = (s + 1) & t.mask)
+        {
+          uint64_t v = t.slots[s].load(std::memory_order_relaxed);
+          if (v == key)
+            return false;
+          if (v == 0)
+            {
+              t.slots[s].store(key, std::memory_order_release);
+              return true;
+            }
+        }
+    }
+
+public:
+  KeyTable () : m_cur(nullptr), m_used(0)
+    {
+      m_all.emplace_back(new Table(64));
+      m_cur.store(m_all.back().get());
+    }
+
+  KeyTable (const KeyTable &) = delete;
+  KeyTable &operator= (const KeyTable &) = delete;
+
+  size_t size () const { return m_used; }
+
+  bool contains (uint64_t key) const
+    {
+      const Table *t = m_cur.load(std::memory_order_acquire);
+      for (size_t s = key_slot(key) & t->mask; ; s = (s + 1) & t->mask)
+        {
+          uint64_t v = t->slots[s].load(std::memory_order_acquire);
+          if (v == key)
+            return true;
+          if (v == 0)
+            return false;
+        }
+    }
+
+  /* writer only; true if key is new */
+  bool insert (uint64_t key)
+    {
+      Table *t = m_cur.load(std::memory_order_relaxed);
+
+      /* load at most 1/2: grow before insert, readers keep old table */
+      if (2 * (m_used + 1) > t->mask + 1)
+        {
+          Table *g = new Table(2 * (t->mask + 1));
+          m_all.emplace_back(g);
+          for (size_t i = 0; i <= t->mask; ++i)
+            {
+              uint64_t v = t->slots[i].load(std::memory_order_relaxed);
+              if (v != 0)
+                put(*g, v);
+            }
+          m_cur.store(g, std::memory_order_release);
+          t = g;
+        }
+
+      if (!put(*t, key))
+        return false;
+      m_used += 1;
+      return true;
+    }
+};
+
+class ConcurrentCfdict
+{
+public:
+  /* result of check or insert, as Cfdict::add_tuple: 0 accepted,
+     -1 candidate is cyclic itself, 1 conflict with dictionary */
+  enum
+  {
+    accepted = WordKeys::accepted,
+    cyclic = WordKeys::cyclic,
+    conflict = WordKeys::conflict
+  };
+
+private:
+  typedef WordKeys::Parts Parts;
+
+  size_t m_n;
+  WordKeys m_keys;
+  KeyTable m_words, m_sufs, m_prefs, m_left, m_right;
+
+  /* writer only: splits waiting for their v to become prefix (key of v
+     -> keys of u) and for their u to become suffix */
+  std::unordered_map< uint64_t, vector<uint64_t> > m_wait_v, m_wait_u;
+  vector<int> m_dict;             /* flat words, in insertion order */
+
+  mutable std::mutex m_mut;
+  std::atomic<uint64_t> m_version;
+
+  /* lock-free, against whatever sets are published now */
+  int check_word (const int *w) const
+    {
+      return m_keys.check(m_words, m_sufs, m_prefs, m_left, m_right, w);
+    }
+
+  void insert_locked (const int *w)
+    {
+      CF_ALLOC_SCOPE("ConcurrentCfdict::insert");
+      size_t n = m_n, k;
+      Parts p(m_keys, w);
+      vector<uint64_t> new_prefs, new_sufs;
+
+      for (k = 1; k != n; ++k)
+        {
+          if (m_prefs.insert(p.part(0, k)))
+            new_prefs.push_back(p.part(0, k));
+          if (m_sufs.insert(p.part(n - k, n)))
+            new_sufs.push_back(p.part(n - k, n));
+        }
+
+      /* splits of w itself */
+      for (k = 1; k != n; ++k)
+        {
+          uint64_t u = p.part(0, k), v = p.part(k, n);
+          if (m_prefs.contains(v))
+            m_left.insert(u);
+          else
+            m_wait_v[v].push_back(u);
+          if (m_sufs.contains(u))
+            m_right.insert(v);
+          else
+            m_wait_u[u].push_back(v);
+        }
+
+      /* older splits completed by new prefixes and suffixes */
+      for (uint64_t v : new_prefs)
+        {
+          auto it = m_wait_v.find(v);
+          if (it == m_wait_v.end())
+            continue;
+          for (uint64_t u : it->second)
+            m_left.insert(u);
+          m_wait_v.erase(it);
+        }
+
+      for (uint64_t u : new_sufs)
+        {
+          auto it = m_wait_u.find(u);
+          if (it == m_wait_u.end())
+            continue;
+          for (uint64_t v : it->second)
+            m_right.insert(v);
+          m_wait_u.erase(it);
+        }
+
+      m_words.insert(p.rotation(0));
+      m_dict.insert(m_dict.end(), w, w + n);
+      m_version.fetch_add(1, std::memory_order_release);
+    }
+
+  void check_size (const vector<int> &w) const
+    {
+      if (w.size() != m_n)
+        throw std::runtime_error("Incorrect size of candidate");
+    }
+
+public:
+  explicit ConcurrentCfdict (size_t n) : m_n(n), m_keys(n), m_version(0)
+    {
+      if (n == 0)
+        throw std::runtime_error("ConcurrentCfdict: n shall be > 0");
+    }
+
+  size_t length () const { return m_n; }
+
+  /* number of words, grows while others insert */
+  uint64_t size () const { return m_version.load(std::memory_order_acquire); }
+
+  /* lock-free: result of insert of w into current dictionary */
+  int check (const vector<int> &w) const
+    {
+      check_size (w);
+      return check_word (w.data());
+    }
+
+  /* checks and inserts w, returns accepted, cyclic or conflict */
+  int insert (const vector<int> &w)
+    {
+      check_size (w);
+      uint64_t ver = size();
+      int res = check_word (w.data());
+      if (res != accepted)
+        return res;
+
+      std::lock_guard<std::mutex> lock(m_mut);
+      if ((size() != ver) && ((res = check_word (w.data())) != accepted))
+        return res;
+      insert_locked (w.data());
+      return accepted;
+    }
+
+  /* inserts candidates on nthreads threads, result[i] is result for
+     cands[i]; ordered gives same dictionary and results as insertion
+     one by one in list order; returns number of accepted */
+  size_t insert_all (const vector< vector<int> > &cands, unsigned nthreads,
+                     bool ordered, vector<int> *result = nullptr)
+    {
+      vector<int> res(cands.size(), accepted);
+      std::atomic<size_t> next(0), naccepted(0);
+      std::condition_variable turn_cv;
+      size_t turn = 0;
+
+      for (const auto &w : cands)
+        check_size (w);
+
+      auto worker = [&] () {
+        for (;;)
+          {
+            size_t i = next.fetch_add(1);
+            if (i >= cands.size())
+              break;
+
+            const int *w = cands[i].data();
+            uint64_t ver = size();
+            int r = check_word (w);
+
+            std::unique_lock<std::mutex> lock(m_mut);
+            if (ordered)
+              turn_cv.wait(lock, [&] { return turn == i; });
+
+            if ((r == accepted) && (size() != ver))
+              r = check_word (w);
+            if (r == accepted)
+              {
+                insert_locked (w);
+                naccepted += 1;
+              }
+            res[i] = r;
+
+            if (ordered)
+              {
+                turn += 1;
+                turn_cv.notify_all();
+              }
+          }
+      };
+
+      vector<std::thread> threads;
+      for (unsigned t = 1; t < nthreads; ++t)
+        threads.emplace_back(worker);
+      worker();
+      for (auto &th : threads)
+        th.join();
+
+      if (result)
+        result->swap(res);
+      return naccepted;
+    }
+
+  /* witness of rejection as Cfdict::add_tuple (w, true) leaves it in
+     m_lasterr: doubled dictionary word if w is its rotation, otherwise
+     x . y containing w or containing dictionary word, if x or y is w,
+     first one in order of Cfdict::verify_dict; empty if w fits. Only
+     first upto words (in insertion order) are used, so rejection by
+     insert_all is explained as it was seen. Exact search, for error
+     reports only: offsets where dictionary word may overlap w are found
+     once per word, pairs are scanned only for words having them */
+  vector<int> explain (const vector<int> &w, size_t upto = ~size_t(0)) const
+    {
+      check_size (w);
+      std::lock_guard<std::mutex> lock(m_mut);
+      size_t n = m_n, cnt = std::min(upto, m_dict.size() / n), i, j, off;
+      const int *d = m_dict.data(), *v = w.data();
+      vector<int> err;
+      vector<size_t> a1, a2, c1, c2;
+
+      auto word = [&] (size_t k) { return d + k * n; };
+      auto found = [&] (const int *x, const int *y) {
+        err.assign(x, x + n);
+        err.insert(err.end(), y, y + n);
+        return err;
+      };
+      /* x . y contains z at offset off */
+      auto at = [&] (const int *x, const int *y, const int *z, size_t off) {
+        return std::equal(x + off, x + n, z)
+               && std::equal(y, y + off, z + n - off);
+      };
+
+      for (i = 0; i != cnt; ++i)
+        for (off = 0; off != n; ++off)
+          if (at(word(i), word(i), v, off))
+            return found(word(i), word(i));
+
+      for (i = 0; i != cnt; ++i)
+        {
+          const int *x = word(i);
+
+          /* offsets where x may be first (a1) or second (a2) around w,
+             or w may be first (c1) or second (c2) around x */
+          a1.clear(); a2.clear(); c1.clear(); c2.clear();
+          for (off = 1; off != n; ++off)
+            {
+              if (std::equal(x + off, x + n, v))
+                a1.push_back(off);
+              if (std::equal(x, x + off, v + n - off))
+                a2.push_back(off);
+              if (std::equal(v + off, v + n, x))
+                c1.push_back(off);
+              if (std::equal(v, v + off, x + n - off))
+                c2.push_back(off);
+            }
+
+          /* w as z */
+          if (!a1.empty() || !a2.empty())
+            for (j = i + 1; j != cnt; ++j)
+              {
+                for (size_t o : a1)
+                  if (at(x, word(j), v, o))
+                    return found(x, word(j));
+                for (size_t o : a2)
+                  if (at(word(j), x, v, o))
+                    return found(word(j), x);
+              }
+          for (size_t o : a1)
+            if (at(x, v, v, o))
+              return found(x, v);
+          for (size_t o : a2)
+            if (at(v, x, v, o))
+              return found(v, x);
+
+          /* w as x or y, dictionary word as z */
+          if (!c1.empty() || !c2.empty())
+            for (j = 0; j != cnt; ++j)
+              {
+                for (size_t o : c1)
+                  if (at(v, word(j), x, o))
+                    return found(v, word(j));
+                for (size_t o : c2)
+                  if (at(word(j), v, x, o))
+                    return found(word(j), v);
+              }
+        }
+
+      return err;
+    }
+
+  void get_dict (vector< vector<int> > &out) const
+    {
+      std::lock_guard<std::mutex> lock(m_mut);
+      out.clear();
+      for (size_t i = 0; i != m_dict.size(); i += m_n)
+        out.emplace_back(m_dict.begin() + i, m_dict.begin() + i + m_n);
+    }
+};
+
+#endif
@@ -16,14 +16,71 @@
 // because 1 2 0 2 1 1 contains 2 0 2 in the midst
 // i. e. suffix "2 0" is both head of "2 0 2" and tail of "1 2 0"
 //
+// option --stats (or --stats=secs for periodic reports) prints latency of
+// every dictionary insert to stderr, see cf_stats.hpp; only sequential
+// word by word check has it, other modes reject it
+//
+// option --verify checks complete code at once, for codes too big for
+// word by word insertion (like Eastman codes with millions of words):
+//
+// ./cf_check --verify 25 code.txt
+//
+// code is read from given file (mapped to memory) or from stdin, same
+// format. Prints verdict and first violating triples, exit status is 1 if
+// code is not comma-free. Options of this mode:
+//
+// --threads N   number of threads (default: number of cores)
+// --mem MB      memory for prefix and suffix sets (default 4096), bigger
+//               sets are checked by passes through temporary files
+// --tmp dir     directory for temporary files (default $TMPDIR or /tmp)
+// --report K    number of reported triples (default 10)
+//
+// see cf_verify.hpp for details
+//
+// option --threads N without --verify reads all input first and checks
+// words on N threads against shared ConcurrentCfdict (cf_cdict.hpp),
+// words are accepted in input order and rejections are explained by
+// same witnesses as Cfdict gives, so output is as without it
+//
+// option --save-snapshot file writes accepted dictionary (or code which
+// passed --verify) as binary snapshot, see cf_snapshot.hpp. Option
+// --snapshot file maps it instead of building dictionary, n might be
+// omitted then; every input line gets verdict, nothing is inserted:
+//
+// ./cf_check --verify --save-snapshot code.cfs 25 code.txt
+// ./cf_check --snapshot code.cfs < words.txt
+//
+// 0 1 1 0 ... : member        (word is in code)
+// 1 1 0 1 ... : accepted      (code with it is still comma-free)
+// ...         : cyclic | conflict
+//
+// option --trie file builds succinct trie of code from file (cf_trie.hpp)
+// and gives same verdicts, with few bytes per word of code instead of
+// tables of snapshot, for codes too big to keep otherwise:
+//
+// ./cf_check --trie code.txt 25 < words.txt
+//
 //===----------------------------------------------------------------------===//
 
 #include <iostream>
 #include <sstream>
 #include <vector>
 #include <string>
+#include <chrono>
+#include <iterator>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "cf_dict.hpp"
+#include "cf_stats.hpp"
+#include "cf_verify.hpp"
+#include "cf_cdict.hpp"
+#include "cf_snapshot.hpp"
+#include "cf_trie.hpp"
 
 using std::cout;
 using std::cin;
@@ -31,17 +88,320 @@ using std::cerr;
 using std::endl;
 using std::vector;
 
-void process_command_line (int argc, char **argv, int &n);
+struct Options
+{
+  int n = 0;
+  bool stats = false, verify = false;
+  double interval = 0.0;
+  unsigned threads = 0;
+  size_t mem = 4096, report = 10;
+  std::string input, tmp, snapshot, save_snapshot, trie;
+};
+
+void process_command_line (int argc, char **argv, Options &opts);
+
+/* appends words of text p[0 .. len) to words, lines of n numbers,
+   empty lines are skipped */
+static void
+parse_code (const char *p, size_t len, size_t n, vector<int> &words)
+{
+  const char *e = p + len;
+  size_t line = 1;
+
+  while (p != e)
+    {
+      size_t cnt = 0;
+      for (;;)
+        {
+          while ((p != e) && ((*p == ' ') || (*p == '\t') || (*p == '\r')))
+            ++p;
+          if ((p == e) || (*p == '\n'))
+            break;
+          if ((*p < '0') || (*p > '9'))
+            throw std::runtime_error("Not a number at line "
+                                     + std::to_string(line));
+          int v = 0;
+          while ((p != e) && (*p >= '0') && (*p <= '9'))
+            v = v * 10 + (*p++ - '0');
+          words.push_back(v);
+          cnt += 1;
+        }
+
+      if ((cnt != 0) && (cnt != n))
+        throw std::runtime_error("You should enter " + std::to_string(n)
+                                 + " numbers at line " + std::to_string(line));
+      if (p != e)
+        ++p;
+      line += 1;
+    }
+}
+
+/* appends words of code file (mapped to memory), or of stdin if path is
+   empty */
+static void
+read_code (const std::string &path, size_t n, vector<int> &words)
+{
+  if (path.empty())
+    {
+      std::string text((std::istreambuf_iterator<char>(cin)),
+                       std::istreambuf_iterator<char>());
+      parse_code (text.data(), text.size(), n, words);
+      return;
+    }
+
+  struct stat sb;
+  int fd = open(path.c_str(), O_RDONLY);
+  if ((fd < 0) || (fstat(fd, &sb) != 0))
+    throw std::runtime_error("Can not open " + path);
+
+  size_t len = sb.st_size;
+  if (len > 0)
+    {
+      void *p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p == MAP_FAILED)
+        throw std::runtime_error("Can not map " + path);
+      madvise(p, len, MADV_SEQUENTIAL);
+      parse_code (static_cast<const char *>(p), len, n, words);
+      munmap(p, len);
+    }
+  close(fd);
+}
+
+/* writes words (flat or per word) as snapshot, if it is asked for */
+static void
+save_snapshot (const Options &opts, const vector<int> &flat)
+{
+  if (opts.save_snapshot.empty())
+    return;
+  CfSnapshot::write(opts.save_snapshot, opts.n, flat);
+  cerr << "snapshot of " << flat.size() / opts.n << " words saved to "
+       << opts.save_snapshot << endl;
+}
+
+static void
+save_snapshot (const Options &opts, const vector< vector<int> > &words)
+{
+  vector<int> flat;
+  for (const auto &w : words)
+    flat.insert(flat.end(), w.begin(), w.end());
+  save_snapshot (opts, flat);
+}
+
+/* verdict for every input line against dictionary of words of size n
+   (CfSnapshot or TrieCfdict) */
+template <typename D>
+static int
+query_dict (const D &dict, size_t n)
+{
+  std::string line;
+
+  while (getline(cin, line))
+    {
+      vector<int> w;
+      int c;
+      for (std::istringstream is(line); is >> c; )
+        w.push_back(c);
+      if (w.size() != n)
+        {
+          cout << "You should enter " << n << " space-separated numbers"
+               << endl;
+          continue;
+        }
+
+      const char *verdict = "member";
+      if (dict.find(w) < 0)
+        switch (dict.check(w))
+          {
+          case ConcurrentCfdict::accepted:
+            verdict = "accepted";
+            break;
+          case ConcurrentCfdict::cyclic:
+            verdict = "cyclic";
+            break;
+          default:
+            verdict = "conflict";
+          }
+
+      for (size_t i = 0; i != n; ++i)
+        cout << (i ? " " : "") << w[i];
+      cout << " : " << verdict << '\n';
+    }
+
+  return 0;
+}
+
+/* verdicts against mapped snapshot */
+static int
+query_snapshot (const Options &opts)
+{
+  auto start = std::chrono::steady_clock::now();
+  CfSnapshot snap(opts.snapshot);
+  double ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+  size_t n = snap.length();
+
+  if ((opts.n != 0) && (size_t(opts.n) != n))
+    throw std::runtime_error("Snapshot " + opts.snapshot + " has words of size "
+                             + std::to_string(n));
+  cerr << snap.size() << " words of size " << n << " mapped in " << ms
+       << " ms" << endl;
+
+  return query_dict (snap, n);
+}
+
+/* verdicts against succinct trie of code file */
+static int
+query_trie (const Options &opts)
+{
+  vector<int> words;
+  auto start = std::chrono::steady_clock::now();
+
+  read_code (opts.trie, opts.n, words);
+  TrieCfdict trie(opts.n, words);
+  vector<int>().swap(words);
+
+  double ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+  cerr << trie.size() << " words of size " << opts.n << " in " << trie.bytes()
+       << " bytes of trie, built in " << ms << " ms" << endl;
+
+  return query_dict (trie, opts.n);
+}
+
+static int
+verify_code (const Options &opts)
+{
+  vector<int> words;
+  auto start = std::chrono::steady_clock::now();
+
+  read_code (opts.input, opts.n, words);
+
+  CodeVerifier v(opts.n, std::move(words));
+  if (opts.threads != 0)
+    v.set_threads (opts.threads);
+  v.set_memory (opts.mem << 20, opts.tmp);
+
+  CodeVerifier::Result res = v.verify(opts.report);
+  double secs = std::chrono::duration<double>(
+                  std::chrono::steady_clock::now() - start).count();
+
+  cout << v.size() << " words of size " << opts.n << ": "
+       << (res.comma_free ? "comma-free" : "not comma-free") << endl;
+
+  auto put = [&v] (size_t i) {
+    for (size_t j = 0; j != v.length(); ++j)
+      cout << (j ? " " : "") << v.word(i)[j];
+  };
+
+  for (const auto &t : res.triples)
+    {
+      cout << "error: ";
+      put (t.x);
+      cout << " | ";
+      put (t.y);
+      cout << " contains ";
+      put (t.z);
+      cout << " at offset " << t.offset << endl;
+    }
+
+  if (!res.comma_free)
+    cout << res.flagged << " violating splits" << endl;
+  else if (!opts.save_snapshot.empty())
+    {
+      vector<int> flat;
+      flat.reserve(v.size() * v.length());
+      for (size_t i = 0; i != v.size(); ++i)
+        flat.insert(flat.end(), v.word(i), v.word(i) + v.length());
+      save_snapshot (opts, flat);
+    }
+
+  cerr << "verified in " << secs << "s, " << res.passes << " passes" << endl;
+  return res.comma_free ? 0 : 1;
+}
+
+/* same output as interactive mode, but all input is read first and
+   candidates are checked on several threads, committed in input order */
+static int
+check_batch (const Options &opts)
+{
+  vector< vector<int> > words;
+  vector<size_t> line_word;       /* line -> word index or npos */
+  std::string line;
+  const size_t npos = ~size_t(0);
+
+  cout << "Comma-free checker. Input space-separated numbers of size "
+       << opts.n << endl;
+
+  while (getline(cin, line))
+    {
+      vector<int> w;
+      int c;
+      for (std::istringstream is(line); is >> c; )
+        w.push_back(c);
+      if (w.size() != size_t(opts.n))
+        line_word.push_back(npos);
+      else
+        {
+          line_word.push_back(words.size());
+          words.push_back(w);
+        }
+    }
+
+  ConcurrentCfdict d(opts.n);
+  vector<int> res;
+  size_t accepted = 0;
+  d.insert_all (words, opts.threads, true, &res);
+
+  for (size_t idx : line_word)
+    {
+      if (idx == npos)
+        cout << "You should enter " << opts.n << " space-separated numbers"
+             << endl;
+      else if (res[idx] == ConcurrentCfdict::accepted)
+        accepted += 1;
+      else if (res[idx] == ConcurrentCfdict::cyclic)
+        cout << "Input is cyclic" << endl;
+      else
+        {
+          cout << "error: ";
+          for (const auto &x : d.explain(words[idx], accepted))
+            cout << x;
+          cout << endl;
+        }
+    }
+
+  vector< vector<int> > dict;
+  d.get_dict(dict);
+  save_snapshot (opts, dict);
+  return 0;
+}
 
 int
 main (int argc, char **argv)
 {
-  int n;
+  Options opts;
+
+  process_command_line (argc, argv, opts);
+
+  if (!opts.snapshot.empty())
+    return query_snapshot (opts);
 
-  process_command_line (argc, argv, n);
+  if (!opts.trie.empty())
+    return query_trie (opts);
+
+  if (opts.verify)
+    return verify_code (opts);
+
+  if (opts.threads != 0)
+    return check_batch (opts);
+
+  int n = opts.n;
+  bool stats = opts.stats;
+  double interval = opts.interval;
 
   std::vector<int> nxt(n);
   Cfdict d(n);
+  OpStats st("insert", interval);
 
   cout << "Comma-free checker. Input space-separated numbers of size " << n << endl;
 
@@ -69,8 +429,15 @@ main (int argc, char **argv)
           continue;
         }
       
+      OpStats::clock::time_point t0;
+      if (stats)
+        t0 = OpStats::now();
+
       int res = d.add_tuple(nxt, true);
 
+      if (stats)
+        st.record(t0);
+
       if (0 == res)
         continue;
 
@@ -85,25 +452,95 @@ main (int argc, char **argv)
         cout << x;
       cout << endl;
     }
+
+  if (stats)
+    st.finish();
+
+  vector< vector<int> > dict;
+  d.get_dict(dict);
+  save_snapshot (opts, dict);
+  return 0;
 }
 
 void 
-process_command_line (int argc, char **argv, int &n)
+process_command_line (int argc, char **argv, Options &opts)
 {
-  if (argc < 2)
+  int idx, npos = 0;
+
+  for (idx = 1; idx < argc; ++idx)
+    {
+      std::string arg = argv[idx];
+      bool has_val = (idx + 1 < argc);
+
+      if (parse_stats_option (argv[idx], opts.stats, opts.interval))
+        continue;
+      if (arg == "--verify")
+        opts.verify = true;
+      else if (arg == "--threads" && has_val)
+        opts.threads = atoi(argv[++idx]);
+      else if (arg == "--mem" && has_val)
+        opts.mem = std::strtoull(argv[++idx], nullptr, 10);
+      else if (arg == "--tmp" && has_val)
+        opts.tmp = argv[++idx];
+      else if (arg == "--snapshot" && has_val)
+        opts.snapshot = argv[++idx];
+      else if (arg == "--trie" && has_val)
+        opts.trie = argv[++idx];
+      else if (arg == "--save-snapshot" && has_val)
+        opts.save_snapshot = argv[++idx];
+      else if (arg == "--report" && has_val)
+        opts.report = std::strtoull(argv[++idx], nullptr, 10);
+      else if (npos == 0)
+        {
+          opts.n = atoi (argv[idx]);
+          npos += 1;
+        }
+      else if (npos == 1)
+        {
+          opts.input = arg;
+          npos += 1;
+        }
+      else
+        npos += 1;
+    }
+
+  bool query = !opts.snapshot.empty(), trie = !opts.trie.empty();
+  if (((npos != 1) && !(opts.verify && (npos == 2)) && !(query && (npos == 0)))
+      || ((query || trie) && (opts.verify || !opts.save_snapshot.empty()))
+      || (query && trie))
     {
-      cerr << "usage: \"" << argv[0] << " n\" where n "
-              "is word block count" << endl;
+      cerr << "usage: \"" << argv[0] << " [--stats[=secs]] [--save-snapshot"
+              " file] n\" or \""
+           << argv[0] << " --verify [--threads N] [--mem MB] [--tmp dir]"
+              " [--report K] [--save-snapshot file] n [file]\" or \""
+           << argv[0] << " --snapshot file [n]\" or \""
+           << argv[0] << " --trie file n\" where n is word block count"
+           << endl;
       throw std::runtime_error("incorrect command line");
     }
 
-  n = atoi (argv[1]);
+  if (opts.stats && (query || trie || opts.verify || (opts.threads != 0)))
+    {
+      cerr << "--verify, --threads, --snapshot and --trie have no per-word"
+              " --stats" << endl;
+      throw std::runtime_error("incorrect command line");
+    }
+
+  if (query)
+    return;
 
-  if (n <= 0)
+  if (opts.n <= 0)
     {
       cerr << "Both n and k shall be > 0" << endl;
       throw std::runtime_error("incorrect command line");     
     }
-}
 
+  if (opts.verify && (opts.n < 2))
+    {
+      cerr << "n shall be > 1 for --verify" << endl;
+      throw std::runtime_error("incorrect command line");
+    }
 
+  if (opts.mem == 0)
+    opts.mem = 1;
+}
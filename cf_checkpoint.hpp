@@ -0,0 +1,205 @@
+//===------- cf_checkpoint.hpp -- checkpoints and shards of long runs -----===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains definition and implementation of Checkpoint class,
+// text file of "key value ..." lines which keeps position of generator and
+// partial counters of long enumeration, and Shard, part i of N of work
+//
+// Checkpoint is written to temporary file and renamed over old one, so
+// crash during save leaves previous checkpoint intact. Tools save it every
+// few seconds and on SIGINT / SIGTERM (see CheckpointSignals), then run
+// with same arguments resumes from it. Complete run keeps its final
+// checkpoint with "done 1": it is shard result, which merge step sums
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_CHECKPOINT_GUARD_
+#define CF_CHECKPOINT_GUARD_
+
+#include <map>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <csignal>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+
+class Checkpoint
+{
+  std::string m_path;
+  std::map< std::string, std::string > m_vals;
+
+public:
+  explicit Checkpoint (const std::string &path = "") : m_path(path) {}
+
+  const std::string &path () const { return m_path; }
+  bool enabled () const { return !m_path.empty(); }
+
+  /* false if there is no checkpoint file */
+  bool load ()
+    {
+      std::ifstream is(m_path);
+      std::string line;
+
+      m_vals.clear();
+      if (!is)
+        return false;
+
+      while (getline(is, line))
+        {
+          std::istringstream ls(line);
+          std::string key, rest;
+          if (!(ls >> key))
+            continue;
+          getline(ls >> std::ws, rest);
+          m_vals[key] = rest;
+        }
+
+      return true;
+    }
+
+  void save () const
+    {
+      std::string tmp = m_path + ".tmp";
+      {
+        std::ofstream os(tmp);
+        for (const auto &kv : m_vals)
+          os << kv.first << " " << kv.second << "\n";
+        os.flush();
+        if (!os)
+          throw std::runtime_error("Can not write checkpoint " + tmp);
+      }
+      if (std::rename(tmp.c_str(), m_path.c_str()) != 0)
+        throw std::runtime_error("Can not rename checkpoint to " + m_path);
+    }
+
+  bool has (const std::string &key) const { return m_vals.count(key) != 0; }
+
+  void set (const std::string &key, const std::string &v) { m_vals[key] = v; }
+
+  void set (const std::string &key, uint64_t v)
+    {
+      m_vals[key] = std::to_string(v);
+    }
+
+  void set (const std::string &key, const std::vector<int> &v)
+    {
+      std::string s;
+      for (size_t i = 0; i != v.size(); ++i)
+        s += (i ? " " : "") + std::to_string(v[i]);
+      m_vals[key] = s;
+    }
+
+  std::string get (const std::string &key) const
+    {
+      auto it = m_vals.find(key);
+      if (it == m_vals.end())
+        throw std::runtime_error("Checkpoint " + m_path + " has no " + key);
+      return it->second;
+    }
+
+  uint64_t get_u64 (const std::string &key) const
+    {
+      return std::strtoull(get(key).c_str(), nullptr, 10);
+    }
+
+  std::vector<int> get_ints (const std::string &key) const
+    {
+      std::vector<int> res;
+      std::istringstream is(get(key));
+      int x;
+      while (is >> x)
+        res.push_back(x);
+      return res;
+    }
+};
+
+/* part index of count (0-based), as --shard i/N */
+struct Shard
+{
+  uint64_t index = 0, count = 1;
+
+  /* parses "i/N", false on error */
+  bool parse (const std::string &s)
+    {
+      char *end;
+      size_t slash = s.find('/');
+      if (slash == std::string::npos)
+        return false;
+      index = std::strtoull(s.c_str(), &end, 10);
+      if (end != s.c_str() + slash)
+        return false;
+      count = std::strtoull(s.c_str() + slash + 1, &end, 10);
+      return (*end == 0) && (count > 0) && (index < count);
+    }
+
+  /* contiguous part [lo, hi) of total items */
+  uint64_t lo (uint64_t total) const { return part(total, index); }
+  uint64_t hi (uint64_t total) const { return part(total, index + 1); }
+
+  /* item number j belongs to shard, for round-robin split */
+  bool owns (uint64_t j) const { return j % count == index; }
+
+  std::string str () const
+    {
+      return std::to_string(index) + "/" + std::to_string(count);
+    }
+
+private:
+  uint64_t part (uint64_t total, uint64_t i) const
+    {
+      return uint64_t((unsigned __int128) total * i / count);
+    }
+};
+
+/* SIGINT and SIGTERM set flag, so tool saves checkpoint and exits; made
+   only with checkpoint, so plain runs keep default signal handling */
+class CheckpointSignals
+{
+  static volatile std::sig_atomic_t &flag ()
+    {
+      static volatile std::sig_atomic_t f = 0;
+      return f;
+    }
+
+  static void handler (int) { flag() = 1; }
+
+public:
+  CheckpointSignals ()
+    {
+      std::signal(SIGINT, handler);
+      std::signal(SIGTERM, handler);
+    }
+
+  ~CheckpointSignals ()
+    {
+      std::signal(SIGINT, SIG_DFL);
+      std::signal(SIGTERM, SIG_DFL);
+    }
+
+  bool raised () const { return flag() != 0; }
+};
+
+/* FNV-1a digest of input words, so checkpoint and shards are matched
+   to input they were made for */
+inline uint64_t
+words_digest (const std::vector< std::vector<int> > &words)
+{
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (const auto &w : words)
+    {
+      for (int x : w)
+        h = (h ^ uint64_t(uint32_t(x))) * 0x100000001b3ull;
+      h = (h ^ 0xffffffffull) * 0x100000001b3ull;
+    }
+  return h;
+}
+
+#endif
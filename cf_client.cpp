@@ -0,0 +1,508 @@
+//===-- cf_client.cpp -- text client of cf_serve daemon -------------------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains an executable programm which reads requests as text
+// lines from stdin, sends them to cf_serve and prints answers:
+//
+// add main 0 0 1           add main 0 0 1 : accepted
+// add main 0 1 0     ->    add main 0 1 0 : conflict
+// check main 1 0 0         check main 1 0 0 : conflict
+// eastman 3 0 1 2 0        eastman 3 0 1 2 0 : 3
+// canon 2 0 1 0            canon 2 0 1 0 : 1 primitive
+// dump main                0 0 1
+//
+// results of add and check are accepted, cyclic or conflict, dump prints
+// words one per line (cf_check input format). Options:
+//
+// --socket path  connect to daemon on unix socket
+// --exec cmd     run daemon as child on its stdin / stdout (like
+//                --exec ./cf_serve), it lives as long as client does
+// --batch K      up to K consecutive add (or check) lines of the same
+//                dictionary go in one request (default 256)
+// --window N     at most N requests wait for answer (default 1024)
+//
+// Requests are pipelined: lines are sent as they are read, answers are
+// printed by other thread. Batch is sent early when all input read so far
+// is sent, so interactive use gets answer per line
+//
+//===----------------------------------------------------------------------===//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "cf_serve.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+struct Options
+{
+  string socket, exec;
+  size_t batch = 256, window = 1024;
+};
+
+void process_command_line (int argc, char **argv, Options &opts);
+
+/* request waiting for answer: its op and text lines */
+struct Pending
+{
+  uint32_t id;
+  uint8_t op;
+  vector<string> lines;
+};
+
+class Client
+{
+  int m_fd;
+  size_t m_window;
+  std::mutex m_mut;
+  std::condition_variable m_cv;
+  std::deque<Pending> m_pending;
+  bool m_broken = false;
+  string m_out;
+
+  /* batch being collected */
+  uint8_t m_op = 0;
+  string m_name;
+  size_t m_n = 0;
+  vector<int> m_letters;
+  vector<string> m_lines;
+  uint32_t m_next = 0;
+
+  void write_all (const string &buf)
+    {
+      size_t sent = 0;
+      while (sent < buf.size())
+        {
+          ssize_t put = write(m_fd, buf.data() + sent, buf.size() - sent);
+          if (put < 0)
+            {
+              if (errno == EINTR)
+                continue;
+              throw std::runtime_error(string("write: ")
+                                       + std::strerror(errno));
+            }
+          sent += put;
+        }
+    }
+
+  /* queues request for answer before it is sent, waits for free window
+     slot; requests built so far are sent first, else answers which free
+     slots would never come */
+  void queue (uint8_t op, vector<string> &lines)
+    {
+      std::unique_lock<std::mutex> lock(m_mut);
+      if (m_pending.size() >= m_window)
+        {
+          lock.unlock();
+          send ();
+          lock.lock();
+        }
+      m_cv.wait(lock, [&] {
+        return m_broken || (m_pending.size() < m_window);
+      });
+      if (m_broken)
+        throw std::runtime_error("Connection to daemon lost");
+      m_pending.push_back(Pending{ m_next, op, vector<string>() });
+      m_pending.back().lines.swap(lines);
+    }
+
+  /* false on end of stream */
+  bool read_all (char *buf, size_t len)
+    {
+      while (len != 0)
+        {
+          ssize_t got = read(m_fd, buf, len);
+          if (got < 0 && errno == EINTR)
+            continue;
+          if (got <= 0)
+            return false;
+          buf += got;
+          len -= got;
+        }
+      return true;
+    }
+
+  void print (const Pending &p, WireReader &rd)
+    {
+      static const char *verdict[] = { "cyclic", "accepted", "conflict" };
+
+      if (rd.u8 () != status_ok)
+        {
+          string msg = rd.str ();
+          for (const auto &l : p.lines)
+            cout << l << " : error: " << msg << "\n";
+          return;
+        }
+
+      switch (p.op)
+        {
+        case op_add:
+        case op_check:
+          for (const auto &l : p.lines)
+            {
+              int r = int8_t(rd.u8 ());
+              cout << l << " : " << verdict[std::max(-1, std::min(1, r)) + 1]
+                   << "\n";
+            }
+          break;
+        case op_eastman:
+          cout << p.lines[0] << " : " << rd.u32 () << "\n";
+          break;
+        case op_canon:
+          {
+            uint32_t off = rd.u32 ();
+            cout << p.lines[0] << " : " << off << " "
+                 << (rd.u8 () ? "primitive" : "periodic") << "\n";
+            break;
+          }
+        case op_dump:
+          {
+            vector<int> w;
+            uint32_t n = rd.u32 ();
+            uint64_t k = rd.u64 ();
+            for (uint64_t i = 0; i != k; ++i)
+              {
+                rd.word (w, n);
+                for (size_t j = 0; j != n; ++j)
+                  cout << (j ? " " : "") << w[j];
+                cout << "\n";
+              }
+            break;
+          }
+        }
+    }
+
+public:
+  Client (int fd, size_t window) : m_fd(fd), m_window(window) {}
+
+  /* answers in request order, runs on its own thread */
+  void receive ()
+    {
+      string body;
+      char hdr[4];
+
+      for (;;)
+        {
+          {
+            std::unique_lock<std::mutex> lock(m_mut);
+            if (m_pending.empty())
+              cout.flush();
+          }
+
+          if (!read_all (hdr, 4))
+            break;
+          uint32_t len = 0;
+          for (int i = 3; i >= 0; --i)
+            len = (len << 8) | uint8_t(hdr[i]);
+          if (len > max_frame)
+            break;
+          body.resize(len);
+          if (!read_all (&body[0], len))
+            break;
+
+          Pending p;
+          {
+            std::lock_guard<std::mutex> lock(m_mut);
+            if (m_pending.empty())
+              break;
+            p = std::move(m_pending.front());
+            m_pending.pop_front();
+          }
+          m_cv.notify_all();
+
+          try
+            {
+              WireReader rd(body.data(), len);
+              if (rd.u32 () != p.id)
+                throw std::runtime_error("answer out of order");
+              print (p, rd);
+            }
+          catch (std::runtime_error &e)
+            {
+              cerr << "cf_client: " << e.what() << endl;
+              break;
+            }
+        }
+
+      cout.flush();
+      std::lock_guard<std::mutex> lock(m_mut);
+      if (!m_pending.empty())
+        cerr << "cf_client: connection closed, " << m_pending.size()
+             << " requests not answered" << endl;
+      m_broken = true;
+      m_cv.notify_all();
+    }
+
+  /* sends collected batch */
+  void flush ()
+    {
+      if (m_op == 0)
+        return;
+
+      size_t k = m_lines.size();
+      queue (m_op, m_lines);
+
+      WireWriter wr(m_out);
+      wr.u32 (m_next);
+      wr.u8 (m_op);
+      if ((m_op == op_add) || (m_op == op_check))
+        {
+          wr.str (m_name);
+          wr.u32 (m_n);
+          wr.u32 (k);
+        }
+      else if (m_op != op_dump)
+        wr.u32 (m_n);
+      else
+        wr.str (m_name);
+      wr.word (m_letters.data(), m_letters.size());
+      wr.finish ();
+
+      m_next += 1;
+      m_op = 0;
+      m_lines.clear();
+      m_letters.clear();
+
+      if (m_out.size() >= (1 << 16))
+        send ();
+    }
+
+  /* writes requests built so far */
+  void send ()
+    {
+      write_all (m_out);
+      m_out.clear();
+    }
+
+  /* parses text line, sends batch if it can not take it; false if line
+     is incorrect */
+  bool request (const string &line, size_t batch)
+    {
+      std::istringstream is(line);
+      string cmd, name, item;
+      vector<int> w;
+      uint8_t op;
+
+      if (!(is >> cmd))
+        return true;
+      if (cmd == "add")
+        op = op_add;
+      else if (cmd == "check")
+        op = op_check;
+      else if (cmd == "eastman")
+        op = op_eastman;
+      else if (cmd == "canon")
+        op = op_canon;
+      else if (cmd == "dump")
+        op = op_dump;
+      else
+        return false;
+
+      if (((op == op_add) || (op == op_check) || (op == op_dump))
+          && !(is >> name))
+        return false;
+
+      while (is >> item)
+        {
+          char *end;
+          long x = std::strtol(item.c_str(), &end, 10);
+          if ((*end != '\0') || (x < 0) || (x > 0x7fffffff))
+            return false;
+          w.push_back(int(x));
+        }
+      if ((op == op_dump) != w.empty())
+        return false;
+
+      bool joins = ((op == op_add) || (op == op_check)) && (op == m_op)
+                   && (name == m_name) && (w.size() == m_n)
+                   && (m_lines.size() < batch);
+      if (!joins)
+        flush ();
+
+      m_op = op;
+      m_name = name;
+      m_n = w.size();
+      m_letters.insert(m_letters.end(), w.begin(), w.end());
+      m_lines.push_back(line);
+      if ((op != op_add) && (op != op_check))
+        flush ();
+      return true;
+    }
+};
+
+static int
+connect_socket (const string &path)
+{
+  sockaddr_un addr;
+
+  if (path.size() >= sizeof(addr.sun_path))
+    throw std::runtime_error("Socket path too long: " + path);
+
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  std::strcpy(addr.sun_path, path.c_str());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if ((fd < 0)
+      || (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0))
+    throw std::runtime_error("Can not connect to " + path + ": "
+                             + std::strerror(errno));
+  return fd;
+}
+
+/* runs cmd with stdin and stdout on socket, returns other end */
+static int
+spawn (const string &cmd, pid_t &pid)
+{
+  int sv[2];
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    throw std::runtime_error(string("socketpair: ") + std::strerror(errno));
+
+  pid = fork();
+  if (pid < 0)
+    throw std::runtime_error(string("fork: ") + std::strerror(errno));
+  if (pid == 0)
+    {
+      close(sv[0]);
+      dup2(sv[1], 0);
+      dup2(sv[1], 1);
+      close(sv[1]);
+      execl("/bin/sh", "sh", "-c", cmd.c_str(), (char *) nullptr);
+      _exit(127);
+    }
+
+  close(sv[1]);
+  return sv[0];
+}
+
+int
+main (int argc, char **argv)
+{
+  Options opts;
+  pid_t pid = -1;
+  int fd, status = 0;
+
+  process_command_line (argc, argv, opts);
+  std::signal(SIGPIPE, SIG_IGN);
+
+  fd = opts.exec.empty() ? connect_socket (opts.socket)
+                         : spawn (opts.exec, pid);
+
+  Client cl(fd, opts.window);
+  std::thread receiver(&Client::receive, &cl);
+
+  try
+    {
+      char buf[1 << 16];
+      string line, rest;
+      size_t lineno = 0;
+      ssize_t got;
+
+      /* everything read at once is batched, then sent */
+      while ((got = read(0, buf, sizeof(buf))) != 0)
+        {
+          if (got < 0)
+            {
+              if (errno == EINTR)
+                continue;
+              throw std::runtime_error(string("read: ") + std::strerror(errno));
+            }
+
+          rest.append(buf, got);
+          size_t pos = 0, eol;
+          while ((eol = rest.find('\n', pos)) != string::npos)
+            {
+              line.assign(rest, pos, eol - pos);
+              pos = eol + 1;
+              lineno += 1;
+              if (!cl.request (line, opts.batch))
+                {
+                  cerr << "line " << lineno << " is incorrect: " << line
+                       << endl;
+                  status = 1;
+                }
+            }
+          rest.erase(0, pos);
+          cl.flush ();
+          cl.send ();
+        }
+
+      lineno += 1;
+      if (!rest.empty() && !cl.request (rest, opts.batch))
+        {
+          cerr << "line " << lineno << " is incorrect: " << rest << endl;
+          status = 1;
+        }
+      cl.flush ();
+      cl.send ();
+    }
+  catch (std::runtime_error &e)
+    {
+      cerr << "cf_client: " << e.what() << endl;
+      status = 1;
+    }
+
+  /* daemon sees end of requests, answers rest of them and closes */
+  shutdown(fd, SHUT_WR);
+  receiver.join();
+  close(fd);
+
+  if (pid > 0)
+    waitpid(pid, nullptr, 0);
+
+  return status;
+}
+
+void
+process_command_line (int argc, char **argv, Options &opts)
+{
+  int idx;
+
+  for (idx = 1; idx < argc; ++idx)
+    {
+      string arg = argv[idx];
+      bool has_val = (idx + 1 < argc);
+
+      if (arg == "--socket" && has_val)
+        opts.socket = argv[++idx];
+      else if (arg == "--exec" && has_val)
+        opts.exec = argv[++idx];
+      else if (arg == "--batch" && has_val)
+        opts.batch = std::max(1, std::atoi(argv[++idx]));
+      else if (arg == "--window" && has_val)
+        opts.window = std::max(1, std::atoi(argv[++idx]));
+      else
+        break;
+    }
+
+  if ((idx != argc) || (opts.socket.empty() == opts.exec.empty()))
+    {
+      cerr << "usage: \"" << argv[0] << " --socket path | --exec cmd"
+              " [--batch K] [--window N]\", requests are read from stdin"
+           << endl;
+      throw std::runtime_error("incorrect command line");
+    }
+}
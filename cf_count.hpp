@@ -0,0 +1,397 @@
+//===------- cf_count.hpp -- exact count of comma-free routes -------------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains definition and implementation of RouteCounter class
+// which counts routes (class i -> rotation r_i, see cf_all_paths) giving
+// comma-free code exactly, without walking k^N routes, and draws uniform
+// random accepted routes
+//
+// Code of chosen words is rejected (as by Cfdict strict) iff some word is
+// periodic, two words are rotations of each other, or z appears inside
+// x . y for chosen x, y, z. So conflicts are compiled once into:
+//
+// - bad choices (periodic words)
+// - pairs of choices of different classes (rotations, or violation with
+//   two distinct words among x, y, z)
+// - triples of choices of three classes (x, y, z all distinct)
+//
+// Routes form decision diagram: classes are decided in input order, and
+// what matters for classes p .. N-1 after choice of 0 .. p-1 is the set of
+// choices banned by pairs (and triples with two chosen words) and set of
+// pairs of future choices induced by triples with one chosen word. This
+// state is node of diagram, count of its accepted completions is kept in
+// memo, so routes which lead to same state are counted once; node without
+// any choice left in some future class is cut. Time depends on number of
+// distinct states, not on k^N
+//
+// Counts are unsigned __int128, so accepted count shall be below 2^128
+// (k^N might be bigger, then it is known as power of ten only). Uniform
+// route goes down the diagram choosing child by its share of count
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_COUNT_GUARD_
+#define CF_COUNT_GUARD_
+
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <string>
+#include <random>
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "cf_canon.hpp"
+
+using std::vector;
+
+class RouteCounter
+{
+public:
+  typedef unsigned __int128 count_t;
+
+private:
+  /* level p, banned choices, then induced pairs (two choices each) */
+  typedef vector<uint32_t> Key;
+
+  struct KeyHash
+  {
+    size_t operator() (const Key &k) const
+      {
+        uint64_t h = 0x84222325cbf29ce4ull;
+        for (uint32_t x : k)
+          h = (h ^ x) * 0x100000001b3ull;
+        return h ^ (h >> 29);
+      }
+  };
+
+  typedef std::pair<uint32_t, uint32_t> Pair;
+
+  size_t m_classes, m_k;
+  vector<uint8_t> m_bad;
+  vector< vector<uint32_t> > m_pairs;    /* choice -> conflicting choices */
+  vector< vector<Pair> > m_triples;      /* choice -> pairs, first < second */
+  std::unordered_map<Key, count_t, KeyHash> m_memo;
+  size_t m_max_memo;
+
+  size_t cls (uint32_t c) const { return c / m_k; }
+
+  static void
+  sort_unique (vector<uint32_t> &v)
+    {
+      std::sort(v.begin(), v.end());
+      v.erase(std::unique(v.begin(), v.end()), v.end());
+    }
+
+  static void
+  sort_unique (vector<Pair> &v)
+    {
+      std::sort(v.begin(), v.end());
+      v.erase(std::unique(v.begin(), v.end()), v.end());
+    }
+
+  void add_pair (uint32_t a, uint32_t b)
+    {
+      if (cls(a) == cls(b))
+        return;
+      m_pairs[a].push_back(b);
+      m_pairs[b].push_back(a);
+    }
+
+  /* conflicts of all choices: z inside x . y for every x, y and split */
+  void compile (const vector< vector<int> > &classes)
+    {
+      size_t nc = m_classes * m_k, k = m_k, i;
+      vector< vector<int> > words(nc);
+      std::map< vector<int>, vector<uint32_t> > owner;
+      vector< vector<int> > canon(m_classes);
+
+      for (uint32_t c = 0; c != nc; ++c)
+        {
+          const vector<int> &w = classes[cls(c)];
+          size_t r = c % k;
+          words[c].assign(w.begin() + r, w.end());
+          words[c].insert(words[c].end(), w.begin(), w.begin() + r);
+          m_bad[c] = !canonical_rotation(words[c]).primitive;
+          owner[words[c]].push_back(c);
+        }
+
+      /* classes given twice: every pair of their words is rejected */
+      for (i = 0; i != m_classes; ++i)
+        {
+          canon[i] = classes[i];
+          canonicalize(canon[i]);
+          for (size_t j = 0; j != i; ++j)
+            if (canon[i] == canon[j])
+              for (size_t a = 0; a != k; ++a)
+                for (size_t b = 0; b != k; ++b)
+                  add_pair (i * k + a, j * k + b);
+        }
+
+      vector<int> z(k);
+      for (uint32_t x = 0; x != nc; ++x)
+        for (uint32_t y = 0; y != nc; ++y)
+          {
+            if ((x != y) && (cls(x) == cls(y)))
+              continue;
+            for (size_t off = 1; off != k; ++off)
+              {
+                for (i = 0; i != k; ++i)
+                  z[i] = (off + i < k) ? words[x][off + i]
+                                       : words[y][off + i - k];
+                auto it = owner.find(z);
+                if (it == owner.end())
+                  continue;
+                for (uint32_t c : it->second)
+                  {
+                    if ((c == x) || (c == y))
+                      add_pair (x, y);
+                    else if (x == y)
+                      add_pair (x, c);
+                    else if ((cls(c) != cls(x)) && (cls(c) != cls(y)))
+                      {
+                        uint32_t t[3] = { x, y, c };
+                        std::sort(t, t + 3);
+                        m_triples[t[0]].push_back(Pair(t[1], t[2]));
+                        m_triples[t[1]].push_back(Pair(t[0], t[2]));
+                        m_triples[t[2]].push_back(Pair(t[0], t[1]));
+                      }
+                  }
+              }
+          }
+
+      for (uint32_t c = 0; c != nc; ++c)
+        {
+          sort_unique (m_pairs[c]);
+          sort_unique (m_triples[c]);
+        }
+    }
+
+  /* state after choice c at level p of state (banned, pairs); false if
+     some future class has no choice left */
+  bool choose (size_t p, uint32_t c, const vector<uint32_t> &banned,
+               const vector<Pair> &pairs, vector<uint32_t> &nb,
+               vector<Pair> &np) const
+    {
+      size_t k = m_k;
+
+      nb.clear();
+      for (uint32_t d : banned)
+        if (cls(d) > p)
+          nb.push_back(d);
+      for (uint32_t d : m_pairs[c])
+        if (cls(d) > p)
+          nb.push_back(d);
+      for (const Pair &x : pairs)
+        if (x.first == c)
+          nb.push_back(x.second);
+        else if (x.second == c)
+          nb.push_back(x.first);
+      sort_unique (nb);
+
+      /* every future class keeps some choice */
+      size_t i = 0;
+      for (size_t q = p + 1; q != m_classes; ++q)
+        {
+          size_t left = 0;
+          for (uint32_t d = q * k; d != (q + 1) * k; ++d)
+            {
+              while ((i != nb.size()) && (nb[i] < d))
+                ++i;
+              if (!m_bad[d] && ((i == nb.size()) || (nb[i] != d)))
+                left += 1;
+            }
+          if (left == 0)
+            return false;
+        }
+
+      auto alive = [&nb, this, p] (uint32_t d) {
+        return (cls(d) > p) && !std::binary_search(nb.begin(), nb.end(), d);
+      };
+
+      np.clear();
+      for (const Pair &x : pairs)
+        if (alive(x.first) && alive(x.second))
+          np.push_back(x);
+      for (const Pair &x : m_triples[c])
+        if (alive(x.first) && alive(x.second))
+          np.push_back(x);
+      sort_unique (np);
+      return true;
+    }
+
+  count_t count (size_t p, const vector<uint32_t> &banned,
+                 const vector<Pair> &pairs)
+    {
+      if (p == m_classes)
+        return 1;
+
+      Key key;
+      key.reserve(2 + banned.size() + 2 * pairs.size());
+      key.push_back(p);
+      key.push_back(banned.size());
+      key.insert(key.end(), banned.begin(), banned.end());
+      for (const Pair &x : pairs)
+        {
+          key.push_back(x.first);
+          key.push_back(x.second);
+        }
+
+      auto it = m_memo.find(key);
+      if (it != m_memo.end())
+        return it->second;
+
+      count_t total = 0;
+      vector<uint32_t> nb;
+      vector<Pair> np;
+      for (uint32_t c = p * m_k; c != (p + 1) * m_k; ++c)
+        if (!m_bad[c] && !std::binary_search(banned.begin(), banned.end(), c)
+            && choose (p, c, banned, pairs, nb, np))
+          {
+            count_t n = count (p + 1, nb, np);
+            if (total > ~count_t(0) - n)
+              throw std::runtime_error("Too many accepted routes to count");
+            total += n;
+          }
+
+      /* memo is dropped when full, counts stay exact */
+      if (m_memo.size() >= m_max_memo)
+        m_memo.clear();
+      m_memo.emplace(std::move(key), total);
+      return total;
+    }
+
+  /* random below n, n > 0 */
+  static count_t
+  below (std::mt19937_64 &rng, count_t n)
+    {
+      count_t lim = ~count_t(0) - ~count_t(0) % n, x;
+      do
+        x = (count_t(rng()) << 64) | rng();
+      while (x >= lim);
+      return x % n;
+    }
+
+public:
+  RouteCounter (const vector< vector<int> > &classes, size_t k,
+                size_t max_memo = size_t(1) << 22) :
+    m_classes(classes.size()), m_k(k), m_bad(classes.size() * k, 0),
+    m_pairs(classes.size() * k), m_triples(classes.size() * k),
+    m_max_memo(max_memo)
+    {
+      for (const auto &w : classes)
+        if (w.size() != k)
+          throw std::runtime_error("Class of other length");
+      compile (classes);
+    }
+
+  /* true if k^N fits into count_t */
+  bool routes_fit () const
+    {
+      count_t all = 1;
+      for (size_t i = 0; i != m_classes; ++i)
+        {
+          if (all > ~count_t(0) / m_k)
+            return false;
+          all *= m_k;
+        }
+      return true;
+    }
+
+  /* k^N, throws if it does not fit */
+  count_t routes () const
+    {
+      if (!routes_fit ())
+        throw std::runtime_error("Too many routes to count");
+      count_t all = 1;
+      for (size_t i = 0; i != m_classes; ++i)
+        all *= m_k;
+      return all;
+    }
+
+  /* log10 of k^N, for any N */
+  double log10_routes () const { return m_classes * std::log10(m_k); }
+
+  /* throws only if accepted count itself does not fit */
+  count_t accepted ()
+    {
+      return count (0, vector<uint32_t>(), vector<Pair>());
+    }
+
+  /* nodes of diagram kept in memo */
+  size_t nodes () const { return m_memo.size(); }
+
+  /* number of pairs and triples of conflicting choices */
+  size_t pairs () const
+    {
+      size_t s = 0;
+      for (const auto &x : m_pairs)
+        s += x.size();
+      return s / 2;
+    }
+
+  size_t triples () const
+    {
+      size_t s = 0;
+      for (const auto &x : m_triples)
+        s += x.size();
+      return s / 3;
+    }
+
+  /* uniform random accepted route, false if there is none */
+  bool sample (std::mt19937_64 &rng, vector<int> &route)
+    {
+      vector<uint32_t> banned, nb;
+      vector<Pair> pairs, np;
+      size_t p;
+
+      route.assign(m_classes, 0);
+      count_t left = count (0, banned, pairs);
+      if (left == 0)
+        return false;
+
+      left = below(rng, left);
+      for (p = 0; p != m_classes; ++p)
+        for (uint32_t c = p * m_k; ; ++c)
+          {
+            if (c == (p + 1) * m_k)
+              throw std::runtime_error("Route count is inconsistent");
+            if (m_bad[c] || std::binary_search(banned.begin(), banned.end(), c)
+                || !choose (p, c, banned, pairs, nb, np))
+              continue;
+            count_t n = count (p + 1, nb, np);
+            if (left < n)
+              {
+                route[p] = c % m_k;
+                banned.swap(nb);
+                pairs.swap(np);
+                break;
+              }
+            left -= n;
+          }
+
+      return true;
+    }
+
+  static std::string
+  str (count_t x)
+    {
+      std::string s;
+      do
+        {
+          s.push_back('0' + int(x % 10));
+          x /= 10;
+        }
+      while (x != 0);
+      std::reverse(s.begin(), s.end());
+      return s;
+    }
+};
+
+#endif
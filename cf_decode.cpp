@@ -0,0 +1,275 @@
+//===-- cf_decode.cpp -- streaming comma-free decoder ---------------------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains an executable programm which decodes unframed stream
+// of letters with comma-free code, like:
+//
+// ./cf_search 2 4 > dict.txt
+// ./cf_decode 4 dict.txt stream.bin
+//
+// dictionary file contains code words, one per line, n space-separated
+// numbers each (cf_check input format); it is checked to be comma-free.
+// Stream is read from given file (mapped to memory) or from stdin.
+// Every byte of stream is letter, with option --text stream is
+// space-separated numbers. Output is index of every decoded word in
+// dictionary file, one per line. Options:
+//
+// --count   do not print indices, only summary
+//
+// Summary (words, resyncs, skipped letters, throughput) goes to stderr.
+// See cf_decode.hpp for decoder details
+//
+//===----------------------------------------------------------------------===//
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cf_dict.hpp"
+#include "cf_decode.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::vector;
+using std::string;
+
+struct Options
+{
+  int n = 0;
+  string dict, input;
+  bool text = false, count = false;
+};
+
+/* buffered output of decoded indices */
+class IndexWriter
+{
+  string m_buf;
+  bool m_on;
+
+public:
+  explicit IndexWriter (bool on) : m_on(on) { m_buf.reserve(1 << 16); }
+  ~IndexWriter () { flush(); }
+
+  void put (int32_t idx)
+    {
+      char tmp[16];
+      int len;
+
+      if (!m_on)
+        return;
+      len = std::snprintf(tmp, sizeof(tmp), "%d\n", int(idx));
+      m_buf.append(tmp, len);
+      if (m_buf.size() >= (1 << 16))
+        flush();
+    }
+
+  void flush ()
+    {
+      std::fwrite(m_buf.data(), 1, m_buf.size(), stdout);
+      m_buf.clear();
+    }
+};
+
+void process_command_line (int argc, char **argv, Options &opts);
+
+static void
+read_dict (const Options &opts, vector< vector<int> > &out)
+{
+  std::ifstream is(opts.dict);
+  string line;
+  Cfdict d(opts.n);
+
+  if (!is)
+    throw std::runtime_error("Can not open dictionary " + opts.dict);
+
+  while (getline(is, line))
+    {
+      vector<int> w;
+      int c;
+      for (std::istringstream ls(line); ls >> c; )
+        w.push_back(c);
+      if (w.empty())
+        continue;
+      if (w.size() != size_t(opts.n))
+        throw std::runtime_error("Dictionary word of wrong length: " + line);
+      if (d.add_tuple(w, true) != 0)
+        throw std::runtime_error("Dictionary is not comma-free at: " + line);
+    }
+
+  d.get_dict(out);
+}
+
+/* decodes chunks, keeping unconsumed tail for next one */
+template <typename T, typename R, typename F> static uint64_t
+decode_stream (vector<T> &buf, R refill, F run)
+{
+  size_t have = 0;
+
+  for (;;)
+    {
+      size_t got = refill(buf.data() + have, buf.size() - have);
+      have += got;
+      size_t used = run(buf.data(), have);
+      std::copy(buf.begin() + used, buf.begin() + have, buf.begin());
+      have -= used;
+      if (got == 0)
+        return have;
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  Options opts;
+  vector< vector<int> > dict;
+  uint64_t trailing = 0;
+
+  process_command_line (argc, argv, opts);
+  read_dict (opts, dict);
+
+  CfDecoder dec(dict);
+  IndexWriter out(!opts.count);
+  auto emit = [&out] (uint64_t, int32_t idx) { out.put(idx); };
+  auto start = std::chrono::steady_clock::now();
+
+  if (opts.text)
+    {
+      std::ifstream fs;
+      if (!opts.input.empty())
+        {
+          fs.open(opts.input);
+          if (!fs)
+            throw std::runtime_error("Can not open " + opts.input);
+        }
+      std::istream &is = opts.input.empty() ? std::cin : fs;
+      vector<int> buf(1 << 16);
+
+      trailing = decode_stream (buf,
+        [&is] (int *p, size_t room) {
+          size_t k = 0;
+          while ((k != room) && (is >> p[k]))
+            k += 1;
+          return k;
+        },
+        [&dec, &emit] (const int *p, size_t len) {
+          return dec.decode(p, len, emit);
+        });
+    }
+  else if (!opts.input.empty())
+    {
+      struct stat sb;
+      int fd = open(opts.input.c_str(), O_RDONLY);
+      if ((fd < 0) || (fstat(fd, &sb) != 0))
+        throw std::runtime_error("Can not open " + opts.input);
+
+      size_t len = sb.st_size;
+      if (len > 0)
+        {
+          void *p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+          if (p == MAP_FAILED)
+            throw std::runtime_error("Can not map " + opts.input);
+          madvise(p, len, MADV_SEQUENTIAL);
+          trailing = len - dec.decode_bytes(static_cast<const uint8_t *>(p),
+                                            len, emit);
+          munmap(p, len);
+        }
+      close(fd);
+    }
+  else
+    {
+      vector<uint8_t> buf(1 << 20);
+
+      trailing = decode_stream (buf,
+        [] (uint8_t *p, size_t room) {
+          ssize_t k;
+          do
+            k = read(0, p, room);
+          while ((k < 0) && (errno == EINTR));
+          return (k > 0) ? size_t(k) : size_t(0);
+        },
+        [&dec, &emit] (const uint8_t *p, size_t len) {
+          return dec.decode_bytes(p, len, emit);
+        });
+    }
+
+  out.flush();
+
+  double secs = std::chrono::duration<double>(
+                  std::chrono::steady_clock::now() - start).count();
+  const DecodeStats &st = dec.stats();
+  uint64_t total = st.letters + trailing;
+
+  cerr << "decoded " << st.words << " words from " << total << " letters, "
+       << st.resyncs << " resyncs, " << st.skipped << " skipped, "
+       << trailing << " trailing";
+  if (secs > 0)
+    cerr << ", " << (total / secs / 1e6) << " M letters/s";
+  cerr << endl;
+
+  return 0;
+}
+
+void
+process_command_line (int argc, char **argv, Options &opts)
+{
+  int idx, npos = 0;
+
+  for (idx = 1; idx < argc; ++idx)
+    {
+      string arg = argv[idx];
+
+      if (arg == "--text")
+        opts.text = true;
+      else if (arg == "--count")
+        opts.count = true;
+      else if (npos == 0)
+        {
+          opts.n = atoi (argv[idx]);
+          npos += 1;
+        }
+      else if (npos == 1)
+        {
+          opts.dict = arg;
+          npos += 1;
+        }
+      else if (npos == 2)
+        {
+          opts.input = arg;
+          npos += 1;
+        }
+      else
+        npos += 1;
+    }
+
+  if ((npos != 2) && (npos != 3))
+    {
+      cerr << "usage: \"" << argv[0] << " [--text] [--count] n dict [input]\""
+              " where n is word length, dict is file with code words and"
+              " input is stream file (stdin if omitted)" << endl;
+      throw std::runtime_error("incorrect command line");
+    }
+
+  if (opts.n <= 0)
+    {
+      cerr << "n shall be > 0" << endl;
+      throw std::runtime_error("incorrect command line");
+    }
+}
@@ -0,0 +1,415 @@
+//===------- cf_decode.hpp -- streaming comma-free decoder ----------------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains definition and implementation of CfDecoder class which
+// finds word boundaries in unframed stream of letters, encoded with
+// comma-free code, and emits indices of decoded words
+//
+// In comma-free code no code word appears across boundary of two others,
+// so every window of n letters equal to code word is real word. Decoder:
+//
+// - searching: slides window letter by letter until window is code word,
+//   so stream, started at arbitrary offset, is locked after at most
+//   2n - 1 letters
+// - locked: checks only aligned windows, one lookup per word; window which
+//   is not code word (corrupted stream) drops lock and search restarts
+//   from next letter
+//
+// Windows are looked up in open addressing table. For int letters key is
+// polynomial rolling hash (updated in O(1) on slide, hits are verified
+// letter by letter). For byte letters and n <= 8 window is packed into
+// 64-bit key exactly, loaded by single unaligned read, so no verification
+// is needed. Code compiled in (cf_fixed.hpp) might be looked up by its rank
+// table over all m^n words instead, without any table built: it is faster
+// than hashing with verification, but slower than packed keys
+//
+// Stream might be fed by chunks: decode returns number of letters consumed,
+// unconsumed tail (less than n letters) shall be prepended to next chunk
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_DECODE_GUARD_
+#define CF_DECODE_GUARD_
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+
+using std::vector;
+
+/* counters of decoded stream */
+struct DecodeStats
+{
+  uint64_t letters = 0;   /* consumed letters */
+  uint64_t words = 0;     /* emitted words */
+  uint64_t resyncs = 0;   /* lost locks */
+  uint64_t skipped = 0;   /* letters skipped while searching */
+};
+
+class CfDecoder
+{
+  enum : uint64_t { base = 0x100000001b3ull };
+
+  size_t m_n, m_size;
+  vector<int> m_words;            /* dictionary, flat */
+  const int16_t *m_rank;          /* rank table of all m^n words or null */
+  uint32_t m_m;
+  uint64_t m_top;                 /* base^(n-1) */
+
+  /* open addressing tables: key and word index + 1, 0 means empty */
+  vector<uint64_t> m_hkeys, m_bkeys;
+  vector<int32_t> m_hvals, m_bvals;
+  int m_shift, m_bshift;
+  bool m_bytes;                   /* byte fast path available */
+  bool m_direct;                  /* byte table has no collisions */
+  uint64_t m_bmask, m_bmul;
+
+  bool m_locked;
+  DecodeStats m_stats;
+
+  static uint64_t mix (uint64_t key) { return key * 0x9e3779b97f4a7c15ull; }
+
+  static void insert (vector<uint64_t> &keys, vector<int32_t> &vals,
+                      int shift, uint64_t key, int32_t val)
+    {
+      size_t mask = keys.size() - 1, s = mix(key) >> shift;
+      while (vals[s] != 0)
+        s = (s + 1) & mask;
+      keys[s] = key;
+      vals[s] = val + 1;
+    }
+
+  template <typename T> uint64_t hash (const T *x) const
+    {
+      uint64_t h = 0;
+      for (size_t i = 0; i != m_n; ++i)
+        h = h * base + uint64_t(x[i]) + 1;
+      return h;
+    }
+
+  template <typename T> bool same (const T *x, int32_t idx) const
+    {
+      const int *w = &m_words[idx * m_n];
+      for (size_t i = 0; i != m_n; ++i)
+        if (int(x[i]) != w[i])
+          return false;
+      return true;
+    }
+
+  /* index of word with hash h equal to x, or -1 */
+  template <typename T> int32_t find_hashed (uint64_t h, const T *x) const
+    {
+      size_t mask = m_hkeys.size() - 1, s = mix(h) >> m_shift;
+      for (; m_hvals[s] != 0; s = (s + 1) & mask)
+        if ((m_hkeys[s] == h) && same(x, m_hvals[s] - 1))
+          return m_hvals[s] - 1;
+      return -1;
+    }
+
+  int32_t find_packed (uint64_t key) const
+    {
+      size_t mask = m_bkeys.size() - 1, s = (key * m_bmul) >> m_bshift;
+      if (m_direct)
+        return (m_bkeys[s] == key) ? m_bvals[s] - 1 : -1;
+      for (; m_bvals[s] != 0; s = (s + 1) & mask)
+        if (m_bkeys[s] == key)
+          return m_bvals[s] - 1;
+      return -1;
+    }
+
+  /* tries to place packed keys without collisions: multiplicative hash
+     with random odd multipliers into tables up to 64 times larger than
+     dictionary, but small enough to stay in cache, so lookup is single
+     probe without loop; fails for large dictionaries */
+  bool place_direct (const vector<uint64_t> &keys)
+    {
+      enum { max_direct = 1 << 15 };
+      std::mt19937_64 rng(keys.size());
+      size_t cap = m_hkeys.size(), attempt, i;
+      int shift = m_shift;
+      vector<int32_t> vals;
+
+      for (; (cap <= 64 * m_hkeys.size()) && (cap <= max_direct);
+           cap *= 2, shift -= 1)
+        {
+          vals.assign(cap, 0);
+          for (attempt = 0; attempt != 32; ++attempt)
+            {
+              uint64_t mul = rng() | 1;
+
+              for (i = 0; i != keys.size(); ++i)
+                {
+                  size_t s = (keys[i] * mul) >> shift;
+                  if (vals[s] != 0)
+                    break;
+                  vals[s] = i + 1;
+                }
+
+              if (i == keys.size())
+                {
+                  /* empty slot might match key, but its value gives -1 */
+                  m_bkeys.assign(cap, 0);
+                  for (i = 0; i != cap; ++i)
+                    if (vals[i] != 0)
+                      m_bkeys[i] = keys[vals[i] - 1];
+                  m_bvals.swap(vals);
+                  m_bmul = mul;
+                  m_bshift = shift;
+                  return true;
+                }
+
+              /* clear only touched slots */
+              while (i-- > 0)
+                vals[(keys[i] * mul) >> shift] = 0;
+            }
+        }
+
+      return false;
+    }
+
+  /* rank of x by m_rank, -1 for letter outside of alphabet */
+  template <typename T> int32_t ranked (const T *x) const
+    {
+      uint32_t idx = 0, bad = 0;
+      for (size_t i = 0; i != m_n; ++i)
+        {
+          bad |= uint32_t(uint32_t(x[i]) >= m_m);
+          idx = idx * m_m + uint32_t(x[i]);
+        }
+      return bad ? -1 : m_rank[idx];
+    }
+
+  /* first n bytes of p, in memory order, rest zeroed */
+  uint64_t load (const uint8_t *p, size_t avail) const
+    {
+      uint64_t key = 0;
+      if (avail >= sizeof(key))
+        std::memcpy(&key, p, sizeof(key));
+      else
+        std::memcpy(&key, p, m_n);
+      return key & m_bmask;
+    }
+
+public:
+  /* dict is list of code words of equal length, as Cfdict::get_dict gives */
+  explicit CfDecoder (const vector< vector<int> > &dict) :
+    m_n(0), m_size(dict.size()), m_rank(nullptr), m_m(0), m_top(1),
+    m_shift(63), m_bshift(63), m_bytes(true),
+    m_direct(false), m_bmask(0), m_bmul(0x9e3779b97f4a7c15ull),
+    m_locked(false)
+    {
+      size_t cap = 2, i;
+
+      if (dict.empty())
+        throw std::runtime_error("CfDecoder: empty dictionary");
+
+      m_n = dict[0].size();
+      for (const auto &w : dict)
+        {
+          if ((w.size() != m_n) || (m_n == 0))
+            throw std::runtime_error("CfDecoder: words of different size");
+          for (int c : w)
+            if ((c < 0) || (c > 255))
+              m_bytes = false;
+          m_words.insert(m_words.end(), w.begin(), w.end());
+        }
+      m_bytes = m_bytes && (m_n <= sizeof(uint64_t));
+
+      for (i = 1; i < m_n; ++i)
+        m_top *= base;
+
+      while (cap < 2 * dict.size())
+        {
+          cap *= 2;
+          m_shift -= 1;
+        }
+
+      m_hkeys.resize(cap);
+      m_hvals.resize(cap);
+      for (i = 0; i != dict.size(); ++i)
+        insert(m_hkeys, m_hvals, m_shift, hash(&m_words[i * m_n]), i);
+
+      if (m_bytes)
+        {
+          uint8_t ones[sizeof(uint64_t)] = {0}, buf[sizeof(uint64_t)];
+          std::memset(ones, 0xff, m_n);
+          std::memcpy(&m_bmask, ones, sizeof(m_bmask));
+
+          vector<uint64_t> keys;
+          for (i = 0; i != dict.size(); ++i)
+            {
+              std::memset(buf, 0, sizeof(buf));
+              for (size_t j = 0; j != m_n; ++j)
+                buf[j] = m_words[i * m_n + j];
+              keys.push_back(load(buf, sizeof(buf)));
+            }
+
+          m_direct = place_direct(keys);
+          if (!m_direct)
+            {
+              m_bkeys.resize(cap);
+              m_bvals.resize(cap);
+              m_bshift = m_shift;
+              for (i = 0; i != keys.size(); ++i)
+                insert(m_bkeys, m_bvals, m_bshift, keys[i], i);
+            }
+        }
+    }
+
+  /* k code words of length n over m letters, given by rank table of all
+     m^n words (index by base m digits, first letter most significant):
+     code word index or -1, as FixedCode::ranks (cf_fixed.hpp) gives */
+  CfDecoder (int m, size_t n, const int16_t *rank, size_t k) :
+    m_n(n), m_size(k), m_rank(rank), m_m(m), m_top(1), m_shift(63),
+    m_bshift(63), m_bytes(false), m_direct(false), m_bmask(0), m_bmul(0),
+    m_locked(false)
+    {
+      if ((m < 2) || (n == 0) || (k == 0) || !rank)
+        throw std::runtime_error("CfDecoder: empty rank table");
+    }
+
+  size_t length () const { return m_n; }
+  size_t size () const { return m_size; }
+  bool locked () const { return m_locked; }
+  bool byte_path () const { return m_bytes; }
+  const DecodeStats &stats () const { return m_stats; }
+
+  /* index of word equal to x[0 .. n), or -1 */
+  template <typename T> int32_t lookup (const T *x) const
+    {
+      return m_rank ? ranked(x) : find_hashed(hash(x), x);
+    }
+
+  /* forgets lock and counters */
+  void reset ()
+    {
+      m_locked = false;
+      m_stats = DecodeStats();
+    }
+
+  /* decodes x[0 .. len), emit(pos, idx) gets word start in stream and
+     its index in dictionary; returns number of consumed letters */
+  template <typename T, typename F> size_t
+  decode (const T *x, size_t len, F emit)
+    {
+      size_t i = 0;
+      uint64_t pos0 = m_stats.letters;
+
+      while (i + m_n <= len)
+        {
+          if (m_locked)
+            {
+              int32_t idx = lookup(x + i);
+              if (idx >= 0)
+                {
+                  emit(pos0 + i, idx);
+                  m_stats.words += 1;
+                  i += m_n;
+                  continue;
+                }
+              m_locked = false;
+              m_stats.resyncs += 1;
+              m_stats.skipped += 1;
+              i += 1;
+              continue;
+            }
+
+          /* searching with rolling hash (or rank table) */
+          uint64_t h = m_rank ? 0 : hash(x + i);
+          for (;;)
+            {
+              int32_t idx = m_rank ? ranked(x + i) : find_hashed(h, x + i);
+              if (idx >= 0)
+                {
+                  emit(pos0 + i, idx);
+                  m_stats.words += 1;
+                  m_locked = true;
+                  i += m_n;
+                  break;
+                }
+              m_stats.skipped += 1;
+              if (i + m_n >= len)
+                {
+                  i += 1;
+                  break;
+                }
+              h = (h - (uint64_t(x[i]) + 1) * m_top) * base
+                  + uint64_t(x[i + m_n]) + 1;
+              i += 1;
+            }
+        }
+
+      m_stats.letters += i;
+      return i;
+    }
+
+  /* same for byte stream, packed keys when possible, or rank table */
+  template <typename F> size_t
+  decode_bytes (const uint8_t *x, size_t len, F emit)
+    {
+      if (m_rank)
+        return decode_by(x, len, emit, [this] (const uint8_t *p, size_t) {
+          return ranked(p);
+        });
+      if (!m_bytes)
+        return decode(x, len, emit);
+      return decode_by(x, len, emit, [this] (const uint8_t *p, size_t avail) {
+        return find_packed(load(p, avail));
+      });
+    }
+
+private:
+
+  /* decode_bytes, find(p, avail) is index of word at p, -1 if none */
+  template <typename F, typename G> size_t
+  decode_by (const uint8_t *x, size_t len, F emit, G find)
+    {
+      size_t i = 0, n = m_n, wide = std::max(n, sizeof(uint64_t));
+      uint64_t pos0 = m_stats.letters, words = 0;
+
+      while (i + n <= len)
+        {
+          int32_t idx = find(x + i, len - i);
+          if (idx < 0)
+            {
+              if (m_locked)
+                {
+                  m_locked = false;
+                  m_stats.resyncs += 1;
+                }
+              m_stats.skipped += 1;
+              i += 1;
+              continue;
+            }
+
+          emit(pos0 + i, idx);
+          words += 1;
+          m_locked = true;
+          i += n;
+
+          /* locked: aligned full-width loads while they fit */
+          while (i + wide <= len)
+            {
+              idx = find(x + i, wide);
+              if (idx < 0)
+                break;
+              emit(pos0 + i, idx);
+              words += 1;
+              i += n;
+            }
+        }
+
+      m_stats.words += words;
+      m_stats.letters += i;
+      return i;
+    }
+};
+
+#endif
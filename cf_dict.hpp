@@ -19,6 +19,9 @@
 #include <algorithm>
 #include <stdexcept>
 
+#include "cf_alloc.hpp"
+#include "cf_canon.hpp"
+
 using std::vector;
 using std::search;
 
@@ -32,8 +35,9 @@ public:
   /* return 0 on success, otherwise number of conflicting tuple + 1 returned */
   /* -1 means that candidate is cyclic itself */
   /* strict == true implies long check that code at all is really comma-free */
-  int add_tuple (std::vector<int> nxt, bool strict = false)
+  int add_tuple (const std::vector<int> &nxt, bool strict = false)
     {
+      CF_ALLOC_SCOPE("Cfdict::add_tuple");
       int confl;
       m_lasterr.clear();
 
@@ -42,6 +46,10 @@ public:
 
       size_t dsize = m_dict.size(), idx;
 
+      /* it should not be cyclic itself, O(n) without allocation */
+      if (!canonical_rotation(nxt).primitive)
+        return -1;
+
       for (idx = 0; idx != dsize; ++idx)
         {
           auto &x = m_dict[idx];
@@ -52,17 +60,13 @@ public:
             }
         }
 
-      /* keeping nxtnxt to simplify cyclic_perm check to search */
+      /* keeping nxtnxt, so later candidates find rotations by search */
       vector<int> nxt2(nxt);
       nxt2.insert(nxt2.end(), nxt.begin(), nxt.end());
 
-      /* it should not be cyclic itself */
-      if (search(nxt2.begin() + 1, nxt2.end() - 1, nxt.begin(), nxt.end()) != nxt2.end() - 1)
-        return -1;
- 
       if (strict)
         {
-          confl = verify_dict (nxt);
+          confl = verify_dict (nxt, nxt2);
           if (confl != 0) return confl;
         }        
 
@@ -72,6 +76,7 @@ public:
 
   void get_dict(vector< vector<int> > &out)
     {
+      CF_ALLOC_SCOPE("Cfdict::get_dict");
       out = m_dict;
 
       /* now shrinking before return */
@@ -84,37 +89,68 @@ public:
 
 private:
 
-  int cross_check (const vector<int> &fst, 
-                   const vector<int> &snd, 
-                   const vector<int> &nxt)
-    {  
-      vector<int> tmp(fst);
-      tmp.insert(tmp.end(), snd.begin(), snd.end());
-      if (search(tmp.begin(), tmp.end(), nxt.begin(), nxt.end()) != tmp.end())
+  /* true if z occurs in x . y at offsets 1 .. n-1, i.e. straddles words
+     x2, y2 are doubled words as kept in dictionary, z is plain word */
+  bool straddles (const vector<int> &x2, const vector<int> &y2,
+                  const int *z) const
+    {
+      size_t off, i;
+
+      for (off = 1; off < m_n; ++off)
         {
-          vector<int> err(tmp.begin() + m_n, tmp.end() - m_n);
-          m_lasterr = err;
+          for (i = 0; i != m_n; ++i)
+            if (z[i] != ((off + i < m_n) ? x2[off + i] : y2[off + i - m_n]))
+              break;
+          if (i == m_n)
+            return true;
+        }
+
+      return false;
+    }
+
+  int cross_check (const vector<int> &fst,
+                   const vector<int> &snd,
+                   const int *nxt)
+    {
+      if (straddles (fst, snd, nxt))
+        {
+          m_lasterr.assign(fst.begin(), fst.begin() + m_n);
+          m_lasterr.insert(m_lasterr.end(), snd.begin(), snd.begin() + m_n);
           return -1;
         }
       return 0;
     }
 
-  /* returns 0 or (conflicting pattern+1) */
-  int verify_dict (std::vector<int> &nxt)
-    {      
+  /* returns 0 or (conflicting pattern+1)
+     new word is checked in every role of violation: as z inside x . y
+     and as x or y around other z, so result does not depend on order
+     of insertion */
+  int verify_dict (const std::vector<int> &nxt, const std::vector<int> &nxt2)
+    {
       size_t dsize = m_dict.size(), idx, jdx;
 
-      if (dsize < 2)
-        return 0;
-
-      for (idx = 0; idx < dsize - 1; ++idx)
-        for (jdx = idx + 1; jdx < dsize; ++jdx)
-          {
-            int ch = cross_check (m_dict[idx], m_dict[jdx], nxt);
-            if (ch != 0) return (idx + 1);
-            ch = cross_check (m_dict[jdx], m_dict[idx], nxt);
-            if (ch != 0) return (idx + 1);
-          }
+      for (idx = 0; idx < dsize; ++idx)
+        {
+          const vector<int> &x2 = m_dict[idx];
+
+          /* nxt as z */
+          for (jdx = idx + 1; jdx < dsize; ++jdx)
+            {
+              if (cross_check (x2, m_dict[jdx], nxt.data()) != 0)
+                return (idx + 1);
+              if (cross_check (m_dict[jdx], x2, nxt.data()) != 0)
+                return (idx + 1);
+            }
+          if ((cross_check (x2, nxt2, nxt.data()) != 0) ||
+              (cross_check (nxt2, x2, nxt.data()) != 0))
+            return (idx + 1);
+
+          /* nxt as x or y, dictionary word as z */
+          for (jdx = 0; jdx < dsize; ++jdx)
+            if ((cross_check (nxt2, m_dict[jdx], x2.data()) != 0) ||
+                (cross_check (m_dict[jdx], nxt2, x2.data()) != 0))
+              return (idx + 1);
+        }
 
       return 0;
     }
@@ -22,12 +22,15 @@
 #include <algorithm>
 #include <vector>
 #include <deque>
+#include <numeric>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
 #include <cassert>
 
 #include "cf_eastman.h"
+#include "cf_trace.hpp"
+#include "cf_alloc.hpp"
 
 using std::cout;
 using std::cerr;
@@ -37,8 +40,10 @@ using std::vector;
 // true if subword b[i-1]..b[i] greater then b[i]..b[i+1] from xs 
 // longer word counts greater
 // equal length words counts lexicographically greater
-static bool 
-prev_greater (const vector<int> &xs, const vector<size_t> &b, size_t i) 
+// comparison is counted in st when tracing
+template <bool Traced> static bool 
+prev_greater (const vector<int> &xs, const vector<size_t> &b, size_t i,
+              EastmanCallStats *st) 
 {
   assert (i > 0);
   assert (i < b.size() - 1);
@@ -50,7 +55,10 @@ prev_greater (const vector<int> &xs, const vector<size_t> &b, size_t i)
   int snd_len = b[i + 1] - b[i];
 
   if (fst_len != snd_len)
-    return fst_len > snd_len;
+    {
+      if (Traced) st->compared (0);
+      return fst_len > snd_len;
+    }
 
   for (j = 0; j < fst_len; j++) 
     {
@@ -58,9 +66,13 @@ prev_greater (const vector<int> &xs, const vector<size_t> &b, size_t i)
       int snd_next = xs[snd_start + j];
 
       if (fst_next != snd_next)
-        return fst_next > snd_next;
+        {
+          if (Traced) st->compared (j + 1);
+          return fst_next > snd_next;
+        }
     }
 
+  if (Traced) st->compared (fst_len);
   return false; /* y[i-1] == y[i] */
 }
 
@@ -75,19 +87,14 @@ triple_vector (vector<T> &m)
   std::copy (m.begin(), m.begin() + size, back_it);
 }
 
-/* look in header for detailed comment */
-int 
-do_eastman (vector<int> &xs)
+/* main loop, phases are counted in st when tracing */
+template <bool Traced> static int
+eastman_impl (vector<int> &xs, EastmanCallStats *st)
 {
   size_t new_cnt, phase = 1, boundaries_cnt;
   size_t n = xs.size();
   vector<size_t> b(n * 3);  
 
-#ifdef DBGOUT
-  for (auto x : xs)
-    cout << x << " ";
-#endif
-
   triple_vector(xs);
   std::iota (std::begin(b), std::end(b), 0);
 
@@ -97,10 +104,12 @@ do_eastman (vector<int> &xs)
       size_t i, k;
       std::deque<int> retain_points;
 
+      if (Traced) st->phase_begin (boundaries_cnt);
+
       /* check for trivially cyclic input (say 0 0 0 is trivially cyclic) */
       for (i = 1; i <= boundaries_cnt; i++)
         {
-          if (prev_greater (xs, b, i)) 
+          if (prev_greater<Traced> (xs, b, i, st)) 
             break;
         }
 
@@ -108,7 +117,7 @@ do_eastman (vector<int> &xs)
         throw std::runtime_error("Input is cyclic");
 
       /* advance to the first basin */
-      while (prev_greater (xs, b, i+1))
+      while (prev_greater<Traced> (xs, b, i+1, st))
         i += 1;
 
       /* main loop of Eastman's algorithm */
@@ -118,12 +127,12 @@ do_eastman (vector<int> &xs)
 
           /* climb the range */
           q = i + 1;
-          while (!prev_greater (xs, b, q + 1))
+          while (!prev_greater<Traced> (xs, b, q + 1, st))
             q += 1;
 
           /* advance to the next basin */
           j = q + 1;
-          while (prev_greater (xs, b, j + 1))
+          while (prev_greater<Traced> (xs, b, j + 1, st))
             j += 1;
 
           if ((j - i) % 2)
@@ -143,11 +152,7 @@ do_eastman (vector<int> &xs)
 
       new_cnt = retain_points.size();
 
-#ifdef DBGOUT
-      cout << ":";
-      for (k = 0; k < new_cnt; k++)
-        cout << retain_points[k] << " ";
-#endif
+      if (Traced) st->phase_end (new_cnt);
 
       /* populate b with new retain points */
       for (k = 0; k < new_cnt; k++)
@@ -167,10 +172,31 @@ do_eastman (vector<int> &xs)
       phase += 1;
     }
 
-#ifdef DBGOUT
-  cout << endl;
-#endif
-
   return b[0];
 }
 
+/* look in header for detailed comment */
+int 
+do_eastman (vector<int> &xs)
+{
+  CF_ALLOC_SCOPE("do_eastman (basin)");
+  EastmanTrace *tr = eastman_trace ();
+  int res;
+
+  if (!tr)
+    return eastman_impl<false> (xs, nullptr);
+
+  EastmanCallStats st;
+  st.begin (xs);
+  res = eastman_impl<true> (xs, &st);
+  st.end (res);
+  tr->record ("basin", st);
+  return res;
+}
+
+/* look in header for detailed comment */
+bool
+eastman_sliding ()
+{
+  return true;
+}
@@ -42,6 +42,7 @@
 #define CF_EASTMAN_GUARD_
 
 #include <vector>
+#include <cstddef>
 
 // We think of x as written cyclically, with x[n+j] = x[j] for all j >= 0.
 // The basic idea in the algorithm below is to also think of x as partitioned
@@ -63,4 +64,26 @@
 // output is required shift, like 12
 int do_eastman (std::vector<int> &x);
 
+// Same as do_eastman but dip implementation from cf_eastman_new.cpp.
+// Both implementations define do_eastman, so this name exists only where
+// cf_eastman_new.cpp is compiled with -Ddo_eastman=do_eastman_dip
+// (see cf_bench rules in Makefile)
+int do_eastman_dip (std::vector<int> &x);
+
+// Same as do_eastman for w words of equal odd length n at once, in
+// structure-of-arrays layout: letter p of word l is soa[p * w + l].
+// shifts[l] is shift of word l, or -1 if it is cyclic. Words up to 31
+// letters go in SIMD lanes, see cf_eastman_batch.cpp; cf_eastman_new.cpp
+// has its own one, word by word
+void do_eastman_batch (const int *soa, size_t n, size_t w, int *shifts);
+
+// Instruction set used by do_eastman_batch: avx512, avx2, generic, scalar
+// (per-word in cf_eastman_new.cpp)
+const char *eastman_batch_isa ();
+
+// True if SlidingEastman (cf_sliding.hpp) gives same shifts as do_eastman:
+// it follows basin-range phases of cf_eastman.cpp, dip implementation of
+// cf_eastman_new.cpp chooses other rotations, so windows go to do_eastman
+bool eastman_sliding ();
+
 #endif
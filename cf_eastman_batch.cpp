@@ -0,0 +1,378 @@
+//===------ cf_eastman_batch.cpp -- Eastman algorithm on word lanes -------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains do_eastman_batch: Eastman algorithm (see cf_eastman.h)
+// for many words of equal odd length n <= 31 at once, every word in its
+// own SIMD lane (8 lanes for AVX-512 and AVX2, 4 for generic vectors, 1
+// for scalar). Result of every word is the same as of do_eastman
+//
+// Phase of basin implementation depends only on bit g(i) = y[i-1] > y[i]
+// for every boundary: basins are g(i) && !g(i+1), peaks !g(q) && g(q+1),
+// and for every two consecutive basins i < j with peak q between them, one
+// of q, q+1 (of same parity as i) is retained if j - i is odd. So instead
+// of lists of boundaries and retain_points deque every lane keeps n-bit
+// mask of boundaries, and every phase is:
+//
+// - g(p) by one pass over letter positions p, same for all lanes. First
+//   phase compares letters; later ones get distance to previous and next
+//   boundary, longer subword is greater, subwords of equal length L are
+//   compared by table for shift L: for every start s, 2 * (number of
+//   equal letters x[s + k] == x[s + L + k] from k = 0) + (x[s + k] >
+//   x[s + L + k] at first difference). Tables are built for shifts met in
+//   lanes only, once per block
+// - basins, peaks and retained boundaries by bit operations on cyclic
+//   masks: g of next boundary, parity of boundaries since last basin and
+//   oddness of pair moved back to its peak are segmented fills and xor
+//   scans of log n rotations, no pass over positions
+//
+// There are no data-dependent branches per lane: lanes that are done
+// (one boundary left) or cyclic are masked out and keep their mask, block
+// stops when all lanes are. Kernel is one template inlined into functions
+// compiled for every instruction set, choice is made once by CPU features,
+// CF_EASTMAN_BATCH=scalar|generic|avx2|avx512 forces it (for tests and
+// benchmarks). Longer words are passed to do_eastman one by one
+//
+//===----------------------------------------------------------------------===//
+
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include "cf_eastman.h"
+
+using std::vector;
+
+#define CF_INLINE inline __attribute__((always_inline))
+
+enum { max_lane_n = 31 };
+
+/* vector types of W lanes: letters and masks */
+template <int W> struct Lanes;
+
+template <> struct Lanes<1>
+{
+  typedef int32_t vi __attribute__((vector_size(4)));
+  typedef uint32_t vu __attribute__((vector_size(4)));
+  typedef float vf __attribute__((vector_size(4)));
+};
+
+template <> struct Lanes<4>
+{
+  typedef int32_t vi __attribute__((vector_size(16)));
+  typedef uint32_t vu __attribute__((vector_size(16)));
+  typedef float vf __attribute__((vector_size(16)));
+};
+
+template <> struct Lanes<8>
+{
+  typedef int32_t vi __attribute__((vector_size(32)));
+  typedef uint32_t vu __attribute__((vector_size(32)));
+  typedef float vf __attribute__((vector_size(32)));
+};
+
+
+/* cyclic rotation of n-bit masks by s towards higher bits */
+template <typename V> static CF_INLINE void
+rot (V &y, const V &x, int s, int n, const V &full)
+{
+  y = ((x << s) | (x >> (n - s))) & full;
+}
+
+/* bit p of f is bit of x at nearest e at or before p (Forward) or at or
+   after p, x is subset of e, e is not empty; log n doubling steps */
+template <bool Forward, typename V> static CF_INLINE void
+fill (V &f, const V &x, const V &e, int n, const V &full)
+{
+  V m = e, t;
+  f = x;
+  for (int s = 1; s < n; s *= 2)
+    {
+      int r = Forward ? s : (n - s);
+      rot (t, f, r, n, full);
+      f |= t & ~m;
+      rot (t, m, r, n, full);
+      m |= t;
+    }
+}
+
+/* bit p of a is xor of x after nearest e at or before p up to p
+   (segmented prefix xor), x is disjoint with e */
+template <typename V> static CF_INLINE void
+seg_xor (V &a, const V &x, const V &e, int n, const V &full)
+{
+  V m = e, t;
+  a = x;
+  for (int s = 1; s < n; s *= 2)
+    {
+      rot (t, a, s, n, full);
+      a ^= t & ~m;
+      rot (t, m, s, n, full);
+      m |= t;
+    }
+}
+
+/* lanes [first, first + W) of batch, lanes past w repeat last word */
+template <int W> static CF_INLINE void
+eastman_lanes (const int *soa, size_t n, size_t w, size_t first, int *shifts)
+{
+  typedef typename Lanes<W>::vi vi;
+  typedef typename Lanes<W>::vu vu;
+  typedef typename Lanes<W>::vf vf;
+
+  const int nn = n;
+  const vi zero = {}, one = zero + 1;
+  vi X[max_lane_n], lenp[max_lane_n], lenc[max_lane_n], isb[max_lane_n];
+  vi g[max_lane_n];
+  vi tab[max_lane_n * max_lane_n];   /* shift L, start s -> L * n + s */
+  uint32_t built = 0;
+  int p, l;
+
+  for (p = 0; p != nn; ++p)
+    if (first + W <= w)
+      std::memcpy(&X[p], soa + p * w + first, sizeof(vi));
+    else
+      for (l = 0; l != W; ++l)
+        {
+          size_t lane = first + l;
+          X[p][l] = soa[p * w + ((lane < w) ? lane : (w - 1))];
+        }
+
+  const vu full = (vu) zero + ((1u << n) - 1);
+  vu B = full;
+  vi fail = zero, active = (vi) (B & (B - 1)) != 0;
+
+  for (int phase = 0; phase != 32; ++phase)
+    {
+      for (p = 0; p != nn; ++p)
+        isb[p] = -(vi) ((B >> p) & 1);
+
+      /* least and highest boundary: exponent of power of two as float */
+      vu low = B & -B, high = B;
+      for (int sh = 1; sh != 32; sh *= 2)
+        high |= high >> sh;
+      high = (high >> 1) + 1;
+      vi lo = ((vi) __builtin_convertvector ((vi) low, vf) >> 23) - 127;
+      vi hi = ((vi) __builtin_convertvector ((vi) high, vf) >> 23) - 127;
+
+      if (phase == 0)
+        {
+          /* all subwords are letters */
+          for (p = 0; p != nn; ++p)
+            {
+              lenp[p] = lenc[p] = one;
+              g[p] = X[(p == 0) ? (nn - 1) : (p - 1)] > X[p];
+            }
+        }
+      else
+        {
+          /* distances to previous and next boundary */
+          vi last = hi - nn, next = lo + nn;
+          for (p = 0; p != nn; ++p)
+            {
+              int pb = nn - 1 - p;
+              lenp[p] = p - last;
+              last = isb[p] ? (zero + p) : last;
+              lenc[pb] = next - pb;
+              next = isb[pb] ? (zero + pb) : next;
+            }
+
+          /* shifts of equal length neighbours, new tables are built */
+          vu need = (vu) zero;
+          for (p = 0; p != nn; ++p)
+            need |= (vu) (active & isb[p] & (lenp[p] == lenc[p]))
+                    & ((vu) one << (vu) lenp[p]);
+
+          uint32_t shifts_met = 0;
+          for (l = 0; l != W; ++l)
+            shifts_met |= need[l];
+
+          for (uint32_t todo = shifts_met & ~built; todo; todo &= todo - 1)
+            {
+              int L = __builtin_ctz(todo);
+              int s = L - 1, t = 2 * L - 1;     /* S mod n, (S + L) mod n */
+              vi v = zero + 2 * L;
+              t -= (t >= nn) ? nn : 0;
+              for (int S = nn - 1 + L; S >= 0; --S)
+                {
+                  v = (X[s] == X[t]) ? (v + 2) : ((X[s] > X[t]) & 1);
+                  if (S < nn)
+                    tab[L * nn + s] = v;
+                  s = (s == 0) ? (nn - 1) : (s - 1);
+                  t = (t == 0) ? (nn - 1) : (t - 1);
+                }
+            }
+          built |= shifts_met;
+
+          for (p = 0; p != nn; ++p)
+            {
+              vi sel = zero + 2 * nn;
+              for (uint32_t todo = shifts_met; todo; todo &= todo - 1)
+                {
+                  int L = __builtin_ctz(todo), s = p - L;
+                  s += (s < 0) ? nn : 0;
+                  sel = (lenp[p] == L) ? tab[L * nn + s] : sel;
+                }
+
+              vi eq = (lenp[p] == lenc[p]) & (sel < 2 * lenp[p])
+                      & ((sel & 1) != 0);
+              g[p] = (lenp[p] > lenc[p]) | eq;
+            }
+        }
+
+      vu G = (vu) zero;
+      for (p = 0; p != nn; ++p)
+        {
+          g[p] &= isb[p];
+          G |= (vu) g[p] & (1u << p);
+        }
+
+      /* all subwords equal: word is cyclic */
+      fail |= active & ((vi) G == 0);
+      active &= ~fail;
+
+      /* g of next boundary: basins and peaks */
+      vu GN, D, J, M, t;
+      fill<false> (t, G, B, nn, full);
+      rot (GN, t, nn - 1, nn, full);
+      vu basins = B & G & ~GN, peaks = B & ~G & GN;
+
+      /* D: parity of boundaries after nearest basin up to p, then basins
+         j which end odd pair (i, j), odd bit is moved back to peak */
+      seg_xor (D, B & ~basins, basins, nn, full);
+      rot (t, D, 1, nn, full);
+      fill<false> (J, basins & ~t, basins, nn, full);
+      J &= peaks;
+
+      /* peak q if q - i is even, else boundary after q */
+      fill<true> (M, J & D, B, nn, full);
+      rot (t, M, 1, nn, full);
+      vu R = (J & ~D) | (B & t);
+
+      B = active ? R : B;
+
+      /* lanes with more than one boundary, not known to be cyclic */
+      active &= ((vi) (B & (B - 1)) != 0);
+      int any = 0;
+      for (l = 0; l != W; ++l)
+        any |= active[l];
+      if (!any)
+        break;
+    }
+
+  for (l = 0; l != W && first + l < w; ++l)
+    shifts[first + l] = fail[l] ? -1 : __builtin_ctz(B[l]);
+}
+
+template <int W> static CF_INLINE void
+eastman_blocks (const int *soa, size_t n, size_t w, int *shifts)
+{
+  for (size_t first = 0; first < w; first += W)
+    eastman_lanes<W> (soa, n, w, first, shifts);
+}
+
+typedef void (*batch_fn) (const int *, size_t, size_t, int *);
+
+static void
+batch_scalar (const int *soa, size_t n, size_t w, int *shifts)
+{
+  eastman_blocks<1> (soa, n, w, shifts);
+}
+
+static void
+batch_generic (const int *soa, size_t n, size_t w, int *shifts)
+{
+  eastman_blocks<4> (soa, n, w, shifts);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2"))) static void
+batch_avx2 (const int *soa, size_t n, size_t w, int *shifts)
+{
+  eastman_blocks<8> (soa, n, w, shifts);
+}
+
+/* 256-bit registers, but compares and selects go to mask registers; 16
+   lanes are slower above n = 7, per-block state does not fit L1 */
+__attribute__((target("avx512f,avx512vl"))) static void
+batch_avx512 (const int *soa, size_t n, size_t w, int *shifts)
+{
+  eastman_blocks<8> (soa, n, w, shifts);
+}
+#endif
+
+struct BatchImpl
+{
+  const char *name;
+  batch_fn fn;
+};
+
+/* chosen once: forced by environment if CPU has it, else the widest */
+static const BatchImpl &
+batch_impl ()
+{
+  static const BatchImpl impl = [] {
+    BatchImpl impls[] = {
+#if defined(__x86_64__) || defined(__i386__)
+      { "avx512", (__builtin_cpu_supports("avx512f")
+                   && __builtin_cpu_supports("avx512vl")) ? batch_avx512
+                                                          : nullptr },
+      { "avx2", __builtin_cpu_supports("avx2") ? batch_avx2 : nullptr },
+#endif
+      { "generic", batch_generic },
+      { "scalar", batch_scalar }
+    };
+    const char *env = std::getenv("CF_EASTMAN_BATCH");
+
+    for (const auto &i : impls)
+      if (i.fn && env && (std::strcmp(env, i.name) == 0))
+        return i;
+    for (const auto &i : impls)
+      if (i.fn)
+        return i;
+    return impls[0];
+  }();
+
+  return impl;
+}
+
+const char *
+eastman_batch_isa ()
+{
+  return batch_impl().name;
+}
+
+/* look in header for detailed comment */
+void
+do_eastman_batch (const int *soa, size_t n, size_t w, int *shifts)
+{
+  if ((n % 2) == 0)
+    throw std::runtime_error("Eastman word length shall be odd");
+
+  if (n <= max_lane_n)
+    {
+      batch_impl().fn (soa, n, w, shifts);
+      return;
+    }
+
+  vector<int> x(n * 3);
+  for (size_t l = 0; l != w; ++l)
+    {
+      x.resize(n);
+      for (size_t p = 0; p != n; ++p)
+        x[p] = soa[p * w + l];
+      try
+        {
+          shifts[l] = do_eastman (x);
+        }
+      catch (std::runtime_error &)
+        {
+          shifts[l] = -1;
+        }
+    }
+}
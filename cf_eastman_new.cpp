@@ -22,11 +22,14 @@
 #include <algorithm>
 #include <vector>
 #include <deque>
+#include <numeric>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
 
 #include "cf_eastman.h"
+#include "cf_trace.hpp"
+#include "cf_alloc.hpp"
 
 using std::cout;
 using std::cerr;
@@ -36,8 +39,10 @@ using std::vector;
 // true if subword b[i-1]..b[i] less then b[i]..b[i+1] from xs 
 // longer word counts greater
 // equal length words counts lexicographically less
-static bool
-compare_less (const vector<int> &xs, const vector<size_t> &b, int i)
+// comparison is counted in st when tracing
+template <bool Traced> static bool
+compare_less (const vector<int> &xs, const vector<size_t> &b, int i,
+              EastmanCallStats *st)
 {
   int j;
   int fst_start = b[i - 1];
@@ -46,7 +51,10 @@ compare_less (const vector<int> &xs, const vector<size_t> &b, int i)
   int snd_len = b[i + 1] - b[i];
 
   if (fst_len != snd_len)
-    return fst_len < snd_len;
+    {
+      if (Traced) st->compared (0);
+      return fst_len < snd_len;
+    }
   
   for (j = 0; j < snd_len; j++)
     {
@@ -54,9 +62,13 @@ compare_less (const vector<int> &xs, const vector<size_t> &b, int i)
       int snd_next = xs[snd_start + j];
 
       if (fst_next != snd_next)
-        return fst_next < snd_next;
+        {
+          if (Traced) st->compared (j + 1);
+          return fst_next < snd_next;
+        }
     }
 
+  if (Traced) st->compared (snd_len);
   return false;
 }     
 
@@ -71,19 +83,14 @@ triple_vector (vector<T> &m)
   std::copy (m.begin(), m.begin() + size, back_it);
 }
 
-/* look in header for detailed comment */
-int 
-do_eastman (vector<int> &xs)
+/* main loop, phases are counted in st when tracing */
+template <bool Traced> static int
+eastman_impl (vector<int> &xs, EastmanCallStats *st)
 {
   size_t new_cnt, phase = 1, boundaries_cnt;
   size_t n = xs.size();
   vector<size_t> b(n * 3);  
 
-#ifdef DBGOUT
-  for (auto x : xs)
-    cout << x << " ";
-#endif
-
   triple_vector(xs);
   std::iota (std::begin(b), std::end(b), 0);
 
@@ -93,15 +100,17 @@ do_eastman (vector<int> &xs)
       size_t i, i0, k;
       std::deque<int> retain_points;
 
+      if (Traced) st->phase_begin (boundaries_cnt);
+
       /* check for trivially cyclic input (say 0 0 0 is trivially cyclic) */
       for (i = 1;; i++)
         {
-          if (!compare_less (xs, b, i)) 
+          if (!compare_less<Traced> (xs, b, i, st)) 
             break;
         }
 
       for (i += 2; i <= boundaries_cnt + 2; i++)
-        if (compare_less (xs, b, i - 1))
+        if (compare_less<Traced> (xs, b, i - 1, st))
           break;
 
       if (i > boundaries_cnt + 2) 
@@ -119,7 +128,7 @@ do_eastman (vector<int> &xs)
 
           /* digging the dip */
           for (j = i + 2;; j++)
-            if (compare_less (xs, b, j - 1))
+            if (compare_less<Traced> (xs, b, j - 1, st))
               break;
 
           /* if dip has odd length, retain dip starting point */
@@ -136,11 +145,7 @@ do_eastman (vector<int> &xs)
 
       new_cnt = retain_points.size();
 
-#ifdef DBGOUT
-      cout << ":";
-      for (k = 0; k < new_cnt; k++)
-        cout << retain_points[k] << " ";
-#endif
+      if (Traced) st->phase_end (new_cnt);
 
       /* populate b with new retain points */
       for (k = 0; k < new_cnt; k++)
@@ -160,10 +165,64 @@ do_eastman (vector<int> &xs)
       phase += 1;
     }
 
-#ifdef DBGOUT
-  cout << endl;
-#endif
-
   return b[0];
 }
 
+/* look in header for detailed comment */
+int 
+do_eastman (vector<int> &xs)
+{
+  CF_ALLOC_SCOPE("do_eastman (dip)");
+  EastmanTrace *tr = eastman_trace ();
+  int res;
+
+  if (!tr)
+    return eastman_impl<false> (xs, nullptr);
+
+  EastmanCallStats st;
+  st.begin (xs);
+  res = eastman_impl<true> (xs, &st);
+  st.end (res);
+  tr->record ("dip", st);
+  return res;
+}
+
+
+/* look in header for detailed comment: lanes of cf_eastman_batch.cpp
+   choose shifts of cf_eastman.cpp, so this variant goes word by word */
+void
+do_eastman_batch (const int *soa, size_t n, size_t w, int *shifts)
+{
+  if ((n % 2) == 0)
+    throw std::runtime_error("Eastman word length shall be odd");
+
+  vector<int> x;
+  for (size_t l = 0; l != w; ++l)
+    {
+      x.resize(n);
+      for (size_t p = 0; p != n; ++p)
+        x[p] = soa[p * w + l];
+      try
+        {
+          shifts[l] = do_eastman (x);
+        }
+      catch (std::runtime_error &)
+        {
+          shifts[l] = -1;
+        }
+    }
+}
+
+const char *
+eastman_batch_isa ()
+{
+  return "per-word";
+}
+
+/* look in header for detailed comment: SlidingEastman follows phases of
+   cf_eastman.cpp, windows go to do_eastman one by one */
+bool
+eastman_sliding ()
+{
+  return false;
+}
@@ -0,0 +1,197 @@
+//===-- cf_encode.cpp -- byte stream to Eastman comma-free code ----------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains an executable programm which encodes arbitrary bytes
+// into words of Eastman comma-free code over [0 .. m) with odd word
+// length n, and decodes them back:
+//
+// ./cf_encode 4 5 data.bin > data.cf
+// ./cf_encode -d 4 5 data.cf > data.out
+//
+// every letter of encoded stream is one byte. Input is given file or stdin,
+// output goes to stdout. Decoder fails (exit code 1) on damaged or
+// truncated stream. Option --info prints code parameters (code size,
+// bytes per block, words per block) to stderr
+//
+// see cf_encode.hpp for conversion details
+//
+//===----------------------------------------------------------------------===//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "cf_encode.hpp"
+
+using std::cerr;
+using std::endl;
+using std::vector;
+using std::string;
+
+struct Options
+{
+  int m = 0, n = 0;
+  bool decode = false, info = false;
+  string input;
+};
+
+void process_command_line (int argc, char **argv, Options &opts);
+
+static size_t
+read_some (int fd, uint8_t *p, size_t room)
+{
+  ssize_t k;
+
+  do
+    k = read(fd, p, room);
+  while ((k < 0) && (errno == EINTR));
+
+  if (k < 0)
+    throw std::runtime_error("Read error");
+  return k;
+}
+
+static void
+write_out (vector<uint8_t> &out)
+{
+  if (std::fwrite(out.data(), 1, out.size(), stdout) != out.size())
+    throw std::runtime_error("Write error");
+  out.clear();
+}
+
+/* chunks of input, unconsumed tail of every chunk is moved ahead of
+   next one; f(p, len, final) returns number of consumed bytes */
+template <typename F> static void
+process_stream (int fd, F f)
+{
+  vector<uint8_t> buf(1 << 20);
+  size_t have = 0;
+
+  for (;;)
+    {
+      size_t got = read_some(fd, buf.data() + have, buf.size() - have);
+      have += got;
+      size_t used = f(buf.data(), have, got == 0);
+      std::copy(buf.begin() + used, buf.begin() + have, buf.begin());
+      have -= used;
+      if (got == 0)
+        return;
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  Options opts;
+  int fd = 0;
+  bool ok = true;
+
+  process_command_line (argc, argv, opts);
+
+  CfEncoder enc(opts.m, opts.n);
+  vector<uint8_t> out;
+
+  if (opts.info)
+    cerr << "code " << enc.size() << " words, " << enc.block_bytes()
+         << " bytes per " << enc.group_words() << " words" << endl;
+
+  if (!opts.input.empty())
+    {
+      fd = open(opts.input.c_str(), O_RDONLY);
+      if (fd < 0)
+        throw std::runtime_error("Can not open " + opts.input);
+    }
+
+  if (!opts.decode)
+    process_stream (fd, [&] (const uint8_t *p, size_t len, bool last) {
+      size_t used = enc.encode(p, len, out);
+      if (last)
+        {
+          enc.finish(p + used, len - used, out);
+          used = len;
+        }
+      write_out (out);
+      return used;
+    });
+  else
+    {
+      CfBlockDecoder dec(enc);
+      process_stream (fd, [&] (const uint8_t *p, size_t len, bool last) {
+        size_t used = dec.feed(p, len, out);
+        if (last)
+          ok = dec.finish(len - used, out);
+        write_out (out);
+        return used;
+      });
+    }
+
+  std::fflush(stdout);
+  if (fd != 0)
+    close(fd);
+
+  if (!ok)
+    {
+      cerr << "Damaged or truncated stream" << endl;
+      return 1;
+    }
+
+  return 0;
+}
+
+void
+process_command_line (int argc, char **argv, Options &opts)
+{
+  int idx, npos = 0;
+
+  for (idx = 1; idx < argc; ++idx)
+    {
+      string arg = argv[idx];
+
+      if (arg == "-d")
+        opts.decode = true;
+      else if (arg == "--info")
+        opts.info = true;
+      else if (npos == 0)
+        {
+          opts.m = atoi (argv[idx]);
+          npos += 1;
+        }
+      else if (npos == 1)
+        {
+          opts.n = atoi (argv[idx]);
+          npos += 1;
+        }
+      else if (npos == 2)
+        {
+          opts.input = arg;
+          npos += 1;
+        }
+      else
+        npos += 1;
+    }
+
+  if ((npos != 2) && (npos != 3))
+    {
+      cerr << "usage: \"" << argv[0] << " [-d] [--info] m n [input]\" where"
+              " m is alphabet size (<= 256) and n is odd word length" << endl;
+      throw std::runtime_error("incorrect command line");
+    }
+
+  if ((opts.m <= 1) || (opts.m > 256) || (opts.n <= 1) || (opts.n % 2 == 0))
+    {
+      cerr << "m shall be in [2, 256], n shall be odd and > 1" << endl;
+      throw std::runtime_error("incorrect command line");
+    }
+}
@@ -0,0 +1,317 @@
+//===------- cf_encode.hpp -- byte stream to Eastman code words -----------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains definition and implementation of CfEncoder class which
+// turns arbitrary bytes into words of Eastman comma-free code and
+// CfBlockDecoder class which turns them back
+//
+// Code of (m, odd n) consists of do_eastman shifts of all PrimeGen words,
+// so its K words are ranked in PrimeGen order: table index -> code word
+// (unrank) is precomputed, code word -> index (rank) is CfDecoder lookup.
+// Codes compiled in by cf_fixed.hpp are used in place, not computed or
+// copied: encoder reads their words, decoder of words longer than 8 letters
+// ranks by their rank table; shorter words are looked up by packed keys
+// of CfDecoder, which are faster than rank (cf_bench block_decode)
+//
+// Bytes are converted by blocks: B bytes (big-endian number below 256^B)
+// are written as D digits in base K, most significant first, every digit is
+// code word. B <= 8 is chosen to maximize bytes per word, D is minimal with
+// K^D >= 256^B
+//
+// Last block of r < B bytes (possibly r = 0) gets length byte r as most
+// significant byte, so r + 1 <= B bytes still fit into D digits. Stream
+// always ends with such final group, so decoder holds one group back
+// until stream ends
+//
+// Both sides work on chunks with bounded memory: encoder keeps less than
+// B bytes, decoder keeps less than n letters and two group values.
+// Digits are split off by multiplication with precomputed reciprocal of K
+// (unsigned __int128, gcc and clang), not by division
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_ENCODE_GUARD_
+#define CF_ENCODE_GUARD_
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include "tuples.hpp"
+#include "cf_eastman.h"
+#include "cf_decode.hpp"
+#include "cf_fixed.hpp"
+
+using std::vector;
+
+/* division by runtime constant d > 1 as multiplication, valid for every
+   64-bit n (Granlund and Montgomery, round-up variant) */
+class FastDiv
+{
+  uint64_t m_d, m_mul;
+  int m_shift;
+
+public:
+  explicit FastDiv (uint64_t d = 2) : m_d(d), m_shift(0)
+    {
+      while ((m_shift < 64) && ((uint64_t(1) << m_shift) < d))
+        m_shift += 1;
+      unsigned __int128 top = (unsigned __int128)(
+        (m_shift == 64) ? 0 : (uint64_t(1) << m_shift) - d) << 64;
+      m_mul = uint64_t(top / d) + 1;
+    }
+
+  uint64_t divisor () const { return m_d; }
+
+  uint64_t div (uint64_t n) const
+    {
+      uint64_t t = uint64_t(((unsigned __int128)m_mul * n) >> 64);
+      return (t + ((n - t) >> 1)) >> (m_shift - 1);
+    }
+};
+
+class CfEncoder
+{
+  enum { stride = 8 };
+
+  int m_m, m_n;
+  FixedCodeRef m_fixed;           /* compiled in code or all null */
+  vector<uint8_t> m_letters;      /* index -> code word, flat, stride more
+                                     bytes after last one (other codes) */
+  uint64_t m_k;
+  FastDiv m_div;
+  size_t m_block, m_digits;
+
+  /* digits base k needed for numbers below 256^bytes */
+  static size_t digits_for (uint64_t k, size_t bytes)
+    {
+      uint64_t v = (bytes == 8) ? ~uint64_t(0)
+                                : ((uint64_t(1) << (8 * bytes)) - 1);
+      size_t d = 0;
+      do {
+        v /= k;
+        d += 1;
+      } while (v > 0);
+      return d;
+    }
+
+  /* writes D words to o, stride bytes after them might be spoiled */
+  void put_value (uint64_t v, uint8_t *o) const
+    {
+      uint32_t dig[64];
+      size_t d;
+      const uint8_t *w = letters();
+
+      for (d = m_digits; d-- > 0; )
+        {
+          uint64_t q = m_div.div(v);
+          dig[d] = uint32_t(v - q * m_k);
+          v = q;
+        }
+
+      /* next words overwrite letters past word */
+      if (m_n <= stride)
+        for (d = 0; d != m_digits; ++d, o += m_n)
+          std::memcpy(o, w + size_t(dig[d]) * m_n, stride);
+      else
+        for (d = 0; d != m_digits; ++d, o += m_n)
+          std::memcpy(o, w + size_t(dig[d]) * m_n, m_n);
+    }
+
+  const uint8_t *letters () const
+    {
+      return m_fixed.code ? m_fixed.code : m_letters.data();
+    }
+
+public:
+  /* m is alphabet size (letters are bytes), n is odd word length */
+  CfEncoder (int m, int n) : m_m(m), m_n(n), m_fixed(fixed_code(m, n)),
+    m_k(m_fixed.size), m_block(0), m_digits(0)
+    {
+      size_t b;
+
+      if ((m < 2) || (m > 256) || (n < 3) || (n % 2 == 0))
+        throw std::runtime_error("CfEncoder: need 2 <= m <= 256, odd n > 1");
+
+      if (!m_fixed.code)
+        {
+          PrimeGen pg(m, n);
+          vector<int> w, x;
+          for (const vector<int> &p : pg.range())
+            {
+              w = x = p;
+              int s = do_eastman(x);
+              std::rotate(w.begin(), w.begin() + s, w.end());
+              m_letters.insert(m_letters.end(), w.begin(), w.end());
+              m_k += 1;
+            }
+          m_letters.resize(m_letters.size() + stride, 0);
+        }
+      m_div = FastDiv(m_k);
+
+      double best = 0;
+      for (b = 1; b <= 8; ++b)
+        {
+          size_t d = digits_for(m_k, b);
+          if (double(b) / d > best)
+            {
+              best = double(b) / d;
+              m_block = b;
+              m_digits = d;
+            }
+        }
+    }
+
+  int alphabet () const { return m_m; }
+  int length () const { return m_n; }
+  size_t size () const { return m_k; }
+  size_t block_bytes () const { return m_block; }
+  size_t group_words () const { return m_digits; }
+
+  /* compiled in code (cf_fixed.hpp) or all null */
+  const FixedCodeRef &fixed () const { return m_fixed; }
+
+  /* unrank: n letters of code word of given index */
+  const uint8_t *word (size_t idx) const { return letters() + idx * m_n; }
+
+  /* all code words, as CfDecoder takes them */
+  vector< vector<int> > code () const
+    {
+      vector< vector<int> > res;
+      for (size_t i = 0; i != m_k; ++i)
+        res.emplace_back(word(i), word(i) + m_n);
+      return res;
+    }
+
+  /* encodes whole blocks of p[0 .. len), appends letters to out,
+     returns number of consumed bytes (multiple of block_bytes) */
+  size_t encode (const uint8_t *p, size_t len, vector<uint8_t> &out) const
+    {
+      size_t nblocks = len / m_block, glen = m_digits * m_n, i, j;
+      size_t pos = out.size();
+
+      out.resize(pos + nblocks * glen + stride);
+      uint8_t *o = &out[pos];
+
+      for (i = 0; i != nblocks; ++i, p += m_block, o += glen)
+        {
+          uint64_t v = 0;
+          for (j = 0; j != m_block; ++j)
+            v = (v << 8) | p[j];
+          put_value(v, o);
+        }
+
+      out.resize(pos + nblocks * glen);
+      return nblocks * m_block;
+    }
+
+  /* encodes final block of r < block_bytes bytes, stream is complete */
+  void finish (const uint8_t *p, size_t r, vector<uint8_t> &out) const
+    {
+      uint64_t v = r;
+      size_t pos = out.size();
+
+      if (r >= m_block)
+        throw std::runtime_error("CfEncoder: final block is too long");
+      for (size_t j = 0; j != r; ++j)
+        v = (v << 8) | p[j];
+
+      out.resize(pos + m_digits * m_n + stride);
+      put_value(v, &out[pos]);
+      out.resize(pos + m_digits * m_n);
+    }
+};
+
+/* decoder pairing with CfEncoder */
+class CfBlockDecoder
+{
+  typedef unsigned __int128 wide;
+
+  const CfEncoder &m_enc;
+  CfDecoder m_dec;
+  wide m_value, m_held;           /* group being read and held group */
+  size_t m_ndig;                  /* words of group being read */
+  bool m_has_held, m_bad;
+
+public:
+  /* compiled in code of n > 8 is ranked by its table, other code by
+     packed keys (n <= 8) or hashed lookup */
+  explicit CfBlockDecoder (const CfEncoder &enc) :
+    m_enc(enc),
+    m_dec((enc.fixed().rank && (enc.length() > 8))
+          ? CfDecoder(enc.alphabet(), enc.length(), enc.fixed().rank,
+                      enc.size())
+          : CfDecoder(enc.code())),
+    m_value(0), m_held(0), m_ndig(0), m_has_held(false), m_bad(false) {}
+
+  const DecodeStats &stats () const { return m_dec.stats(); }
+
+  /* prepares for new stream */
+  void reset ()
+    {
+      m_dec.reset();
+      m_value = m_held = 0;
+      m_ndig = 0;
+      m_has_held = m_bad = false;
+    }
+
+  /* feeds letters, appends decoded bytes of all groups but last to out,
+     returns number of consumed letters, see CfDecoder::decode_bytes */
+  size_t feed (const uint8_t *x, size_t len, vector<uint8_t> &out)
+    {
+      size_t d = m_enc.group_words(), b = m_enc.block_bytes();
+      uint64_t k = m_enc.size();
+
+      return m_dec.decode_bytes(x, len, [&] (uint64_t, int32_t idx) {
+        /* K^D < 256^B * K, so value never overflows 128 bits */
+        m_value = m_value * k + uint32_t(idx);
+        if (++m_ndig != d)
+          return;
+
+        if (m_has_held)
+          {
+            if ((m_held >> (8 * b)) != 0)
+              m_bad = true;
+            size_t pos = out.size();
+            out.resize(pos + b);
+            for (size_t j = b; j-- > 0; )
+              out[pos + b - 1 - j] = uint8_t(m_held >> (8 * j));
+          }
+
+        m_held = m_value;
+        m_has_held = true;
+        m_value = 0;
+        m_ndig = 0;
+      });
+    }
+
+  /* decodes final group, trailing is number of unconsumed letters;
+     false if stream is damaged or truncated */
+  bool finish (size_t trailing, vector<uint8_t> &out)
+    {
+      const DecodeStats &st = m_dec.stats();
+      size_t r, b = m_enc.block_bytes();
+
+      if (m_bad || !m_has_held || (m_ndig != 0) || (trailing != 0)
+          || (st.resyncs != 0) || (st.skipped != 0))
+        return false;
+
+      /* v = r * 256^r + data, data < 256^r, only one r fits */
+      for (r = 0; r != b; ++r)
+        if ((m_held >> (8 * r)) == r)
+          break;
+      if (r == b)
+        return false;
+      for (size_t j = r; j-- > 0; )
+        out.push_back(uint8_t(m_held >> (8 * j)));
+      return true;
+    }
+};
+
+#endif
@@ -0,0 +1,103 @@
+//===------- cf_fixed.hpp -- compiled in Eastman codes of small (m, n) ----===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains FixedCode<M, N> class: Eastman code of shipped (M, N)
+// (ternary n = 3, 5, 7, quaternary n = 3, 5) from tables generated at
+// build time by cf_tables_gen (cf_tables.inc), so there is no PrimeGen,
+// do_eastman or dictionary at run time, no startup cost and no heap
+//
+// Word (letters below M) is index by base M digits, then:
+//
+// - member: bit of bitmap over all M^N words
+// - rank: table over all M^N words, index of code word in PrimeGen order
+//   (as CfEncoder ranks it) or -1
+// - word: code word of rank, M^N / N words at most, 8 bytes might be read
+//   from any of them
+//
+// all are constant-time lookups without branches, loop over N letters is
+// unrolled by compiler. Letters are not checked, letter >= M is undefined
+// behaviour. Other (M, N) do not compile; fixed_code (m, n) finds tables
+// at run time (all null if they are not compiled in): CfEncoder takes
+// words in place, CfBlockDecoder ranks words longer than 8 letters by same
+// table, shorter ones by faster packed keys (cf_encode.hpp)
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_FIXED_GUARD_
+#define CF_FIXED_GUARD_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "cf_tables.inc"
+
+template <int M, int N> class FixedCode
+{
+  typedef FixedTables<M, N> T;
+
+public:
+  enum { alphabet = M, length = N, size = T::size, space = T::space };
+
+  /* base M number of w[0 .. N) */
+  template <typename L> static uint32_t index (const L *w)
+    {
+      uint32_t idx = 0;
+      for (int i = 0; i != N; ++i)
+        idx = idx * M + uint32_t(w[i]);
+      return idx;
+    }
+
+  template <typename L> static bool member (const L *w)
+    {
+      uint32_t idx = index(w);
+      return (T::member()[idx >> 6] >> (idx & 63)) & 1;
+    }
+
+  /* index of code word w, -1 if w is not in code */
+  template <typename L> static int rank (const L *w)
+    {
+      return T::rank()[index(w)];
+    }
+
+  /* N letters of code word r < size */
+  static const uint8_t *word (size_t r) { return T::code() + r * N; }
+
+  /* rank of all M^N words, by index */
+  static const int16_t *ranks () { return T::rank(); }
+};
+
+/* tables of FixedCode<m, n> chosen at run time */
+struct FixedCodeRef
+{
+  size_t size;                    /* number of words */
+  const uint8_t *code;            /* FixedCode::word (0) */
+  const int16_t *rank;            /* FixedCode::ranks () */
+};
+
+/* visitor of for_each_fixed_code, keeps tables of (m, n) */
+struct FixedCodeFind
+{
+  int m, n;
+  FixedCodeRef res;
+
+  template <int M, int N> void run ()
+    {
+      if ((m == M) && (n == N))
+        res = { size_t(FixedCode<M, N>::size), FixedCode<M, N>::word(0),
+                FixedCode<M, N>::ranks() };
+    }
+};
+
+inline FixedCodeRef
+fixed_code (int m, int n)
+{
+  FixedCodeFind f = { m, n, { 0, nullptr, nullptr } };
+  for_each_fixed_code (f);
+  return f.res;
+}
+
+#endif
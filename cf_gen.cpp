@@ -18,56 +18,206 @@
 //
 // programm outputs lexicographically minimal representatives from every class
 //
+// options for long sweeps (like cf_gen 2 31 | eastman):
+//
+// --shard i/N        output only words number i, i + N, i + 2N ... (round
+//                    robin, so shards get equal parts of every range)
+// --checkpoint file  save generator state every --every seconds (default
+//                    60) and on SIGINT / SIGTERM, run with same arguments
+//                    continues after last saved word, words printed after
+//                    last checkpoint are printed again
+// --eastman          output rotation of every word which Eastman's
+//                    algorithm chooses (k shall be odd), that is words of
+//                    cf_gen | eastman directly; phases of consecutive words
+//                    are shared over their common prefix (see
+//                    cf_primes.hpp)
+//
 //===----------------------------------------------------------------------===//
 
 #include <iostream>
+#include <string>
+#include <chrono>
+#include <memory>
 #include <cstdlib>
 #include "tuples.hpp"
+#include "cf_primes.hpp"
+#include "cf_checkpoint.hpp"
 
 using std::cout;
 using std::cerr;
 using std::endl;
 using std::atoi;
 
-void process_command_line (int argc, char **argv, int &n, int &k);
+struct Options
+{
+  int n = 0, k = 0;
+  Shard shard;
+  std::string checkpoint;
+  double every = 60.0;
+  bool eastman = false;
+};
 
-int
-main (int argc, char **argv)
+void process_command_line (int argc, char **argv, Options &opts);
+
+template <typename Gen>
+static void
+save_state (Checkpoint &cp, const Options &opts, const Gen &pg,
+            uint64_t next, bool done)
 {
-  int n, k;
+  cp.set("tool", "cf_gen");
+  cp.set("n", opts.n);
+  cp.set("k", opts.k);
+  cp.set("shard", opts.shard.str());
+  cp.set("eastman", opts.eastman ? 1 : 0);
+  cp.set("next", next);
+  cp.set("state", pg.state());
+  cp.set("done", done ? 1 : 0);
+  cp.save();
+}
 
-  process_command_line (argc, argv, n, k);
+/* prints words of pg (PrimeGen or EastmanPrimeGen), returns exit code */
+template <typename Gen>
+static int
+sweep (const Options &opts, Gen &pg)
+{
+  int n = opts.n, k = opts.k;
+  uint64_t next = 0;      /* number of next word of all shards */
 
-  vector<int> res(k);
+  Checkpoint cp(opts.checkpoint);
 
-  PrimeGen pg(n, k);
+  if (cp.enabled() && cp.load())
+    {
+      /* checkpoints of plain cf_gen have no eastman */
+      uint64_t eastman = cp.has("eastman") ? cp.get_u64("eastman") : 0;
+      if ((cp.get("tool") != "cf_gen") || (cp.get_u64("n") != uint64_t(n))
+          || (cp.get_u64("k") != uint64_t(k))
+          || (cp.get("shard") != opts.shard.str())
+          || (eastman != (opts.eastman ? 1 : 0)))
+        throw std::runtime_error("Checkpoint " + cp.path()
+                                 + " is for other arguments");
+      if (cp.get_u64("done") == 1)
+        return 0;
+      pg.restore(cp.get_ints("state"));
+      next = cp.get_u64("next");
+    }
+
+  /* signals are caught only to save checkpoint, otherwise they stop
+     tool as usual */
+  std::unique_ptr<CheckpointSignals> sig;
+  if (cp.enabled())
+    sig.reset(new CheckpointSignals);
+  auto every = std::chrono::duration<double>(opts.every);
+  auto next_save = std::chrono::steady_clock::now() + every;
 
-  while (pg.get_next(res))
+  /* word is asked for only by its shard, EastmanPrimeGen finds its
+     rotation then */
+  auto words = pg.range();
+  for (auto it = words.begin(); it != words.end(); ++it)
     {
-      for (auto a : res)
-        cout << a << " ";
-      cout << std::endl;
+      if (opts.shard.owns(next))
+        {
+          for (auto a : *it)
+            cout << a << " ";
+          cout << std::endl;
+        }
+      next += 1;
+
+      if (sig && ((next & 4095) == 0 || sig->raised()))
+        {
+          bool stop = sig->raised();
+          if (stop || (std::chrono::steady_clock::now() >= next_save))
+            {
+              cout.flush();
+              save_state (cp, opts, pg, next, false);
+              next_save = std::chrono::steady_clock::now() + every;
+            }
+          if (stop)
+            {
+              cerr << "interrupted after word " << next << ", checkpoint "
+                   << cp.path() << " saved" << endl;
+              return 1;
+            }
+        }
     }
-  
+
+  if (cp.enabled())
+    save_state (cp, opts, pg, next, true);
+
   return 0;
 }
 
+int
+main (int argc, char **argv)
+{
+  Options opts;
+
+  process_command_line (argc, argv, opts);
+
+  if (opts.eastman)
+    {
+      EastmanPrimeGen eg(opts.n, opts.k);
+      return sweep (opts, eg);
+    }
+
+  PrimeGen pg(opts.n, opts.k);
+  return sweep (opts, pg);
+}
+
 void 
-process_command_line (int argc, char **argv, int &n, int &k)
+process_command_line (int argc, char **argv, Options &opts)
 {
-  if (argc < 3)
+  int idx, npos = 0;
+
+  for (idx = 1; idx < argc; ++idx)
     {
-      cerr << "usage: \"" << argv[0] << " n k\" where n "
+      std::string arg = argv[idx];
+      bool has_val = (idx + 1 < argc);
+
+      if (arg == "--checkpoint" && has_val)
+        opts.checkpoint = argv[++idx];
+      else if (arg == "--eastman")
+        opts.eastman = true;
+      else if (arg == "--every" && has_val)
+        opts.every = atof(argv[++idx]);
+      else if (arg == "--shard" && has_val)
+        {
+          if (!opts.shard.parse(argv[++idx]))
+            {
+              cerr << "shard shall be i/N, 0 <= i < N" << endl;
+              throw std::runtime_error("incorrect command line");
+            }
+        }
+      else if (npos == 0)
+        {
+          opts.n = atoi (argv[idx]);
+          npos += 1;
+        }
+      else if (npos == 1)
+        {
+          opts.k = atoi (argv[idx]);
+          npos += 1;
+        }
+      else
+        npos += 1;
+    }
+
+  if (npos != 2)
+    {
+      cerr << "usage: \"" << argv[0] << " [--shard i/N] [--checkpoint file]"
+              " [--every secs] [--eastman] n k\" where n "
               "is alphabet delimiter [0 .. n) and k is position count" << endl;
       throw std::runtime_error("incorrect command line");
     }
 
-  n = atoi (argv[1]);
-  k = atoi (argv[2]);
-
-  if ((n <= 1) || (k <= 1))
+  if ((opts.n <= 1) || (opts.k <= 1))
     {
       cerr << "Both n and k shall be > 1" << endl;
       throw std::runtime_error("incorrect command line");     
     }
+
+  if (opts.eastman && (opts.k % 2 == 0))
+    {
+      cerr << "k shall be odd for --eastman" << endl;
+      throw std::runtime_error("incorrect command line");
+    }
 }
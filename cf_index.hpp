@@ -0,0 +1,263 @@
+//===------- cf_index.hpp -- incremental packed comma-free dictionary -----===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains definition and implementation of CfIndex class which
+// holds comma-free code over [0 .. m) alphabet with words of length n,
+// packed as numbers in base m (first letter is most significant)
+//
+// For every split 0 < L < n class keeps counts and lists of code words
+// by prefix of length L and by suffix of length L. Code is comma-free if
+// no word z appears inside xy for x, y, z from code:
+//
+// x = ....[ suffix of x of length L ]
+// y =                               [ prefix of y of length n - L ]....
+// z =     [ prefix of z of length L ][ suffix of z of length n - L ]
+//
+// so for every split pair (suffix of x, prefix of y) is "poisoned" for z.
+// When candidate w is added to comma-free code, every new violation involves
+// w as z, as x or as y, and every role is checked through split counts in
+// O(n * bucket size). Words might be removed as well, so class suits
+// backtracking and local search
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_INDEX_GUARD_
+#define CF_INDEX_GUARD_
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+using std::vector;
+
+class CfIndex
+{
+  int m_m, m_n;
+  vector<uint32_t> m_pow;
+  vector<uint8_t> m_member;
+  vector< vector<uint32_t> > m_pre_cnt, m_suf_cnt;
+  vector< vector< vector<uint32_t> > > m_by_pre, m_by_suf;
+  size_t m_size;
+
+  static void erase_from (vector<uint32_t> &v, uint32_t w)
+    {
+      auto it = std::find(v.begin(), v.end(), w);
+      *it = v.back();
+      v.pop_back();
+    }
+
+  void insert (uint32_t w)
+    {
+      int l;
+      m_member[w] = 1;
+      for (l = 1; l < m_n; ++l)
+        {
+          uint32_t p = prefix(w, l), s = suffix(w, l);
+          m_pre_cnt[l][p] += 1;
+          m_suf_cnt[l][s] += 1;
+          m_by_pre[l][p].push_back(w);
+          m_by_suf[l][s].push_back(w);
+        }
+      m_size += 1;
+    }
+
+  void erase (uint32_t w)
+    {
+      int l;
+      m_member[w] = 0;
+      for (l = 1; l < m_n; ++l)
+        {
+          uint32_t p = prefix(w, l), s = suffix(w, l);
+          m_pre_cnt[l][p] -= 1;
+          m_suf_cnt[l][s] -= 1;
+          erase_from(m_by_pre[l][p], w);
+          erase_from(m_by_suf[l][s], w);
+        }
+      m_size -= 1;
+    }
+
+  /* true if code (with w inside) has violation involving w */
+  bool violates (uint32_t w) const
+    {
+      int l;
+
+      for (l = 1; l < m_n; ++l)
+        {
+          /* w as z: x ends with head of w, y starts with tail of w */
+          if (m_suf_cnt[l][prefix(w, l)]
+              && m_pre_cnt[m_n - l][suffix(w, m_n - l)])
+            return true;
+
+          /* w as x: z starts with tail of w, some y continues z */
+          for (uint32_t z : m_by_pre[l][suffix(w, l)])
+            if (m_pre_cnt[m_n - l][suffix(z, m_n - l)])
+              return true;
+
+          /* w as y: z ends with head of w, some x precedes z */
+          for (uint32_t z : m_by_suf[l][prefix(w, l)])
+            if (m_suf_cnt[m_n - l][prefix(z, m_n - l)])
+              return true;
+        }
+
+      return false;
+    }
+
+public:
+  /* m is alphabet size, n is word length */
+  CfIndex (int m, int n) : m_m(m), m_n(n), m_pow(n + 1),
+                           m_pre_cnt(n), m_suf_cnt(n),
+                           m_by_pre(n), m_by_suf(n), m_size(0)
+    {
+      int l;
+
+      if ((m < 2) || (n < 2))
+        throw std::runtime_error("CfIndex: alphabet and length shall be > 1");
+
+      m_pow[0] = 1;
+      for (l = 1; l <= n; ++l)
+        {
+          if (m_pow[l - 1] > (1u << 26) / m)
+            throw std::runtime_error("CfIndex: m^n is too large");
+          m_pow[l] = m_pow[l - 1] * m;
+        }
+
+      m_member.resize(m_pow[n]);
+      for (l = 1; l < n; ++l)
+        {
+          m_pre_cnt[l].resize(m_pow[l]);
+          m_suf_cnt[l].resize(m_pow[l]);
+          m_by_pre[l].resize(m_pow[l]);
+          m_by_suf[l].resize(m_pow[l]);
+        }
+    }
+
+  int alphabet () const { return m_m; }
+  int length () const { return m_n; }
+  size_t size () const { return m_size; }
+
+  uint32_t prefix (uint32_t w, int l) const { return w / m_pow[m_n - l]; }
+  uint32_t suffix (uint32_t w, int l) const { return w % m_pow[l]; }
+
+  uint32_t pack (const vector<int> &x) const
+    {
+      uint32_t w = 0;
+      for (int c : x)
+        w = w * m_m + c;
+      return w;
+    }
+
+  void unpack (uint32_t w, vector<int> &x) const
+    {
+      int i;
+      x.resize(m_n);
+      for (i = m_n - 1; i >= 0; --i)
+        {
+          x[i] = w % m_m;
+          w /= m_m;
+        }
+    }
+
+  /* left cyclic shift by one letter */
+  uint32_t rotate (uint32_t w) const
+    {
+      uint32_t head = prefix(w, 1);
+      return (w - head * m_pow[m_n - 1]) * m_m + head;
+    }
+
+  bool contains (uint32_t w) const { return m_member[w] != 0; }
+
+  /* true if code stays comma-free with w */
+  bool can_add (uint32_t w)
+    {
+      bool res;
+      if (m_member[w])
+        return false;
+      insert(w);
+      res = !violates(w);
+      erase(w);
+      return res;
+    }
+
+  /* adds w if code stays comma-free, returns success */
+  bool add (uint32_t w)
+    {
+      if (m_member[w])
+        return false;
+      insert(w);
+      if (violates(w))
+        {
+          erase(w);
+          return false;
+        }
+      return true;
+    }
+
+  void remove (uint32_t w)
+    {
+      if (!m_member[w])
+        throw std::runtime_error("CfIndex: removing absent word");
+      erase(w);
+    }
+
+  /* collects code words, removal of which makes w addable: for every
+     violation with w one of its other participants, so result is small
+     but not necessary minimal; w shall be primitive and absent */
+  void conflicts (uint32_t w, vector<uint32_t> &out)
+    {
+      int l;
+
+      out.clear();
+      insert(w);
+
+      for (l = 1; l < m_n; ++l)
+        {
+          /* w as z: remove all x or all y, whichever is smaller */
+          const vector<uint32_t> &xs = m_by_suf[l][prefix(w, l)];
+          const vector<uint32_t> &ys = m_by_pre[m_n - l][suffix(w, m_n - l)];
+          if (!xs.empty() && !ys.empty())
+            {
+              bool xs_w = std::find(xs.begin(), xs.end(), w) != xs.end();
+              bool ys_w = std::find(ys.begin(), ys.end(), w) != ys.end();
+              const vector<uint32_t> &side =
+                (ys_w || (!xs_w && xs.size() <= ys.size())) ? xs : ys;
+              for (uint32_t v : side)
+                if (v != w)
+                  out.push_back(v);
+            }
+
+          /* w as x or y: remove z, if it is w, remove other side */
+          for (uint32_t z : m_by_pre[l][suffix(w, l)])
+            if (m_pre_cnt[m_n - l][suffix(z, m_n - l)])
+              {
+                if (z != w)
+                  out.push_back(z);
+                else
+                  for (uint32_t y : m_by_pre[m_n - l][suffix(z, m_n - l)])
+                    if (y != w)
+                      out.push_back(y);
+              }
+
+          for (uint32_t z : m_by_suf[l][prefix(w, l)])
+            if (m_suf_cnt[m_n - l][prefix(z, m_n - l)])
+              {
+                if (z != w)
+                  out.push_back(z);
+                else
+                  for (uint32_t x : m_by_suf[m_n - l][prefix(z, m_n - l)])
+                    if (x != w)
+                      out.push_back(x);
+              }
+        }
+
+      erase(w);
+      std::sort(out.begin(), out.end());
+      out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+};
+
+#endif
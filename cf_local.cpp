@@ -0,0 +1,147 @@
+//===-- cf_local.cpp -- randomized local search for large comma-free codes ===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains an executable programm which searches large comma-free
+// code for alphabet [0 .. m) and words of length n in given time on all
+// cores, reporting code size over time to stderr:
+//
+// ./cf_local --time 5 4 4
+// 0.10s size 55 (worker 2)
+// 0.30s size 56 (worker 0)
+// ...
+//
+// and printing best code to stdout, one word per line, ready for cf_check
+//
+// Options:
+//
+// --time secs    time budget (default 10)
+// --threads N    number of workers (default: number of cores)
+// --seed S       random seed
+// --target K     stop as soon as code of size K is found
+// --moves N      annealing moves per restart
+//
+// see cf_local.hpp for search details
+//
+//===----------------------------------------------------------------------===//
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "cf_local.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::vector;
+
+struct Options
+{
+  int m = 0, n = 0;
+  double seconds = 10.0;
+  unsigned threads = 0;
+  uint64_t seed = 1, moves = 20000;
+  size_t target = ~size_t(0);
+};
+
+void process_command_line (int argc, char **argv, Options &opts);
+
+int
+main (int argc, char **argv)
+{
+  Options opts;
+  size_t reported = 0;
+
+  process_command_line (argc, argv, opts);
+
+  if (opts.threads == 0)
+    opts.threads = std::max(1u, std::thread::hardware_concurrency());
+
+  LocalSearch ls(opts.m, opts.n);
+  ls.set_schedule (opts.moves, 0.6, 0.9995, 7);
+
+  ls.run (opts.threads, opts.seconds, opts.seed, opts.target, 0.05,
+          [&](double, const LocalSearch::Snapshot *b) {
+            if (b && b->code.size() > reported)
+              {
+                reported = b->code.size();
+                cerr << std::fixed << std::setprecision(2) << b->seconds
+                     << "s size " << reported << " (worker " << b->worker
+                     << ")" << endl;
+              }
+          });
+
+  const LocalSearch::Snapshot *b = ls.best();
+  vector<int> x;
+
+  if (b)
+    for (uint32_t w : b->code)
+      {
+        ls.unpack(w, x);
+        for (auto c : x)
+          cout << c << " ";
+        cout << endl;
+      }
+
+  cout << "size " << (b ? b->code.size() : 0) << " of " << ls.classes()
+       << " classes" << endl;
+
+  return 0;
+}
+
+void
+process_command_line (int argc, char **argv, Options &opts)
+{
+  int idx, npos = 0;
+
+  for (idx = 1; idx < argc; ++idx)
+    {
+      std::string arg = argv[idx];
+      bool has_val = (idx + 1 < argc);
+
+      if (arg == "--time" && has_val)
+        opts.seconds = atof(argv[++idx]);
+      else if (arg == "--threads" && has_val)
+        opts.threads = atoi(argv[++idx]);
+      else if (arg == "--seed" && has_val)
+        opts.seed = std::strtoull(argv[++idx], nullptr, 10);
+      else if (arg == "--target" && has_val)
+        opts.target = std::strtoull(argv[++idx], nullptr, 10);
+      else if (arg == "--moves" && has_val)
+        opts.moves = std::strtoull(argv[++idx], nullptr, 10);
+      else if (npos == 0)
+        {
+          opts.m = atoi (argv[idx]);
+          npos += 1;
+        }
+      else if (npos == 1)
+        {
+          opts.n = atoi (argv[idx]);
+          npos += 1;
+        }
+      else
+        npos += 1;
+    }
+
+  if (npos != 2)
+    {
+      cerr << "usage: \"" << argv[0] << " [--time secs] [--threads N]"
+              " [--seed S] [--target K] [--moves N] m n\" where m is"
+              " alphabet delimiter [0 .. m) and n is word length" << endl;
+      throw std::runtime_error("incorrect command line");
+    }
+
+  if ((opts.m <= 1) || (opts.n <= 1) || (opts.seconds <= 0))
+    {
+      cerr << "Both m and n shall be > 1, time shall be > 0" << endl;
+      throw std::runtime_error("incorrect command line");
+    }
+}
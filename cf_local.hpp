@@ -0,0 +1,305 @@
+//===------- cf_local.hpp -- randomized local search for large codes ------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains definition and implementation of LocalSearch class
+// which finds large (not necessary maximum) comma-free codes when exact
+// search is hopeless. Every worker thread does independent restarts:
+//
+// - greedy insertion of PrimeGen classes in random order, every class gets
+//   first fitting rotation in random order
+// - then simulated annealing over swaps: random absent class gets random
+//   rotation w, code words conflicting with w (CfIndex::conflicts) are
+//   removed, gain is 1 - removed, move is accepted with probability
+//   exp(gain / T); removed classes are tabu for some moves, after every
+//   move absent classes are greedily reinserted
+//
+// Best code of all workers is published through lock-free slot: atomic
+// pointer to immutable snapshot, replaced by CAS only by bigger code.
+// Replaced snapshots are kept until search ends, so readers never see
+// freed memory
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_LOCAL_GUARD_
+#define CF_LOCAL_GUARD_
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#include "tuples.hpp"
+#include "cf_index.hpp"
+
+using std::vector;
+
+class LocalSearch
+{
+public:
+  typedef std::chrono::steady_clock clock;
+
+  /* immutable published code */
+  struct Snapshot
+  {
+    vector<uint32_t> code;
+    double seconds;   /* since search start */
+    unsigned worker;
+  };
+
+private:
+  int m_m, m_n;
+  vector< vector<uint32_t> > m_rots;
+  vector<int32_t> m_class;      /* packed word -> its class or -1 */
+  std::atomic<Snapshot *> m_best;
+  std::atomic<bool> m_stop;
+  std::mutex m_retired_mut;
+  vector<Snapshot *> m_retired;
+  clock::time_point m_start;
+
+  /* annealing parameters */
+  double m_temp = 0.6, m_cooling = 0.9995;
+  uint64_t m_moves = 20000;
+  unsigned m_tenure = 7;
+
+  void publish (const vector<uint32_t> &code, unsigned worker)
+    {
+      Snapshot *cur = m_best.load();
+      if (cur && cur->code.size() >= code.size())
+        return;
+
+      Snapshot *s = new Snapshot;
+      s->code = code;
+      s->seconds = std::chrono::duration<double>(clock::now() - m_start)
+                     .count();
+      s->worker = worker;
+
+      while (!cur || cur->code.size() < code.size())
+        if (m_best.compare_exchange_weak(cur, s))
+          {
+            if (cur)
+              {
+                std::lock_guard<std::mutex> lk(m_retired_mut);
+                m_retired.push_back(cur);
+              }
+            return;
+          }
+
+      delete s;
+    }
+
+  struct Worker
+  {
+    CfIndex idx;
+    vector<int> state;          /* class -> rotation or -1 */
+    vector<uint64_t> tabu;      /* class -> move until which it is tabu */
+    vector<size_t> order;
+    std::mt19937_64 rng;
+
+    Worker (int m, int n, size_t nclasses, uint64_t seed) :
+      idx(m, n), state(nclasses, -1), tabu(nclasses, 0),
+      order(nclasses), rng(seed)
+      {
+        for (size_t c = 0; c != nclasses; ++c)
+          order[c] = c;
+      }
+  };
+
+  /* tries to insert every absent, non-tabu class in random order */
+  void fill (Worker &w, uint64_t move)
+    {
+      size_t n = m_n;
+      std::shuffle(w.order.begin(), w.order.end(), w.rng);
+      for (size_t c : w.order)
+        {
+          if (w.state[c] >= 0 || w.tabu[c] > move)
+            continue;
+          size_t r0 = w.rng() % n;
+          for (size_t k = 0; k != n; ++k)
+            {
+              size_t r = (r0 + k) % n;
+              if (w.idx.add(m_rots[c][r]))
+                {
+                  w.state[c] = r;
+                  break;
+                }
+            }
+        }
+    }
+
+  void code_of (const Worker &w, vector<uint32_t> &code) const
+    {
+      code.clear();
+      for (size_t c = 0; c != m_rots.size(); ++c)
+        if (w.state[c] >= 0)
+          code.push_back(m_rots[c][w.state[c]]);
+    }
+
+  void worker (unsigned id, uint64_t seed)
+    {
+      Worker w(m_m, m_n, m_rots.size(), seed);
+      vector<uint32_t> confl, code;
+      std::uniform_real_distribution<double> unif(0.0, 1.0);
+      size_t nclasses = m_rots.size();
+
+      while (!m_stop.load(std::memory_order_relaxed))
+        {
+          /* restart from empty code */
+          for (size_t c = 0; c != nclasses; ++c)
+            {
+              if (w.state[c] >= 0)
+                w.idx.remove(m_rots[c][w.state[c]]);
+              w.state[c] = -1;
+              w.tabu[c] = 0;
+            }
+
+          fill(w, 0);
+          code_of(w, code);
+          publish(code, id);
+
+          double temp = m_temp;
+          size_t local_best = w.idx.size();
+
+          for (uint64_t move = 1; move <= m_moves; ++move)
+            {
+              temp *= m_cooling;
+              if (((move & 255) == 0)
+                  && m_stop.load(std::memory_order_relaxed))
+                break;
+
+              size_t c = w.rng() % nclasses;
+              if (w.state[c] >= 0 || w.tabu[c] > move)
+                continue;
+
+              uint32_t cand = m_rots[c][w.rng() % m_n];
+              w.idx.conflicts(cand, confl);
+
+              double gain = 1.0 - double(confl.size());
+              if (gain < 0 && unif(w.rng) >= std::exp(gain / temp))
+                continue;
+
+              for (uint32_t v : confl)
+                {
+                  size_t vc = m_class[v];
+                  w.idx.remove(v);
+                  w.state[vc] = -1;
+                  w.tabu[vc] = move + m_tenure;
+                }
+
+              if (w.idx.add(cand))
+                w.state[c] = std::find(m_rots[c].begin(), m_rots[c].end(),
+                                       cand) - m_rots[c].begin();
+
+              fill(w, move);
+
+              if (w.idx.size() > local_best)
+                {
+                  local_best = w.idx.size();
+                  code_of(w, code);
+                  publish(code, id);
+                }
+            }
+        }
+    }
+
+public:
+  /* m is alphabet size, n is word length */
+  LocalSearch (int m, int n) : m_m(m), m_n(n), m_best(nullptr),
+                               m_stop(false)
+    {
+      PrimeGen pg(m, n);
+      CfIndex idx(m, n);
+      uint32_t total = 1;
+
+      for (int i = 0; i != n; ++i)
+        total *= m;
+      m_class.assign(total, -1);
+
+      for (const vector<int> &x : pg.range())
+        {
+          vector<uint32_t> rots;
+          uint32_t w = idx.pack(x);
+          for (int r = 0; r != n; ++r)
+            {
+              rots.push_back(w);
+              m_class[w] = m_rots.size();
+              w = idx.rotate(w);
+            }
+          m_rots.push_back(rots);
+        }
+    }
+
+  ~LocalSearch ()
+    {
+      for (Snapshot *s : m_retired)
+        delete s;
+      delete m_best.load();
+    }
+
+  /* moves per restart, initial temperature, cooling factor per move and
+     tabu tenure in moves */
+  void set_schedule (uint64_t moves, double temp, double cooling,
+                     unsigned tenure)
+    {
+      m_moves = moves;
+      m_temp = temp;
+      m_cooling = cooling;
+      m_tenure = tenure;
+    }
+
+  size_t classes () const { return m_rots.size(); }
+
+  /* current best, nullptr before first publication; valid until
+     LocalSearch is destroyed */
+  const Snapshot *best () const { return m_best.load(); }
+
+  /* runs nthreads workers for given time, on_tick(best) is called from
+     calling thread every tick; stops early if code reaches target size */
+  template <typename F> void
+  run (unsigned nthreads, double seconds, uint64_t seed, size_t target,
+       double tick, F on_tick)
+    {
+      vector<std::thread> threads;
+      m_start = clock::now();
+      m_stop = false;
+
+      for (unsigned t = 0; t != nthreads; ++t)
+        threads.emplace_back(&LocalSearch::worker, this, t,
+                             seed + 0x9e3779b97f4a7c15ull * (t + 1));
+
+      for (;;)
+        {
+          std::this_thread::sleep_for(std::chrono::duration<double>(tick));
+          double elapsed =
+            std::chrono::duration<double>(clock::now() - m_start).count();
+          const Snapshot *b = best();
+          on_tick(elapsed, b);
+          if ((elapsed >= seconds) || (b && b->code.size() >= target))
+            break;
+        }
+
+      m_stop = true;
+      for (auto &t : threads)
+        t.join();
+    }
+
+  void unpack (uint32_t w, vector<int> &x) const
+    {
+      x.resize(m_n);
+      for (int i = m_n - 1; i >= 0; --i)
+        {
+          x[i] = w % m_m;
+          w /= m_m;
+        }
+    }
+};
+
+#endif
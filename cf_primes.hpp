@@ -0,0 +1,136 @@
+//===------- cf_primes.hpp -- Eastman code words of all prime words -------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains definition and implementation of EastmanPrimeGen
+// class: PrimeGen fused with Eastman's algorithm, every prime word of odd
+// length comes out as rotation do_eastman chooses for it (code word of
+// Eastman code, as cf_gen | eastman gives), in PrimeGen order
+//
+// Consecutive prime words of algorithm F share prefix (PrimeGen::changed
+// tells how long), and phases of Eastman's algorithm are local (see
+// cf_sliding.hpp): basins, retained points and later phases over prefix
+// depend on prefix only. So word is kept as stream of SlidingEastman with
+// mark after every letter; next word rewinds stream to mark of common
+// prefix and pushes only letters after it, and shift of stream as cyclic
+// window is shift of word. Per word it is few letters (algorithm F is
+// constant amortized time) and about constant number of comparisons per
+// phase, instead of O(n) comparisons of do_eastman from scratch
+//
+// Shift is found when word is asked for, so shards which skip words pay
+// for letters only
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_PRIMES_GUARD_
+#define CF_PRIMES_GUARD_
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cassert>
+
+#include "tuples.hpp"
+#include "cf_sliding.hpp"
+
+class EastmanPrimeGen
+{
+  PrimeGen m_pg;
+  SlidingEastman m_se;
+  std::vector<SlidingEastman::Mark> m_marks;  /* [c] after c letters */
+  size_t m_n, m_valid;                        /* marks of current word */
+  int m_shift;
+  std::vector<int> m_word;
+
+  /* stream follows prime word of m_pg */
+  void follow ()
+    {
+      const std::vector<int> &w = m_pg.current();
+      size_t c = std::min<size_t>(m_pg.changed(), m_valid);
+
+      m_se.truncate(m_marks[c]);
+      for (; c != m_n; ++c)
+        {
+          m_se.push(w[c]);
+          m_se.mark(m_marks[c + 1]);
+        }
+      m_valid = m_n;
+      m_shift = -1;
+    }
+
+public:
+  /* words of length n (odd) over [0 .. m) */
+  EastmanPrimeGen (int m, int n) :
+    m_pg(m, n), m_se(n), m_marks(n + 1), m_n(n), m_valid(0), m_shift(-1),
+    m_word(n)
+    {
+    }
+
+  /* moves to next prime word, false if there is none */
+  bool advance ()
+    {
+      if (!m_pg.advance())
+        return false;
+      follow ();
+      return true;
+    }
+
+  bool get_next (std::vector<int> &out)
+    {
+      CF_ALLOC_SCOPE("EastmanPrimeGen::get_next");
+
+      if (!advance())
+        return false;
+      const std::vector<int> &w = current();
+      assert (out.size() == w.size());
+      std::copy(w.begin(), w.end(), out.begin());
+      return true;
+    }
+
+  /* prime word found by last advance (least rotation) */
+  const std::vector<int> &prime () const { return m_pg.current(); }
+
+  /* its rotation by shift, as do_eastman chooses */
+  int shift ()
+    {
+      if (m_shift < 0)
+        {
+          m_shift = m_se.shift();
+          if (m_shift < 0)
+            throw std::runtime_error("EastmanPrimeGen: word is cyclic");
+        }
+      return m_shift;
+    }
+
+  /* code word: prime word rotated by shift */
+  const std::vector<int> &current ()
+    {
+      const std::vector<int> &w = m_pg.current();
+      size_t s = shift();
+      std::copy(w.begin() + s, w.end(), m_word.begin());
+      std::copy(w.begin(), w.begin() + s, m_word.begin() + (m_n - s));
+      return m_word;
+    }
+
+  WordRange<EastmanPrimeGen> range ()
+    {
+      bool any = advance();
+      return WordRange<EastmanPrimeGen>(
+        WordIterator<EastmanPrimeGen>(this, any ? ~uint64_t(0) : 0));
+    }
+
+  /* as PrimeGen, stream is built again from restored word */
+  std::vector<int> state () const { return m_pg.state(); }
+
+  void restore (const std::vector<int> &st)
+    {
+      m_pg.restore(st);
+      m_valid = 0;
+      m_shift = -1;
+    }
+};
+
+#endif
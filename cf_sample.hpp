@@ -0,0 +1,276 @@
+//===------- cf_sample.hpp -- Monte Carlo estimate of accepted routes -----===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains definition and implementation of RouteSampler class
+// which estimates fraction of comma-free routes (class i -> rotation r_i,
+// see cf_all_paths) when k^N routes can not be walked
+//
+// Two estimators:
+//
+// - uniform: every r_i is uniform, route is checked class by class and
+//   dropped at first conflict; fraction is binomial, confidence interval
+//   is Wilson score interval, sane for fractions close to 0
+// - importance (Knuth's estimator of tree size): class i gets rotation
+//   uniform among f_i rotations which keep code comma-free, sample has
+//   weight prod (f_i / k), zero if some f_i = 0. Mean weight is unbiased
+//   estimate of fraction, interval is normal one by sample variance. Tiny
+//   fractions are reached much faster than by uniform samples
+//
+// Weights are long double, so fractions down to about 1e-4900 do not
+// underflow. Routes are checked in CfIndex (m^n up to 2^26), every worker
+// has its own index and random generator (seed + worker), sums are merged
+// into shared ones after every batch
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_SAMPLE_GUARD_
+#define CF_SAMPLE_GUARD_
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#include "cf_index.hpp"
+
+using std::vector;
+
+/* current estimate of accepted fraction and its confidence interval */
+struct SampleEstimate
+{
+  uint64_t samples = 0;
+  long double fraction = 0, lo = 0, hi = 1;
+
+  /* half width of interval relative to estimate, infinite if it is 0 */
+  double rel_error () const
+    {
+      if (fraction <= 0)
+        return HUGE_VAL;
+      return double((hi - lo) / 2 / fraction);
+    }
+};
+
+class RouteSampler
+{
+  enum { batch = 256 };
+
+  int m_m, m_n;
+  bool m_importance;
+  vector< vector<uint32_t> > m_rots;    /* class -> rotation -> packed */
+  double m_z;
+
+  std::mutex m_mut;
+  uint64_t m_samples, m_hits;
+  long double m_sum, m_sum2;
+  std::atomic<bool> m_stop;
+
+  /* one sample: weight for importance, 0 or 1 for uniform */
+  long double sample (CfIndex &idx, std::mt19937_64 &rng,
+                      vector<uint32_t> &added, vector<uint32_t> &feas)
+    {
+      long double w = 1;
+      size_t i;
+
+      added.clear();
+      for (i = 0; i != m_rots.size(); ++i)
+        {
+          const vector<uint32_t> &rots = m_rots[i];
+          uint32_t x;
+
+          if (m_importance)
+            {
+              feas.clear();
+              for (uint32_t r : rots)
+                if (idx.can_add(r))
+                  feas.push_back(r);
+              if (feas.empty())
+                {
+                  w = 0;
+                  break;
+                }
+              w *= (long double)feas.size() / rots.size();
+              x = feas[rng() % feas.size()];
+            }
+          else
+            x = rots[rng() % rots.size()];
+
+          if (!idx.add(x))
+            {
+              w = 0;
+              break;
+            }
+          added.push_back(x);
+        }
+
+      for (uint32_t x : added)
+        idx.remove(x);
+      return w;
+    }
+
+  void worker (uint64_t seed, uint64_t max_samples)
+    {
+      CfIndex idx(m_m, m_n);
+      std::mt19937_64 rng(seed);
+      vector<uint32_t> added, feas;
+
+      while (!m_stop)
+        {
+          uint64_t hits = 0;
+          long double sum = 0, sum2 = 0;
+
+          for (int s = 0; s != batch; ++s)
+            {
+              long double w = sample(idx, rng, added, feas);
+              hits += (w > 0);
+              sum += w;
+              sum2 += w * w;
+            }
+
+          std::lock_guard<std::mutex> lock(m_mut);
+          m_samples += batch;
+          m_hits += hits;
+          m_sum += sum;
+          m_sum2 += sum2;
+          if (m_samples >= max_samples)
+            m_stop = true;
+        }
+    }
+
+public:
+  /* classes are words of equal length n, rotation r is left cyclic shift
+     by r letters; confidence is two-sided level, like 0.95 */
+  RouteSampler (const vector< vector<int> > &classes, bool importance,
+                double confidence = 0.95) :
+    m_m(2), m_n(0), m_importance(importance), m_z(0),
+    m_samples(0), m_hits(0), m_sum(0), m_sum2(0), m_stop(false)
+    {
+      if (classes.empty())
+        throw std::runtime_error("RouteSampler: no classes");
+
+      m_n = classes[0].size();
+      for (const auto &c : classes)
+        {
+          if (c.size() != size_t(m_n))
+            throw std::runtime_error("RouteSampler: words of different size");
+          for (int x : c)
+            {
+              if (x < 0)
+                throw std::runtime_error("RouteSampler: negative letter");
+              m_m = std::max(m_m, x + 1);
+            }
+        }
+
+      CfIndex idx(m_m, m_n);
+      for (const auto &c : classes)
+        {
+          vector<uint32_t> rots;
+          uint32_t w = idx.pack(c);
+          for (int r = 0; r != m_n; ++r, w = idx.rotate(w))
+            rots.push_back(w);
+          m_rots.push_back(rots);
+        }
+
+      /* two-sided normal quantile by bisection of erfc */
+      double lo = 0, hi = 40, alpha = 1 - confidence;
+      for (int it = 0; it != 100; ++it)
+        {
+          double mid = (lo + hi) / 2;
+          if (std::erfc(mid / std::sqrt(2.0)) > alpha)
+            lo = mid;
+          else
+            hi = mid;
+        }
+      m_z = lo;
+    }
+
+  /* log10 of number of all routes */
+  double log10_routes () const { return m_rots.size() * std::log10(m_n); }
+
+  SampleEstimate estimate ()
+    {
+      SampleEstimate e;
+      std::lock_guard<std::mutex> lock(m_mut);
+      long double s = m_samples, z = m_z;
+
+      e.samples = m_samples;
+      if (m_samples == 0)
+        return e;
+
+      if (!m_importance)
+        {
+          /* Wilson score interval */
+          long double p = m_hits / s, z2 = z * z;
+          long double c = (p + z2 / (2 * s)) / (1 + z2 / s);
+          long double h = z * std::sqrt(p * (1 - p) / s + z2 / (4 * s * s))
+                          / (1 + z2 / s);
+          e.fraction = p;
+          e.lo = (m_hits == 0) ? 0 : std::max((long double)0, c - h);
+          e.hi = std::min((long double)1, c + h);
+          return e;
+        }
+
+      long double mean = m_sum / s;
+      long double var = (m_samples > 1)
+        ? std::max((long double)0, (m_sum2 - s * mean * mean) / (s - 1))
+        : mean * mean;
+      long double h = z * std::sqrt(var / s);
+      e.fraction = mean;
+      e.lo = std::max((long double)0, mean - h);
+      e.hi = std::min((long double)1, mean + h);
+      return e;
+    }
+
+  /* samples on nthreads workers until relative error of estimate is at
+     most target, time is out or max_samples are drawn; on_tick(elapsed,
+     estimate) is called from calling thread every tick */
+  template <typename F> SampleEstimate
+  run (unsigned nthreads, double seconds, double target, uint64_t max_samples,
+       uint64_t seed, double tick, F on_tick)
+    {
+      typedef std::chrono::steady_clock clock;
+      vector<std::thread> threads;
+      clock::time_point start = clock::now();
+
+      m_stop = false;
+      for (unsigned t = 0; t != nthreads; ++t)
+        threads.emplace_back(&RouteSampler::worker, this,
+                             seed + 0x9e3779b97f4a7c15ull * (t + 1),
+                             max_samples);
+
+      for (;;)
+        {
+          double left = seconds -
+            std::chrono::duration<double>(clock::now() - start).count();
+          std::this_thread::sleep_for(std::chrono::duration<double>(
+            std::max(0.0, std::min(tick, left))));
+
+          double elapsed =
+            std::chrono::duration<double>(clock::now() - start).count();
+          SampleEstimate e = estimate();
+          on_tick(elapsed, e);
+
+          /* interval is not trusted before some samples */
+          if (m_stop || (elapsed >= seconds)
+              || ((e.samples >= 1000) && (e.rel_error() <= target)))
+            break;
+        }
+
+      m_stop = true;
+      for (auto &t : threads)
+        t.join();
+
+      return estimate();
+    }
+};
+
+#endif
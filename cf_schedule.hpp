@@ -0,0 +1,393 @@
+//===------- cf_schedule.hpp -- length-bucketed Eastman batch scheduler ---===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains definition and implementation of EastmanScheduler
+// class: shifts of stream of words of mixed odd lengths, as do_eastman
+// gives them, in order of arrival
+//
+// Words of different lengths in arrival order keep lane batches short
+// (do_eastman_batch needs equal lengths) and buffers resized, so words are
+// put into buckets by length instead. Bucket of length n goes to worker
+// threads as one batch when it has about batch_bytes of letters (cache
+// sized, 4096 words at most) or when its oldest word waited max_delay
+// seconds, whatever comes first; batch is run by do_eastman_batch, which
+// takes SIMD lane kernel for n <= 31 and do_eastman word by word above.
+// If more batches wait than there are workers (or workers share core with
+// caller), add runs oldest of them itself, letters still in cache
+//
+// Results go to sink in order of add, one call at a time (from whichever
+// thread completed prefix of stream), so output of mixed stream is the
+// same as of do_eastman word by word; flush hook follows every run of
+// them, so output is not held longer than words. Words waiting for
+// earlier ones are bounded by max_pending: add waits, and flushes buckets,
+// above it. Exception of kernel or sink is thrown again by next add or
+// finish; add and finish are called from one thread
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_SCHEDULE_GUARD_
+#define CF_SCHEDULE_GUARD_
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <exception>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+#include "cf_eastman.h"
+
+class EastmanScheduler
+{
+public:
+  /* n letters of word and its shift, -1 if it is cyclic */
+  typedef std::function<void (const int *, size_t, int)> Sink;
+  /* called after every run of words passed to sink, say to flush them */
+  typedef std::function<void ()> Flush;
+  typedef std::chrono::steady_clock clock;
+
+private:
+  enum { max_words = 4096 };
+
+  struct Bucket
+  {
+    size_t cap;
+    std::vector<int> letters;
+    std::vector<uint64_t> seqs;
+    clock::time_point first;
+  };
+
+  /* key in m_live, left is number of its words not passed to sink yet */
+  struct Batch
+  {
+    uint64_t id;
+    size_t n, left;
+    std::vector<int> letters, shifts;
+    std::vector<uint64_t> seqs;
+  };
+
+  /* word of stream: its batch once it is run (letters and shift stay
+     there until word is passed to sink), null before */
+  struct Slot
+  {
+    Batch *batch;
+    size_t idx;
+  };
+
+  Sink m_sink;
+  Flush m_flush;
+  clock::duration m_delay;
+  size_t m_batch_bytes, m_max_pending;
+
+  std::mutex m_mut;
+  std::condition_variable m_cv, m_done_cv;
+  std::map<size_t, Bucket> m_buckets;
+  std::map<uint64_t, Batch> m_live;        /* by number, until passed */
+  std::deque<Batch *> m_ready;
+  std::deque<Slot> m_order;                 /* words from m_base on */
+  std::vector<Slot> m_out;                  /* of emitting thread */
+  std::vector<Bucket> m_spare;              /* buffers of passed batches */
+  std::vector<int> m_soa;                   /* of thread calling add */
+  uint64_t m_base, m_batches;
+  bool m_emitting, m_stop;
+  std::exception_ptr m_error;
+  std::vector<std::thread> m_threads;
+
+  size_t capacity (size_t n) const
+    {
+      return std::max<size_t>(1, std::min<size_t>(max_words,
+                                  m_batch_bytes / (n * sizeof(int))));
+    }
+
+  /* bucket becomes batch in worker queue, under m_mut */
+  void release (std::map<size_t, Bucket>::iterator it)
+    {
+      Batch &b = m_live[m_batches];
+      b.id = m_batches++;
+      b.n = it->first;
+      b.letters.swap(it->second.letters);
+      b.seqs.swap(it->second.seqs);
+      b.left = b.seqs.size();
+      m_buckets.erase(it);
+      m_ready.push_back(&b);
+      /* more batches than workers are run by add */
+      if (m_ready.size() <= m_threads.size())
+        m_cv.notify_one();
+    }
+
+  void release_all ()
+    {
+      while (!m_buckets.empty())
+        release (m_buckets.begin());
+      m_cv.notify_all();
+    }
+
+  /* soa is buffer of worker */
+  static void run (Batch &b, std::vector<int> &soa)
+    {
+      size_t n = b.n, w = b.seqs.size(), l, p;
+      soa.resize(n * w);
+      b.shifts.resize(w);
+      for (l = 0; l != w; ++l)
+        for (p = 0; p != n; ++p)
+          soa[p * w + l] = b.letters[l * n + p];
+      do_eastman_batch (soa.data(), n, w, b.shifts.data());
+    }
+
+  /* passes done prefix of m_order to sink, one thread at a time; lock
+     holds m_mut and is released around sink calls */
+  void emit (std::unique_lock<std::mutex> &lock)
+    {
+      if (m_emitting)
+        return;
+      m_emitting = true;
+      try
+        {
+          while (!m_error && !m_order.empty() && m_order.front().batch)
+            {
+              m_out.clear();
+              while (!m_order.empty() && m_order.front().batch)
+                {
+                  m_out.push_back(m_order.front());
+                  m_order.pop_front();
+                  m_base += 1;
+                }
+              lock.unlock();
+              for (const Slot &s : m_out)
+                {
+                  const Batch &b = *s.batch;
+                  m_sink(&b.letters[s.idx * b.n], b.n, b.shifts[s.idx]);
+                }
+              if (m_flush)
+                m_flush();
+              lock.lock();
+              for (const Slot &s : m_out)
+                if (--s.batch->left == 0)
+                  {
+                    /* buffers are reused by next buckets */
+                    m_spare.push_back(Bucket());
+                    m_spare.back().letters.swap(s.batch->letters);
+                    m_spare.back().seqs.swap(s.batch->seqs);
+                    m_live.erase(s.batch->id);
+                  }
+              m_done_cv.notify_all();
+            }
+        }
+      catch (...)
+        {
+          if (!lock.owns_lock())
+            lock.lock();
+          if (!m_error)
+            m_error = std::current_exception();
+        }
+      m_emitting = false;
+      m_done_cv.notify_all();
+    }
+
+  /* runs b taken from m_ready and passes what is done, lock holds
+     m_mut and is released while batch runs */
+  void process (std::unique_lock<std::mutex> &lock, Batch *b,
+                std::vector<int> &soa)
+    {
+      lock.unlock();
+      try
+        {
+          run (*b, soa);
+        }
+      catch (...)
+        {
+          lock.lock();
+          if (!m_error)
+            m_error = std::current_exception();
+          m_done_cv.notify_all();
+          return;
+        }
+      lock.lock();
+      for (size_t l = 0; l != b->seqs.size(); ++l)
+        {
+          Slot &s = m_order[b->seqs[l] - m_base];
+          s.batch = b;
+          s.idx = l;
+        }
+      emit (lock);
+    }
+
+  void worker ()
+    {
+      std::vector<int> soa;
+      std::unique_lock<std::mutex> lock(m_mut);
+      for (;;)
+        {
+          if (!m_ready.empty())
+            {
+              Batch *b = m_ready.front();
+              m_ready.pop_front();
+              process (lock, b, soa);
+              continue;
+            }
+
+          if (m_stop)
+            return;
+
+          /* bucket whose oldest word waits longest */
+          auto due = m_buckets.end();
+          for (auto it = m_buckets.begin(); it != m_buckets.end(); ++it)
+            if ((due == m_buckets.end())
+                || (it->second.first < due->second.first))
+              due = it;
+
+          if (due == m_buckets.end())
+            m_cv.wait(lock);
+          else if (clock::now() >= due->second.first + m_delay)
+            release (due);
+          else
+            m_cv.wait_until(lock, due->second.first + m_delay);
+        }
+    }
+
+  void rethrow ()
+    {
+      if (m_error)
+        std::rethrow_exception(m_error);
+    }
+
+public:
+  /* threads workers (at least one); words wait max_delay seconds at most
+     for their batch */
+  explicit EastmanScheduler (Sink sink, unsigned threads = 0,
+                             double max_delay = 0.01,
+                             size_t batch_bytes = size_t(1) << 15,
+                             size_t max_pending = size_t(1) << 20) :
+    m_sink(std::move(sink)),
+    m_delay(std::chrono::duration_cast<clock::duration>(
+              std::chrono::duration<double>(max_delay))),
+    m_batch_bytes(batch_bytes),
+    m_max_pending(std::max<size_t>(1, max_pending)),
+    m_base(0), m_batches(0), m_emitting(false), m_stop(false)
+    {
+      if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+      for (unsigned t = 0; t != threads; ++t)
+        m_threads.emplace_back(&EastmanScheduler::worker, this);
+    }
+
+  EastmanScheduler (const EastmanScheduler &) = delete;
+  EastmanScheduler &operator= (const EastmanScheduler &) = delete;
+
+  /* words still queued are dropped, call finish to get them */
+  ~EastmanScheduler ()
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_mut);
+        m_stop = true;
+        m_ready.clear();
+        m_cv.notify_all();
+      }
+      for (auto &th : m_threads)
+        th.join();
+    }
+
+  /* word of odd length n > 1 */
+  void add (const int *word, size_t n)
+    {
+      if ((n < 3) || (n % 2 == 0))
+        throw std::runtime_error("Word length shall be odd and > 1");
+
+      std::unique_lock<std::mutex> lock(m_mut);
+      rethrow ();
+      if (m_order.size() >= m_max_pending)
+        {
+          release_all ();
+          m_done_cv.wait(lock, [this] {
+            return m_error || (m_order.size() < m_max_pending);
+          });
+          rethrow ();
+        }
+
+      m_order.push_back(Slot());
+
+      auto it = m_buckets.find(n);
+      if (it == m_buckets.end())
+        {
+          it = m_buckets.emplace(n, Bucket()).first;
+          if (!m_spare.empty())
+            {
+              it->second.letters.swap(m_spare.back().letters);
+              it->second.seqs.swap(m_spare.back().seqs);
+              it->second.letters.clear();
+              it->second.seqs.clear();
+              m_spare.pop_back();
+            }
+          it->second.first = clock::now();
+          it->second.cap = capacity(n);
+          it->second.letters.reserve(it->second.cap * n);
+          it->second.seqs.reserve(it->second.cap);
+          /* first deadline, later ones come after it */
+          if (m_buckets.size() == 1)
+            m_cv.notify_one();
+        }
+      Bucket &b = it->second;
+      b.letters.insert(b.letters.end(), word, word + n);
+      b.seqs.push_back(m_base + m_order.size() - 1);
+      if (b.seqs.size() < b.cap)
+        return;
+
+      /* workers are behind (or share core): oldest batches are run here,
+         while their letters are in cache */
+      release (it);
+      while (m_ready.size() > m_threads.size())
+        {
+          Batch *r = m_ready.front();
+          m_ready.pop_front();
+          process (lock, r, m_soa);
+          rethrow ();
+        }
+    }
+
+  void add (const std::vector<int> &word) { add (word.data(), word.size()); }
+
+  void set_flush (Flush flush)
+    {
+      std::lock_guard<std::mutex> lock(m_mut);
+      m_flush = std::move(flush);
+    }
+
+  /* runs all buckets now and waits until sink got every word */
+  void finish ()
+    {
+      std::unique_lock<std::mutex> lock(m_mut);
+      release_all ();
+      m_done_cv.wait(lock, [this] {
+        return m_error || (m_order.empty() && !m_emitting);
+      });
+      rethrow ();
+    }
+
+  /* words added and batches run so far */
+  uint64_t words ()
+    {
+      std::lock_guard<std::mutex> lock(m_mut);
+      return m_base + m_order.size();
+    }
+
+  uint64_t batches ()
+    {
+      std::lock_guard<std::mutex> lock(m_mut);
+      return m_batches;
+    }
+
+  /* words in full batch of length n */
+  size_t batch_words (size_t n) const { return capacity(n); }
+};
+
+#endif
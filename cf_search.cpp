@@ -0,0 +1,128 @@
+//===-- cf_search.cpp -- exact maximum comma-free code search ------------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains an executable programm which finds maximum comma-free
+// code for alphabet [0 .. m) and words of length n, like:
+//
+// ./cf_search 2 4
+// 0 0 0 1
+// 0 0 1 1
+// 0 1 1 1
+// size 3 of 3 classes, maximum, nodes 4, symmetries 4
+//
+// one word per line (ready for cf_check), then summary. Options:
+//
+// --limit N     stop after N search nodes (result is then just best found)
+// --target K    stop when code of size K is found
+// --progress N  report nodes and best size to stderr every N nodes
+// --no-symmetry do not skip branches symmetric under alphabet permutations
+//               and reversal
+//
+// see cf_search.hpp for search details
+//
+//===----------------------------------------------------------------------===//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "cf_search.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::vector;
+
+struct Options
+{
+  int m = 0, n = 0;
+  uint64_t limit = 0, progress = 0;
+  size_t target = ~size_t(0);
+  bool symmetry = true;
+};
+
+void process_command_line (int argc, char **argv, Options &opts);
+
+int
+main (int argc, char **argv)
+{
+  Options opts;
+  vector< vector<int> > best;
+
+  process_command_line (argc, argv, opts);
+
+  CfSearch s(opts.m, opts.n);
+  s.set_node_limit (opts.limit);
+  s.set_target (opts.target);
+  s.set_report (opts.progress);
+  s.set_symmetry (opts.symmetry);
+
+  size_t res = s.run ();
+  s.get_best (best);
+
+  for (const auto &w : best)
+    {
+      for (auto c : w)
+        cout << c << " ";
+      cout << endl;
+    }
+
+  cout << "size " << res << " of " << s.classes() << " classes, "
+       << (s.stopped() ? "stopped" : "maximum") << ", nodes " << s.nodes()
+       << ", symmetries " << s.symmetries() << endl;
+
+  return 0;
+}
+
+void
+process_command_line (int argc, char **argv, Options &opts)
+{
+  int idx, npos = 0;
+
+  for (idx = 1; idx < argc; ++idx)
+    {
+      std::string arg = argv[idx];
+      bool has_val = (idx + 1 < argc);
+
+      if (arg == "--limit" && has_val)
+        opts.limit = std::strtoull(argv[++idx], nullptr, 10);
+      else if (arg == "--target" && has_val)
+        opts.target = std::strtoull(argv[++idx], nullptr, 10);
+      else if (arg == "--progress" && has_val)
+        opts.progress = std::strtoull(argv[++idx], nullptr, 10);
+      else if (arg == "--no-symmetry")
+        opts.symmetry = false;
+      else if (npos == 0)
+        {
+          opts.m = atoi (argv[idx]);
+          npos += 1;
+        }
+      else if (npos == 1)
+        {
+          opts.n = atoi (argv[idx]);
+          npos += 1;
+        }
+      else
+        npos += 1;
+    }
+
+  if (npos != 2)
+    {
+      cerr << "usage: \"" << argv[0] << " [--limit N] [--target K]"
+              " [--progress N] [--no-symmetry] m n\" where m is alphabet"
+              " delimiter [0 .. m) and n is word length" << endl;
+      throw std::runtime_error("incorrect command line");
+    }
+
+  if ((opts.m <= 1) || (opts.n <= 1))
+    {
+      cerr << "Both m and n shall be > 1" << endl;
+      throw std::runtime_error("incorrect command line");
+    }
+}
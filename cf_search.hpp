@@ -0,0 +1,243 @@
+//===------- cf_search.hpp -- exact maximum comma-free code search --------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains definition and implementation of CfSearch class
+// which finds maximum comma-free code over [0 .. m) alphabet with words of
+// length n by backtracking in spirit of Knuth's commafree programs
+//
+// Every prime class (PrimeGen output) either gets one of its n rotations
+// into code or is excluded. Code so far is kept in CfIndex, so every
+// candidate rotation is checked incrementally. On every node:
+//
+// - rotation is "live" if it might be added to current code; set of live
+//   rotations only shrinks down the tree, class without live rotations is
+//   excluded for whole subtree
+// - bound: code size + number of classes with live rotations shall beat
+//   best code found so far
+// - branching class is one with fewest live rotations (dynamic ordering),
+//   rotations are tried first and exclusion last
+// - symmetry breaking: node keeps symmetries of alphabet permutation and
+//   reversal group (see cf_symmetry.hpp) fixing every decision so far;
+//   rotations of branching class equivalent under them give isomorphic
+//   subtrees, so only least rotation of every orbit is tried
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_SEARCH_GUARD_
+#define CF_SEARCH_GUARD_
+
+#include <vector>
+#include <cstdint>
+#include <iostream>
+
+#include "tuples.hpp"
+#include "cf_index.hpp"
+#include "cf_symmetry.hpp"
+
+using std::vector;
+
+class CfSearch
+{
+  enum { unassigned = -2, excluded = -1 };
+
+  CfIndex m_idx;
+  vector< vector<uint32_t> > m_rots;  /* class -> its rotations */
+  vector<int> m_state;                /* class -> rotation or state */
+  vector<uint32_t> m_code, m_best;
+  ClassSymmetry *m_sym;
+  uint64_t m_nodes, m_limit, m_report;
+  size_t m_target;
+  bool m_stopped;
+
+  /* symmetries of h fixing class c and, if r >= 0, its rotation r */
+  void fix (const vector<uint32_t> &h, size_t c, int r,
+            vector<uint32_t> &res) const
+    {
+      res.clear();
+      for (uint32_t g : h)
+        if ((m_sym->image_class(g, c) == int(c))
+            && ((r < 0) || (m_sym->image_rotation(g, c, r) == r)))
+          res.push_back(g);
+    }
+
+  /* true if some symmetry of h fixing c maps rotation r to smaller one */
+  bool redundant (const vector<uint32_t> &h, size_t c, size_t r) const
+    {
+      for (uint32_t g : h)
+        if ((m_sym->image_class(g, c) == int(c))
+            && (size_t(m_sym->image_rotation(g, c, r)) < r))
+          return true;
+      return false;
+    }
+
+  /* h is list of non-identity symmetries fixing all decisions */
+  void dfs (const vector<uint32_t> &h)
+    {
+      size_t c, nclasses = m_rots.size(), nlive = 0, best_cls = nclasses;
+      size_t best_cnt = ~size_t(0), r, n = m_idx.length();
+      vector<size_t> dropped;
+      vector<uint32_t> sub;
+
+      m_nodes += 1;
+      if (m_report && (m_nodes % m_report) == 0)
+        std::cerr << "nodes " << m_nodes << " best " << m_best.size()
+                  << std::endl;
+
+      if ((m_limit && m_nodes >= m_limit) || (m_best.size() >= m_target))
+        {
+          m_stopped = true;
+          return;
+        }
+
+      /* collect live rotations, excluding dead classes for subtree */
+      for (c = 0; c != nclasses; ++c)
+        {
+          if (m_state[c] != unassigned)
+            continue;
+
+          size_t cnt = 0;
+          for (uint32_t w : m_rots[c])
+            if (m_idx.can_add(w))
+              cnt += 1;
+
+          if (cnt == 0)
+            {
+              m_state[c] = excluded;
+              dropped.push_back(c);
+              continue;
+            }
+
+          nlive += 1;
+          if (cnt < best_cnt)
+            {
+              best_cnt = cnt;
+              best_cls = c;
+            }
+        }
+
+      if (m_code.size() > m_best.size())
+        m_best = m_code;
+
+      if ((nlive > 0) && (m_code.size() + nlive > m_best.size()))
+        {
+          c = best_cls;
+
+          for (r = 0; r != n && !m_stopped; ++r)
+            {
+              uint32_t w = m_rots[c][r];
+              if (redundant (h, c, r) || !m_idx.add(w))
+                continue;
+              m_code.push_back(w);
+              m_state[c] = r;
+              fix (h, c, r, sub);
+              dfs (sub);
+              m_state[c] = unassigned;
+              m_code.pop_back();
+              m_idx.remove(w);
+            }
+
+          /* exclusion makes sense only if bound still allows better code */
+          if (!m_stopped && (m_code.size() + nlive - 1 > m_best.size()))
+            {
+              m_state[c] = excluded;
+              fix (h, c, -1, sub);
+              dfs (sub);
+              m_state[c] = unassigned;
+            }
+        }
+
+      for (size_t d : dropped)
+        m_state[d] = unassigned;
+    }
+
+public:
+  /* m is alphabet size, n is word length */
+  CfSearch (int m, int n) : m_idx(m, n), m_sym(nullptr), m_nodes(0),
+                            m_limit(0),
+                            m_report(0), m_target(~size_t(0)),
+                            m_stopped(false)
+    {
+      PrimeGen pg(m, n);
+
+      for (const vector<int> &x : pg.range())
+        {
+          vector<uint32_t> rots;
+          uint32_t w = m_idx.pack(x);
+          for (int r = 0; r != n; ++r)
+            {
+              rots.push_back(w);
+              w = m_idx.rotate(w);
+            }
+          m_rots.push_back(rots);
+        }
+
+      m_state.assign(m_rots.size(), unassigned);
+    }
+
+  ~CfSearch () { delete m_sym; }
+
+  CfSearch (const CfSearch &) = delete;
+  CfSearch &operator= (const CfSearch &) = delete;
+
+  /* enables symmetry breaking; every symmetry keeps table of
+     classes * n rotations, alphabet permutations are used only if all
+     tables fit into budget entries, otherwise just reversal */
+  void set_symmetry (bool on, size_t budget = (1u << 24))
+    {
+      delete m_sym;
+      m_sym = nullptr;
+      if (!on)
+        return;
+
+      size_t words = m_rots.size() * m_idx.length(), group = 2, l;
+      for (l = 2; (l <= size_t(m_idx.alphabet())) && (group <= budget); ++l)
+        group *= l;
+      if (2 * words > budget)
+        return;
+
+      vector< vector<int> > cls(m_rots.size());
+      for (size_t c = 0; c != m_rots.size(); ++c)
+        m_idx.unpack(m_rots[c][0], cls[c]);
+      m_sym = new ClassSymmetry(cls, (group * words <= budget)
+                                       ? m_idx.alphabet() : 0);
+    }
+
+  /* number of symmetries used, 1 if symmetry breaking is off */
+  size_t symmetries () const { return m_sym ? m_sym->size() : 1; }
+
+  /* stop after given number of nodes, 0 means no limit */
+  void set_node_limit (uint64_t limit) { m_limit = limit; }
+
+  /* stop as soon as code of given size found */
+  void set_target (size_t target) { m_target = target; }
+
+  /* report progress to stderr every given number of nodes */
+  void set_report (uint64_t every) { m_report = every; }
+
+  /* returns size of best code, it is maximum if !stopped() */
+  size_t run ()
+    {
+      vector<uint32_t> h;
+      for (size_t g = 1; g < symmetries(); ++g)
+        h.push_back(g);
+      dfs (h);
+      return m_best.size();
+    }
+
+  size_t classes () const { return m_rots.size(); }
+  uint64_t nodes () const { return m_nodes; }
+  bool stopped () const { return m_stopped; }
+
+  void get_best (vector< vector<int> > &out) const
+    {
+      out.resize(m_best.size());
+      for (size_t i = 0; i != m_best.size(); ++i)
+        m_idx.unpack(m_best[i], out[i]);
+    }
+};
+
+#endif
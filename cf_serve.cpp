@@ -0,0 +1,307 @@
+//===-- cf_serve.cpp -- dictionary and Eastman service daemon -------------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains an executable programm which serves requests of
+// cf_serve.hpp protocol, so callers do not pay process start and
+// dictionary rebuild per request:
+//
+// ./cf_serve --socket /tmp/cf.sock &
+// ./cf_client --socket /tmp/cf.sock < requests.txt
+//
+// without --socket one client is served on stdin / stdout, until stdin is
+// closed (like ./cf_client --exec ./cf_serve does). With --socket any
+// number of clients connect to unix socket and share named dictionaries,
+// daemon runs until SIGINT / SIGTERM and removes socket then
+//
+// Single thread serves all connections by poll: all complete requests
+// read from connection are answered in one batch, responses are written
+// by one write when socket accepts them. Client which does not read its
+// responses is not read from, while more than --backlog MB of them wait
+//
+//===----------------------------------------------------------------------===//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "cf_serve.hpp"
+
+using std::cerr;
+using std::endl;
+
+struct Options
+{
+  string socket;
+  size_t backlog = 64;    /* MB of unsent responses per connection */
+};
+
+void process_command_line (int argc, char **argv, Options &opts);
+
+static volatile std::sig_atomic_t stop_flag = 0;
+
+static void
+stop_handler (int)
+{
+  stop_flag = 1;
+}
+
+/* one client: requests are read from in, responses written to out */
+struct Connection
+{
+  int in, out;
+  string inbuf, outbuf;
+  size_t sent = 0;
+  bool eof = false;
+
+  Connection (int i, int o) : in(i), out(o) {}
+};
+
+static void
+set_nonblocking (int fd)
+{
+  int fl = fcntl(fd, F_GETFL);
+  if ((fl < 0) || (fcntl(fd, F_SETFL, fl | O_NONBLOCK) < 0))
+    throw std::runtime_error(string("fcntl: ") + std::strerror(errno));
+}
+
+/* reads what is available, answers complete requests; false if
+   connection is broken */
+static bool
+serve_input (Connection &c, CfService &svc)
+{
+  char buf[1 << 16];
+
+  for (;;)
+    {
+      ssize_t got = read(c.in, buf, sizeof(buf));
+      if (got > 0)
+        {
+          c.inbuf.append(buf, got);
+          if (size_t(got) < sizeof(buf))
+            break;
+          continue;
+        }
+      if (got == 0)
+        c.eof = true;
+      else if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+        return false;
+      break;
+    }
+
+  size_t pos = 0, len;
+  try
+    {
+      while ((len = frame_size(c.inbuf, pos)) != 0)
+        {
+          svc.handle(c.inbuf.data() + pos + 4, len - 4, c.outbuf);
+          pos += len;
+        }
+    }
+  catch (std::runtime_error &e)
+    {
+      cerr << "cf_serve: " << e.what() << ", connection closed" << endl;
+      return false;
+    }
+
+  c.inbuf.erase(0, pos);
+  if (c.eof && !c.inbuf.empty())
+    cerr << "cf_serve: truncated request at end of input" << endl;
+  return true;
+}
+
+/* writes what socket accepts; false if connection is broken */
+static bool
+serve_output (Connection &c)
+{
+  while (c.sent < c.outbuf.size())
+    {
+      ssize_t put = write(c.out, c.outbuf.data() + c.sent,
+                          c.outbuf.size() - c.sent);
+      if (put < 0)
+        {
+          if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+            break;
+          return false;
+        }
+      c.sent += put;
+    }
+
+  if (c.sent == c.outbuf.size())
+    {
+      c.outbuf.clear();
+      c.sent = 0;
+    }
+  return true;
+}
+
+static int
+listen_socket (const string &path)
+{
+  sockaddr_un addr;
+  int fd;
+
+  if (path.size() >= sizeof(addr.sun_path))
+    throw std::runtime_error("Socket path too long: " + path);
+
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  std::strcpy(addr.sun_path, path.c_str());
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    throw std::runtime_error(string("socket: ") + std::strerror(errno));
+
+  /* stale socket of killed daemon is replaced, live one is not */
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0)
+    throw std::runtime_error("Daemon is already running on " + path);
+  unlink(path.c_str());
+
+  if ((bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+      || (listen(fd, 64) < 0))
+    throw std::runtime_error("Can not listen on " + path + ": "
+                             + std::strerror(errno));
+  set_nonblocking (fd);
+  return fd;
+}
+
+int
+main (int argc, char **argv)
+{
+  Options opts;
+  CfService svc;
+  vector< std::unique_ptr<Connection> > conns;
+  int lfd = -1;
+
+  process_command_line (argc, argv, opts);
+
+  struct sigaction sa;
+  std::memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = stop_handler;     /* no SA_RESTART: poll is interrupted */
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+  std::signal(SIGPIPE, SIG_IGN);
+
+  if (opts.socket.empty())
+    {
+      set_nonblocking (0);
+      set_nonblocking (1);
+      conns.emplace_back(new Connection(0, 1));
+    }
+  else
+    lfd = listen_socket (opts.socket);
+
+  size_t backlog = opts.backlog << 20;
+  vector<pollfd> fds;
+
+  while (!stop_flag)
+    {
+      fds.clear();
+      if (lfd >= 0)
+        fds.push_back(pollfd{ lfd, POLLIN, 0 });
+      for (auto &c : conns)
+        {
+          short ev = (c->eof || (c->outbuf.size() > backlog)) ? 0 : POLLIN;
+          fds.push_back(pollfd{ c->in, ev, 0 });
+          fds.push_back(pollfd{ c->out, short(c->outbuf.empty() ? 0 : POLLOUT),
+                                0 });
+        }
+
+      if (poll(fds.data(), fds.size(), -1) < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          throw std::runtime_error(string("poll: ") + std::strerror(errno));
+        }
+
+      size_t base = (lfd >= 0) ? 1 : 0, i, nconns = conns.size();
+      for (i = 0; i != nconns; ++i)
+        {
+          Connection &c = *conns[i];
+          const pollfd &pin = fds[base + 2 * i];
+          bool ok = true;
+
+          if (pin.revents & (POLLIN | POLLHUP | POLLERR))
+            ok = serve_input (c, svc);
+          /* fresh responses are written at once, socket is mostly ready */
+          if (ok && !c.outbuf.empty())
+            ok = serve_output (c);
+
+          /* connection is over when its input ended and all is answered */
+          if (!ok || (c.eof && c.outbuf.empty()))
+            {
+              close(c.in);
+              if (c.out != c.in)
+                close(c.out);
+              conns[i].reset();
+            }
+        }
+
+      conns.erase(std::remove(conns.begin(), conns.end(), nullptr),
+                  conns.end());
+
+      if (lfd < 0)
+        {
+          if (conns.empty())
+            break;
+          continue;
+        }
+
+      if (fds[0].revents & POLLIN)
+        {
+          int fd;
+          while ((fd = accept(lfd, nullptr, nullptr)) >= 0)
+            {
+              set_nonblocking (fd);
+              conns.emplace_back(new Connection(fd, fd));
+            }
+        }
+    }
+
+  if (lfd >= 0)
+    {
+      close(lfd);
+      unlink(opts.socket.c_str());
+    }
+
+  return 0;
+}
+
+void
+process_command_line (int argc, char **argv, Options &opts)
+{
+  int idx;
+
+  for (idx = 1; idx < argc; ++idx)
+    {
+      string arg = argv[idx];
+      bool has_val = (idx + 1 < argc);
+
+      if (arg == "--socket" && has_val)
+        opts.socket = argv[++idx];
+      else if (arg == "--backlog" && has_val)
+        opts.backlog = std::max(1, std::atoi(argv[++idx]));
+      else
+        {
+          cerr << "usage: \"" << argv[0] << " [--socket path] [--backlog MB]\""
+                  ", without --socket serves stdin / stdout" << endl;
+          throw std::runtime_error("incorrect command line");
+        }
+    }
+}
@@ -0,0 +1,354 @@
+//===------- cf_serve.hpp -- dictionary service protocol ------------------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains wire format of cf_serve daemon and CfService class
+// which keeps named dictionaries warm in memory and answers requests
+//
+// Every message is frame: u32 length of body, then body. All integers are
+// little-endian, string is u16 length and bytes, word is its letters as
+// u32. Request body is u32 id, u8 op and arguments, response body is same
+// id, u8 status (0 ok, 1 error) and results, or error message string:
+//
+//   op       arguments                   results
+//   add      name, u32 n, u32 k, k words k x i8 (0 accepted, -1 cyclic,
+//                                        1 conflict), u64 dictionary size
+//   check    same as add                 same as add, nothing is added
+//   eastman  u32 n, word                 u32 shift (see cf_eastman.h)
+//   canon    u32 n, word                 u32 offset, u8 primitive
+//   dump     name                        u32 n, u64 k, k words
+//
+// add creates dictionary name of length n, if there is no such; words of
+// one add are inserted one by one, like lines of cf_check input, but
+// without per-word round trips. Dictionaries are ConcurrentCfdict, so
+// check costs O(n) whatever dictionary size is
+//
+// Client might send any number of requests before reading responses
+// (pipelining), responses of one connection come in request order, id is
+// only echoed back
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_SERVE_GUARD_
+#define CF_SERVE_GUARD_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include "cf_cdict.hpp"
+#include "cf_canon.hpp"
+#include "cf_eastman.h"
+
+using std::vector;
+using std::string;
+
+enum ServeOp : uint8_t
+{
+  op_add = 1,
+  op_check = 2,
+  op_eastman = 3,
+  op_canon = 4,
+  op_dump = 5
+};
+
+enum ServeStatus : uint8_t { status_ok = 0, status_error = 1 };
+
+enum : uint32_t
+{
+  /* frames are refused above this, connection is closed then */
+  max_frame = 1u << 28,
+  /* words are refused above this length */
+  max_word = 1u << 16
+};
+
+/* appends little-endian values to frame body */
+class WireWriter
+{
+  string &m_out;
+  size_t m_start;
+
+public:
+  /* starts frame at the end of out, length is patched by finish */
+  explicit WireWriter (string &out) : m_out(out), m_start(out.size())
+    {
+      u32 (0);
+    }
+
+  void u8 (uint8_t x) { m_out.push_back(char(x)); }
+
+  void u16 (uint16_t x)
+    {
+      u8 (x & 0xff);
+      u8 (x >> 8);
+    }
+
+  void u32 (uint32_t x)
+    {
+      char b[4] = { char(x), char(x >> 8), char(x >> 16), char(x >> 24) };
+      m_out.append(b, 4);
+    }
+
+  void u64 (uint64_t x)
+    {
+      u32 (uint32_t(x));
+      u32 (uint32_t(x >> 32));
+    }
+
+  void str (const string &s)
+    {
+      size_t len = std::min(s.size(), size_t(0xffff));
+      u16 (len);
+      m_out.append(s, 0, len);
+    }
+
+  void word (const int *w, size_t n)
+    {
+      for (size_t i = 0; i != n; ++i)
+        u32 (uint32_t(w[i]));
+    }
+
+  /* patches length of frame */
+  void finish ()
+    {
+      uint32_t len = m_out.size() - m_start - 4;
+      for (int i = 0; i != 4; ++i)
+        m_out[m_start + i] = char(len >> (8 * i));
+    }
+};
+
+/* reads little-endian values of frame body, throws on truncated body */
+class WireReader
+{
+  const unsigned char *m_p, *m_end;
+
+  const unsigned char *take (size_t len)
+    {
+      if (size_t(m_end - m_p) < len)
+        throw std::runtime_error("Truncated request");
+      const unsigned char *p = m_p;
+      m_p += len;
+      return p;
+    }
+
+public:
+  WireReader (const char *body, size_t len) :
+    m_p(reinterpret_cast<const unsigned char *>(body)), m_end(m_p + len) {}
+
+  size_t left () const { return m_end - m_p; }
+
+  /* request shall be parsed completely before it is executed */
+  void end () const
+    {
+      if (m_p != m_end)
+        throw std::runtime_error("Trailing bytes in request");
+    }
+
+  uint8_t u8 () { return *take(1); }
+
+  uint16_t u16 ()
+    {
+      const unsigned char *p = take(2);
+      return p[0] | (p[1] << 8);
+    }
+
+  uint32_t u32 ()
+    {
+      const unsigned char *p = take(4);
+      return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16)
+             | (uint32_t(p[3]) << 24);
+    }
+
+  uint64_t u64 ()
+    {
+      uint64_t lo = u32 ();
+      return lo | (uint64_t(u32 ()) << 32);
+    }
+
+  string str ()
+    {
+      size_t len = u16 ();
+      const unsigned char *p = take(len);
+      return string(reinterpret_cast<const char *>(p), len);
+    }
+
+  /* n letters, every shall be nonnegative int */
+  void word (vector<int> &w, size_t n)
+    {
+      if (left() / 4 < n)
+        throw std::runtime_error("Truncated request");
+      w.resize(n);
+      for (size_t i = 0; i != n; ++i)
+        {
+          uint32_t x = u32 ();
+          if (x > 0x7fffffffu)
+            throw std::runtime_error("Letter out of range");
+          w[i] = int(x);
+        }
+    }
+};
+
+/* length of first complete frame in buf[pos ..] including its header, 0
+   if frame is not complete yet; throws if frame is too long */
+inline size_t
+frame_size (const string &buf, size_t pos)
+{
+  if (buf.size() - pos < 4)
+    return 0;
+
+  const unsigned char *p =
+    reinterpret_cast<const unsigned char *>(buf.data() + pos);
+  uint32_t len = uint32_t(p[0]) | (uint32_t(p[1]) << 8)
+                 | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+
+  if (len > max_frame)
+    throw std::runtime_error("Frame too long");
+  if (buf.size() - pos - 4 < len)
+    return 0;
+  return len + 4;
+}
+
+class CfService
+{
+  std::map< string, std::unique_ptr<ConcurrentCfdict> > m_dicts;
+  vector<int> m_word;
+  vector< vector<int> > m_batch;
+
+  ConcurrentCfdict &find (const string &name)
+    {
+      auto it = m_dicts.find(name);
+      if (it == m_dicts.end())
+        throw std::runtime_error("No dictionary " + name);
+      return *it->second;
+    }
+
+  static uint32_t word_length (WireReader &rd)
+    {
+      uint32_t n = rd.u32 ();
+      if ((n == 0) || (n > max_word))
+        throw std::runtime_error("Incorrect word length");
+      return n;
+    }
+
+  void add_check (WireReader &rd, bool add, WireWriter &wr)
+    {
+      string name = rd.str ();
+      uint32_t n = word_length (rd), k = rd.u32 ();
+
+      if (rd.left() / 4 / n < k)
+        throw std::runtime_error("Truncated request");
+
+      /* nothing is created or added unless whole request is valid */
+      m_batch.resize(std::max(size_t(k), m_batch.size()));
+      for (uint32_t i = 0; i != k; ++i)
+        rd.word (m_batch[i], n);
+      rd.end ();
+
+      auto it = m_dicts.find(name);
+      if (add && (it == m_dicts.end()))
+        it = m_dicts.emplace(name, std::unique_ptr<ConcurrentCfdict>(
+                               new ConcurrentCfdict(n))).first;
+      ConcurrentCfdict &d = (it != m_dicts.end()) ? *it->second : find(name);
+      if (d.length() != n)
+        throw std::runtime_error("Dictionary " + name + " has other length");
+
+      wr.u8 (status_ok);
+      for (uint32_t i = 0; i != k; ++i)
+        wr.u8 (uint8_t(add ? d.insert(m_batch[i]) : d.check(m_batch[i])));
+      wr.u64 (d.size());
+    }
+
+  void eastman (WireReader &rd, WireWriter &wr)
+    {
+      uint32_t n = word_length (rd);
+      if ((n < 3) || ((n % 2) == 0))
+        throw std::runtime_error("Eastman word length shall be odd and > 1");
+      rd.word (m_word, n);
+      rd.end ();
+      int shift = do_eastman (m_word);
+      wr.u8 (status_ok);
+      wr.u32 (shift);
+    }
+
+  void canon (WireReader &rd, WireWriter &wr)
+    {
+      uint32_t n = word_length (rd);
+      rd.word (m_word, n);
+      rd.end ();
+      Canon c = canonical_rotation (m_word);
+      wr.u8 (status_ok);
+      wr.u32 (c.offset);
+      wr.u8 (c.primitive);
+    }
+
+  void dump (WireReader &rd, WireWriter &wr)
+    {
+      ConcurrentCfdict &d = find(rd.str ());
+      rd.end ();
+      vector< vector<int> > words;
+      d.get_dict(words);
+      wr.u8 (status_ok);
+      wr.u32 (d.length());
+      wr.u64 (words.size());
+      for (const auto &w : words)
+        wr.word (w.data(), w.size());
+    }
+
+public:
+  /* number of named dictionaries */
+  size_t size () const { return m_dicts.size(); }
+
+  /* answers request body, appends response frame to out; malformed
+     request gets error response, as any other failed one */
+  void handle (const char *body, size_t len, string &out)
+    {
+      WireReader rd(body, len);
+      uint32_t id = (len >= 4) ? rd.u32 () : 0;
+      size_t start = out.size();
+
+      try
+        {
+          WireWriter wr(out);
+          wr.u32 (id);
+          switch (rd.u8 ())
+            {
+            case op_add:
+              add_check (rd, true, wr);
+              break;
+            case op_check:
+              add_check (rd, false, wr);
+              break;
+            case op_eastman:
+              eastman (rd, wr);
+              break;
+            case op_canon:
+              canon (rd, wr);
+              break;
+            case op_dump:
+              dump (rd, wr);
+              break;
+            default:
+              throw std::runtime_error("Unknown operation");
+            }
+          wr.finish ();
+        }
+      catch (std::runtime_error &e)
+        {
+          out.resize(start);
+          WireWriter wr(out);
+          wr.u32 (id);
+          wr.u8 (status_error);
+          wr.str (e.what());
+          wr.finish ();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,489 @@
+//===------- cf_sliding.hpp -- Eastman shifts of sliding windows ----------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains definition and implementation of SlidingEastman
+// class: shift of do_eastman for every window of n letters of long
+// stream (say, candidates of codeword alignment), push letter and ask
+// shift of last n letters
+//
+// Phase of Eastman's algorithm (see cf_eastman.h) is local: boundary
+// points are cut by basins into segments, and segment from basin i to
+// next basin j retains point by comparisons of subwords between i and
+// j + 1 only. So phases are run on the stream itself, as linear word:
+// Phase k keeps boundary points of stream, its basins and, for every
+// basin, how many points of phase k + 1 were retained before it. Points
+// are retained as letters arrive, every comparison is done once.
+//
+// Window is cyclic, so its phase k is middle of stream phase k (between
+// first and last stream basins whose comparisons are inside window) and
+// few edge points around the wrap. Only segments from last middle basin
+// over the wrap to first one are walked: they give edge points of phase
+// k + 1, and its middle is slice of stream phase k + 1 between the same
+// basins. Phase without middle basin (few points left) is done as by
+// do_eastman. So window costs about constant number of comparisons per
+// phase instead of O(n), and its result is exactly do_eastman one
+//
+// Positions are absolute in stream; edge points past window end are kept
+// unwrapped (+ n), letter at p is window letter (p - start) mod n. Stream
+// phases drop points (and letters) which no window or walk needs
+//
+// State of stream phases after some letters is function of them only, so
+// stream might be rewound: mark records it (phases walked as far as these
+// letters allow), truncate returns to it, letters pushed after mark are
+// dropped. Words which share prefix (like consecutive Lyndon words, see
+// cf_primes.hpp) are pushed as their common prefix once and different
+// suffixes, shift of whole stream as window is shift of word. Stream shall
+// not be trimmed between mark and truncate: it is not, while length stays
+// below 4096 or window length
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_SLIDING_GUARD_
+#define CF_SLIDING_GUARD_
+
+#include <vector>
+#include <deque>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#include "cf_alloc.hpp"
+
+class SlidingEastman
+{
+  /* vector indexed by absolute index, head is dropped when half of
+     storage is dead */
+  template <typename T> class Tail
+  {
+    std::vector<T> m_v;
+    size_t m_off;
+
+  public:
+    Tail () : m_off(0) {}
+
+    size_t begin_index () const { return m_off; }
+    size_t end_index () const { return m_off + m_v.size(); }
+    T &operator[] (size_t i) { return m_v[i - m_off]; }
+    const T &operator[] (size_t i) const { return m_v[i - m_off]; }
+    void push_back (const T &x) { m_v.push_back(x); }
+
+    /* elements from index end on are dropped */
+    void truncate (size_t end)
+      {
+        if (end < m_off)
+          throw std::runtime_error("SlidingEastman: stream was trimmed");
+        if (end < end_index())
+          m_v.resize(end - m_off);
+      }
+
+    /* first index in [begin_index, end_index) with element >= x, for
+       sorted tail */
+    size_t lower_bound (const T &x) const
+      {
+        return m_off + (std::lower_bound(m_v.begin(), m_v.end(), x)
+                        - m_v.begin());
+      }
+
+    void drop_before (size_t i)
+      {
+        size_t dead = std::min(i, end_index()) - std::min(i, m_off);
+        if ((dead != 0) && (2 * dead >= m_v.size()))
+          {
+            m_v.erase(m_v.begin(), m_v.begin() + dead);
+            m_off += dead;
+          }
+      }
+  };
+
+  /* phase of stream as linear word and state of its basin walk: stage 0
+     looks for first basin at i, 1 climbs range at q, 2 descends at j */
+  struct Phase
+  {
+    Tail<uint64_t> pts;
+    Tail<size_t> basins, out;
+    int stage;
+    size_t i, q, j;
+
+    Phase () : stage(0), i(1), q(0), j(0) {}
+  };
+
+  enum { max_phases = 64, trim_period = 4096 };
+
+public:
+  /* recorded state of stream, see mark */
+  class Mark
+  {
+    friend class SlidingEastman;
+
+    struct PhaseMark
+    {
+      size_t pts, basins, out, i, q, j;
+      int stage;
+    };
+
+    uint64_t m_len;
+    std::vector<PhaseMark> m_phases;
+
+  public:
+    Mark () : m_len(0) {}
+    uint64_t length () const { return m_len; }
+  };
+
+private:
+  size_t m_n;
+  uint64_t m_len, m_s;            /* letters pushed, window start */
+  Tail<int> m_x;
+  std::deque<Phase> m_phases;
+  std::vector<uint64_t> m_edge, m_next, m_walk, m_list;
+
+  /* subword [a, b) greater than [b, c) of stream, as prev_greater */
+  bool stream_greater (uint64_t a, uint64_t b, uint64_t c) const
+    {
+      uint64_t len = b - a, k;
+      if (len != c - b)
+        return len > c - b;
+      for (k = 0; k != len; ++k)
+        if (m_x[a + k] != m_x[b + k])
+          return m_x[a + k] > m_x[b + k];
+      return false;
+    }
+
+  int letter (uint64_t p) const
+    {
+      return m_x[(p < m_s + m_n) ? p : m_s + (p - m_s) % m_n];
+    }
+
+  /* same for window written cyclically */
+  bool window_greater (uint64_t a, uint64_t b, uint64_t c) const
+    {
+      if (c <= m_s + m_n)
+        return stream_greater(a, b, c);
+
+      uint64_t len = b - a, k;
+      if (len != c - b)
+        return len > c - b;
+      for (k = 0; k != len; ++k)
+        {
+          int x = letter(a + k), y = letter(b + k);
+          if (x != y)
+            return x > y;
+        }
+      return false;
+    }
+
+  bool descent (const Phase &ph, size_t i) const
+    {
+      return stream_greater(ph.pts[i - 1], ph.pts[i], ph.pts[i + 1]);
+    }
+
+  bool descent (const std::vector<uint64_t> &p, size_t i) const
+    {
+      return window_greater(p[i - 1], p[i], p[i + 1]);
+    }
+
+  Phase &phase (size_t k)
+    {
+      if (k >= max_phases)
+        throw std::runtime_error("Too many Eastman phases");
+      while (m_phases.size() <= k)
+        m_phases.emplace_back();
+      return m_phases[k];
+    }
+
+  /* walks basins of phase k as far as points allow, retained points go
+     to phase k + 1 */
+  void extend (size_t k)
+    {
+      Phase &ph = phase(k), &nx = phase(k + 1);
+      size_t end = ph.pts.end_index();
+
+      for (;;)
+        if (ph.stage == 0)
+          {
+            if (ph.i + 2 >= end)
+              return;
+            if (descent(ph, ph.i) && !descent(ph, ph.i + 1))
+              {
+                ph.basins.push_back(ph.i);
+                ph.out.push_back(nx.pts.end_index());
+                ph.stage = 1;
+                ph.q = ph.i + 1;
+              }
+            else
+              ph.i += 1;
+          }
+        else if (ph.stage == 1)
+          {
+            if (ph.q + 2 >= end)
+              return;
+            if (descent(ph, ph.q + 1))
+              {
+                ph.stage = 2;
+                ph.j = ph.q + 1;
+              }
+            else
+              ph.q += 1;
+          }
+        else
+          {
+            if (ph.j + 2 >= end)
+              return;
+            if (descent(ph, ph.j + 1))
+              {
+                ph.j += 1;
+                continue;
+              }
+            if ((ph.j - ph.i) % 2)
+              nx.pts.push_back(ph.pts[ph.q + (ph.q - ph.i) % 2]);
+            ph.i = ph.j;
+            ph.basins.push_back(ph.i);
+            ph.out.push_back(nx.pts.end_index());
+            ph.stage = 1;
+            ph.q = ph.i + 1;
+          }
+    }
+
+  /* segments of cyclic p from basin i to basin stop, as eastman_impl */
+  void walk (const std::vector<uint64_t> &p, size_t i, size_t stop,
+             std::vector<uint64_t> &res) const
+    {
+      while (i < stop)
+        {
+          size_t q = i + 1, j;
+          while (!descent(p, q + 1))
+            q += 1;
+          j = q + 1;
+          while (descent(p, j + 1))
+            j += 1;
+          if ((j - i) % 2)
+            res.push_back(p[q + (q - i) % 2]);
+          i = j;
+        }
+    }
+
+  /* whole phase on m_list (ascending, in window), false if window is
+     cyclic */
+  bool full_phase ()
+    {
+      size_t t = m_list.size(), i, c;
+
+      m_walk.clear();
+      for (c = 0; c != 3; ++c)
+        for (uint64_t p : m_list)
+          m_walk.push_back(p + c * m_n);
+
+      for (i = 1; i <= t; ++i)
+        if (descent(m_walk, i))
+          break;
+      if (i > t)
+        return false;
+      while (descent(m_walk, i + 1))
+        i += 1;
+
+      m_next.clear();
+      walk (m_walk, i, i + t, m_next);
+
+      for (uint64_t &p : m_next)
+        p = m_s + (p - m_s) % m_n;
+      std::rotate(m_next.begin(),
+                  std::min_element(m_next.begin(), m_next.end()),
+                  m_next.end());
+      m_list.swap(m_next);
+      return true;
+    }
+
+  /* stream points which neither window nor basin walks need; last phase
+     was never walked, its walk will start at first kept point */
+  void trim ()
+    {
+      size_t k, nphases = m_phases.size();
+      uint64_t keep = m_s;
+
+      for (k = 0; k + 1 < nphases; ++k)
+        extend (k);
+
+      for (k = 0; k != nphases; ++k)
+        {
+          Phase &ph = m_phases[k];
+          size_t first = ph.pts.lower_bound(m_s);
+
+          if (k + 1 < nphases)
+            first = std::min(first, ph.i - 1);
+          size_t ord = ph.basins.lower_bound(first);
+
+          ph.pts.drop_before(first);
+          ph.basins.drop_before(ord);
+          ph.out.drop_before(ord);
+          if (k + 1 == nphases)
+            ph.i = std::max(ph.i, ph.pts.begin_index() + 1);
+          if (first < ph.pts.end_index())
+            keep = std::min(keep, ph.pts[first]);
+        }
+
+      m_x.drop_before(keep);
+    }
+
+public:
+  /* n is odd window length */
+  explicit SlidingEastman (size_t n) : m_n(n), m_len(0), m_s(0)
+    {
+      if (n % 2 == 0)
+        throw std::runtime_error("Window length shall be odd");
+      m_phases.emplace_back();
+    }
+
+  size_t length () const { return m_n; }
+
+  /* walks all phases as far as letters pushed allow and records state
+     into m (its storage is reused) */
+  void mark (Mark &m)
+    {
+      size_t k, end;
+      /* phases were walked by last mark or push, later ones are walked
+         only if points came to them */
+      for (k = 0; k != m_phases.size(); ++k)
+        {
+          end = phase(k + 1).pts.end_index();
+          extend (k);
+          if (m_phases[k + 1].pts.end_index() == end)
+            break;
+        }
+
+      m.m_len = m_len;
+      m.m_phases.resize(m_phases.size());
+      for (k = 0; k != m_phases.size(); ++k)
+        {
+          const Phase &ph = m_phases[k];
+          Mark::PhaseMark &pm = m.m_phases[k];
+          pm.pts = ph.pts.end_index();
+          pm.basins = ph.basins.end_index();
+          pm.out = ph.out.end_index();
+          pm.stage = ph.stage;
+          pm.i = ph.i;
+          pm.q = ph.q;
+          pm.j = ph.j;
+        }
+    }
+
+  /* back to state recorded by mark, letters pushed after it are dropped */
+  void truncate (const Mark &m)
+    {
+      size_t k;
+      if (m.m_len > m_len)
+        throw std::runtime_error("SlidingEastman: mark is ahead of stream");
+
+      m_x.truncate(m.m_len);
+      m_len = m.m_len;
+      while (m_phases.size() > std::max<size_t>(m.m_phases.size(), 1))
+        m_phases.pop_back();
+      for (k = 0; k != m_phases.size(); ++k)
+        {
+          Phase &ph = m_phases[k];
+          if (k >= m.m_phases.size())
+            {
+              ph = Phase();
+              continue;
+            }
+          const Mark::PhaseMark &pm = m.m_phases[k];
+          ph.pts.truncate(pm.pts);
+          ph.basins.truncate(pm.basins);
+          ph.out.truncate(pm.out);
+          ph.stage = pm.stage;
+          ph.i = pm.i;
+          ph.q = pm.q;
+          ph.j = pm.j;
+        }
+    }
+
+  /* number of letters pushed, last window starts at pushed () - n */
+  uint64_t pushed () const { return m_len; }
+  bool ready () const { return m_len >= m_n; }
+
+  void push (int letter)
+    {
+      m_x.push_back(letter);
+      m_phases[0].pts.push_back(m_len);
+      m_len += 1;
+
+      if ((m_len % trim_period == 0) && ready())
+        {
+          m_s = m_len - m_n;
+          trim ();
+        }
+    }
+
+  /* shift of last n letters as do_eastman gives for their copy, or -1
+     if they are cyclic */
+  int shift ()
+    {
+      CF_ALLOC_SCOPE("SlidingEastman::shift");
+      if (!ready())
+        throw std::runtime_error("Window is not full");
+
+      m_s = m_len - m_n;
+
+      size_t lo = m_s, hi = m_s + m_n, k;
+      bool full = false;
+
+      m_edge.clear();
+      for (k = 0; ; ++k)
+        {
+          if (!full)
+            {
+              if (hi - lo + m_edge.size() == 1)
+                return ((hi > lo) ? phase(k).pts[lo] - m_s
+                                  : (m_edge[0] - m_s) % m_n);
+
+              extend (k);
+              Phase &ph = phase(k);
+
+              /* first and last basins of middle, their descents are
+                 inside middle */
+              size_t f = ph.basins.lower_bound(lo + 1),
+                     l = ph.basins.lower_bound(hi - 2);
+              if ((hi - lo >= 4) && (f < l))
+                {
+                  size_t bf = ph.basins[f], bl = ph.basins[--l], i;
+
+                  m_walk.clear();
+                  for (i = bl; i != hi; ++i)
+                    m_walk.push_back(ph.pts[i]);
+                  m_walk.insert(m_walk.end(), m_edge.begin(), m_edge.end());
+                  size_t stop = m_walk.size() + bf - lo;
+                  for (i = lo; i != bf + 3; ++i)
+                    m_walk.push_back(ph.pts[i] + m_n);
+
+                  m_next.clear();
+                  walk (m_walk, 0, stop, m_next);
+                  m_edge.swap(m_next);
+                  lo = ph.out[f];
+                  hi = ph.out[l];
+                  continue;
+                }
+
+              /* few points left, window is done as whole from now */
+              m_list.clear();
+              for (size_t i = lo; i != hi; ++i)
+                m_list.push_back(ph.pts[i]);
+              for (uint64_t p : m_edge)
+                m_list.push_back(m_s + (p - m_s) % m_n);
+              std::rotate(m_list.begin(),
+                          std::min_element(m_list.begin(), m_list.end()),
+                          m_list.end());
+              full = true;
+            }
+
+          if (m_list.size() == 1)
+            return m_list[0] - m_s;
+          if (!full_phase ())
+            return -1;
+        }
+    }
+};
+
+#endif
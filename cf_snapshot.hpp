@@ -0,0 +1,500 @@
+//===------- cf_snapshot.hpp -- memory mapped comma-free dictionary -------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains binary snapshot of comma-free dictionary: CfSnapshot
+// writes it from list of words and maps it back read-only, queries go to
+// mapped pages directly, there is no parsing or rebuild on load. Several
+// processes mapping one file share its page cache
+//
+// File is header and 64-byte aligned sections, native byte order (header
+// has version and byte order mark, mismatch is refused):
+//
+// - words: letters as int32, in dictionary order
+// - W: minimal perfect hash (CHD, hash and displace) over keys of words:
+//   key goes to bucket (key >> 32) % buckets, slot is (f1 + d0 * f2 + d1)
+//   % words, where f1, f2 come from key and (d0, d1) are stored for its
+//   bucket; slot holds key, for membership, and index of word
+// - S, P, B, C: keys of suffixes, prefixes and parts of splits (see
+//   cf_cdict.hpp) in open addressing tables, load at most 1/2, key_slot
+//   and linear probing like KeyTable
+//
+// Keys are WordKeys ones, so check is the same as ConcurrentCfdict::check
+// on dictionary of these words. Snapshot is immutable; dictionary which
+// still grows is saved again
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_SNAPSHOT_GUARD_
+#define CF_SNAPSHOT_GUARD_
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cf_cdict.hpp"
+
+using std::vector;
+using std::string;
+
+class CfSnapshot
+{
+  enum : uint32_t { version = 1, byte_order = 0x01020304 };
+  enum { nsets = 4, align = 64, bucket_load = 4 };
+
+  struct Header
+  {
+    char magic[8];
+    uint32_t version, byte_order;
+    uint64_t n, words, file_size;
+    uint64_t words_off;
+    uint64_t buckets, disp_off, slot_key_off, slot_word_off;
+    uint64_t set_cap[nsets], set_off[nsets];    /* S, P, B, C */
+  };
+
+  /* open addressing set over mapped slots */
+  class Frozen
+  {
+    const uint64_t *m_slots;
+    size_t m_mask;
+
+  public:
+    Frozen () : m_slots(nullptr), m_mask(0) {}
+    Frozen (const uint64_t *slots, size_t cap) :
+      m_slots(slots), m_mask(cap - 1) {}
+
+    bool contains (uint64_t key) const
+      {
+        for (size_t s = key_slot(key) & m_mask; ; s = (s + 1) & m_mask)
+          {
+            uint64_t v = m_slots[s];
+            if (v == key)
+              return true;
+            if (v == 0)
+              return false;
+          }
+      }
+  };
+
+  /* minimal perfect hash of word keys */
+  class Mph
+  {
+    const uint32_t *m_disp;     /* d0, d1 per bucket */
+    const uint64_t *m_keys;
+    const uint32_t *m_index;
+    uint64_t m_m, m_buckets;
+
+  public:
+    Mph () : m_disp(nullptr), m_keys(nullptr), m_index(nullptr),
+             m_m(0), m_buckets(0) {}
+    Mph (const uint32_t *disp, const uint64_t *keys, const uint32_t *index,
+         uint64_t m, uint64_t buckets) :
+      m_disp(disp), m_keys(keys), m_index(index), m_m(m), m_buckets(buckets)
+      {}
+
+    static uint64_t bucket (uint64_t key, uint64_t buckets)
+      {
+        return (key >> 32) % buckets;
+      }
+
+    /* f1 in [0, m), f2 in [1, m) */
+    static void hashes (uint64_t key, uint64_t m, uint64_t &f1, uint64_t &f2)
+      {
+        uint64_t h = WordKeys::mix(key ^ 0x5851f42d4c957f2dull);
+        f1 = uint32_t(h) % m;
+        f2 = (m > 1) ? (1 + (h >> 32) % (m - 1)) : 0;
+      }
+
+    static uint64_t slot (uint64_t f1, uint64_t f2, uint64_t d0, uint64_t d1,
+                          uint64_t m)
+      {
+        return (f1 + (d0 * f2) % m + d1) % m;
+      }
+
+    /* slot of key, if it is there */
+    bool find (uint64_t key, uint64_t &s) const
+      {
+        if (m_m == 0)
+          return false;
+        uint64_t b = bucket(key, m_buckets), f1, f2;
+        hashes (key, m_m, f1, f2);
+        s = slot(f1, f2, m_disp[2 * b], m_disp[2 * b + 1], m_m);
+        return m_keys[s] == key;
+      }
+
+    bool contains (uint64_t key) const
+      {
+        uint64_t s;
+        return find(key, s);
+      }
+
+    uint32_t index (uint64_t s) const { return m_index[s]; }
+  };
+
+  /* growing open addressing set, its slots are written as they are */
+  class Builder
+  {
+    vector<uint64_t> m_slots;
+    size_t m_used;
+
+    static void put (vector<uint64_t> &t, uint64_t key)
+      {
+        size_t mask = t.size() - 1;
+        for (size_t s = key_slot(key) & mask; ; s = (s + 1) & mask)
+          {
+            if (t[s] == key)
+              return;
+            if (t[s] == 0)
+              {
+                t[s] = key;
+                return;
+              }
+          }
+      }
+
+  public:
+    Builder () : m_slots(64, 0), m_used(0) {}
+
+    const vector<uint64_t> &slots () const { return m_slots; }
+
+    bool contains (uint64_t key) const
+      {
+        return Frozen(m_slots.data(), m_slots.size()).contains(key);
+      }
+
+    void insert (uint64_t key)
+      {
+        if (contains(key))
+          return;
+        if (2 * (m_used + 1) > m_slots.size())
+          {
+            vector<uint64_t> g(2 * m_slots.size(), 0);
+            for (uint64_t v : m_slots)
+              if (v != 0)
+                put(g, v);
+            m_slots.swap(g);
+          }
+        put(m_slots, key);
+        m_used += 1;
+      }
+  };
+
+  int m_fd;
+  const char *m_base;
+  size_t m_len;
+  const Header *m_hdr;
+  WordKeys m_keys;
+  const int32_t *m_words;
+  Mph m_mph;
+  Frozen m_sets[nsets];
+
+  static uint64_t aligned (uint64_t off)
+    {
+      return (off + align - 1) / align * align;
+    }
+
+  /* (d0, d1) of every bucket: largest buckets first, singletons take
+     free slots directly */
+  static void build_mph (const vector<uint64_t> &keys, uint64_t buckets,
+                         vector<uint32_t> &disp, vector<uint64_t> &slot_key,
+                         vector<uint32_t> &slot_word)
+    {
+      uint64_t m = keys.size(), i;
+      vector< vector<uint32_t> > in(buckets);
+      vector<uint64_t> order(buckets), pos;
+      vector<char> used(m, 0);
+
+      for (i = 0; i != m; ++i)
+        in[Mph::bucket(keys[i], buckets)].push_back(i);
+      for (i = 0; i != buckets; ++i)
+        order[i] = i;
+      std::stable_sort(order.begin(), order.end(),
+                       [&in] (uint64_t a, uint64_t b) {
+                         return in[a].size() > in[b].size();
+                       });
+
+      disp.assign(2 * buckets, 0);
+      slot_key.assign(m, 0);
+      slot_word.assign(m, 0);
+      uint64_t next_free = 0;
+
+      for (uint64_t b : order)
+        {
+          const vector<uint32_t> &ks = in[b];
+          uint64_t d0 = 0, d1 = 0, f1, f2;
+
+          if (ks.empty())
+            break;
+
+          if (ks.size() == 1)
+            {
+              while (used[next_free])
+                next_free += 1;
+              Mph::hashes (keys[ks[0]], m, f1, f2);
+              d1 = (next_free + m - f1) % m;
+            }
+          else
+            for (uint64_t tries = 0; ; ++tries)
+              {
+                if (tries > (uint64_t(1) << 32))
+                  throw std::runtime_error("CfSnapshot: perfect hash failed");
+                d0 = tries / m;
+                d1 = tries % m;
+
+                pos.clear();
+                bool ok = true;
+                for (uint32_t k : ks)
+                  {
+                    Mph::hashes (keys[k], m, f1, f2);
+                    uint64_t s = Mph::slot(f1, f2, d0, d1, m);
+                    if (used[s]
+                        || (std::find(pos.begin(), pos.end(), s) != pos.end()))
+                      {
+                        ok = false;
+                        break;
+                      }
+                    pos.push_back(s);
+                  }
+                if (ok)
+                  break;
+              }
+
+          disp[2 * b] = d0;
+          disp[2 * b + 1] = d1;
+          for (uint32_t k : ks)
+            {
+              Mph::hashes (keys[k], m, f1, f2);
+              uint64_t s = Mph::slot(f1, f2, d0, d1, m);
+              used[s] = 1;
+              slot_key[s] = keys[k];
+              slot_word[s] = k;
+            }
+        }
+    }
+
+  const char *section (uint64_t off, uint64_t len) const
+    {
+      if ((off % align != 0) || (off > m_len) || (len > m_len - off))
+        throw std::runtime_error("CfSnapshot: damaged file");
+      return m_base + off;
+    }
+
+public:
+  /* maps snapshot file, throws if it is not one of this version */
+  explicit CfSnapshot (const string &path) :
+    m_fd(-1), m_base(nullptr), m_len(0), m_hdr(nullptr), m_keys(0),
+    m_words(nullptr)
+    {
+      struct stat sb;
+      m_fd = open(path.c_str(), O_RDONLY);
+      if ((m_fd < 0) || (fstat(m_fd, &sb) != 0))
+        throw std::runtime_error("Can not open snapshot " + path);
+      m_len = sb.st_size;
+      if (m_len < sizeof(Header))
+        {
+          close(m_fd);
+          throw std::runtime_error("Not a snapshot: " + path);
+        }
+
+      void *p = mmap(nullptr, m_len, PROT_READ, MAP_SHARED, m_fd, 0);
+      if (p == MAP_FAILED)
+        {
+          close(m_fd);
+          throw std::runtime_error("Can not map snapshot " + path);
+        }
+      m_base = static_cast<const char *>(p);
+      m_hdr = reinterpret_cast<const Header *>(m_base);
+
+      try
+        {
+          const Header &h = *m_hdr;
+          if (std::memcmp(h.magic, "CFSNAP\0\0", 8) != 0)
+            throw std::runtime_error("Not a snapshot: " + path);
+          if ((h.version != version) || (h.byte_order != byte_order))
+            throw std::runtime_error("Snapshot " + path
+                                     + " is of other version or byte order");
+          if ((h.file_size != m_len) || (h.n == 0) || (h.n > (1u << 16))
+              || (h.words > 0xffffffffull)
+              || (h.buckets == 0) || (h.buckets > h.words + 1))
+            throw std::runtime_error("CfSnapshot: damaged file");
+
+          m_keys = WordKeys(h.n);
+          m_words = reinterpret_cast<const int32_t *>(
+            section(h.words_off, h.words * h.n * 4));
+          m_mph = Mph(reinterpret_cast<const uint32_t *>(
+                        section(h.disp_off, h.buckets * 8)),
+                      reinterpret_cast<const uint64_t *>(
+                        section(h.slot_key_off, h.words * 8)),
+                      reinterpret_cast<const uint32_t *>(
+                        section(h.slot_word_off, h.words * 4)),
+                      h.words, h.buckets);
+          for (int i = 0; i != nsets; ++i)
+            {
+              uint64_t cap = h.set_cap[i];
+              if ((cap == 0) || ((cap & (cap - 1)) != 0) || (cap > m_len))
+                throw std::runtime_error("CfSnapshot: damaged file");
+              m_sets[i] = Frozen(reinterpret_cast<const uint64_t *>(
+                                   section(h.set_off[i], cap * 8)), cap);
+            }
+        }
+      catch (...)
+        {
+          munmap(const_cast<char *>(m_base), m_len);
+          close(m_fd);
+          throw;
+        }
+    }
+
+  CfSnapshot (const CfSnapshot &) = delete;
+  CfSnapshot &operator= (const CfSnapshot &) = delete;
+
+  ~CfSnapshot ()
+    {
+      munmap(const_cast<char *>(m_base), m_len);
+      close(m_fd);
+    }
+
+  size_t length () const { return m_hdr->n; }
+  size_t size () const { return m_hdr->words; }
+
+  /* letters of word i, as int32 */
+  const int32_t *word (size_t i) const { return &m_words[i * m_hdr->n]; }
+
+  /* index of w in dictionary, -1 if it is not there */
+  long find (const vector<int> &w) const
+    {
+      uint64_t s;
+      if (w.size() != length())
+        throw std::runtime_error("Incorrect size of candidate");
+      WordKeys::Parts p(m_keys, w.data());
+      if (!m_mph.find(p.rotation(0), s))
+        return -1;
+      uint32_t i = m_mph.index(s);
+      return std::equal(w.begin(), w.end(), word(i)) ? long(i) : -1;
+    }
+
+  /* result of insert of w, as ConcurrentCfdict::check */
+  int check (const vector<int> &w) const
+    {
+      if (w.size() != length())
+        throw std::runtime_error("Incorrect size of candidate");
+      return m_keys.check(m_mph, m_sets[0], m_sets[1], m_sets[2], m_sets[3],
+                          w.data());
+    }
+
+  /* writes snapshot of words (k * n letters, comma-free code); written
+     to temporary file and renamed, so readers never see a partial one */
+  static void write (const string &path, size_t n, const vector<int> &words)
+    {
+      size_t k = words.size() / n, i, j;
+      WordKeys keys(n);
+      vector<uint64_t> wkeys(k);
+      Builder sets[nsets];              /* S, P, B, C */
+
+      if ((n == 0) || (n > (1u << 16)) || (words.size() % n != 0)
+          || (k > 0xffffffffull))
+        throw std::runtime_error("CfSnapshot: incorrect dictionary");
+
+      for (i = 0; i != k; ++i)
+        {
+          WordKeys::Parts p(keys, &words[i * n]);
+          wkeys[i] = p.rotation(0);
+          for (j = 1; j != n; ++j)
+            {
+              sets[0].insert(p.part(n - j, n));
+              sets[1].insert(p.part(0, j));
+            }
+        }
+
+      /* B: u of split u . v with v in P, C: v with u in S */
+      for (i = 0; i != k; ++i)
+        {
+          WordKeys::Parts p(keys, &words[i * n]);
+          for (j = 1; j != n; ++j)
+            {
+              uint64_t u = p.part(0, j), v = p.part(j, n);
+              if (sets[1].contains(v))
+                sets[2].insert(u);
+              if (sets[0].contains(u))
+                sets[3].insert(v);
+            }
+        }
+
+      vector<uint64_t> sorted(wkeys);
+      std::sort(sorted.begin(), sorted.end());
+      if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end())
+        throw std::runtime_error("CfSnapshot: repeated word or key collision");
+
+      Header h;
+      std::memset(&h, 0, sizeof(h));
+      std::memcpy(h.magic, "CFSNAP\0\0", 8);
+      h.version = version;
+      h.byte_order = byte_order;
+      h.n = n;
+      h.words = k;
+      h.buckets = k / bucket_load + 1;
+
+      static_assert(sizeof(int) == 4, "letters are written as int32");
+      vector<uint32_t> disp, slot_word;
+      vector<uint64_t> slot_key;
+      build_mph (wkeys, h.buckets, disp, slot_key, slot_word);
+
+      uint64_t off = aligned(sizeof(h));
+      auto place = [&off] (uint64_t len) {
+        uint64_t at = off;
+        off = aligned(off + len);
+        return at;
+      };
+      h.words_off = place(words.size() * 4);
+      h.disp_off = place(disp.size() * 4);
+      h.slot_key_off = place(slot_key.size() * 8);
+      h.slot_word_off = place(slot_word.size() * 4);
+      for (i = 0; i != nsets; ++i)
+        {
+          h.set_cap[i] = sets[i].slots().size();
+          h.set_off[i] = place(h.set_cap[i] * 8);
+        }
+      h.file_size = off;
+
+      string tmp = path + ".tmp";
+      {
+        std::ofstream os(tmp, std::ios::binary);
+        uint64_t at = 0;
+        auto put = [&os, &at] (uint64_t to, const void *p, size_t len) {
+          static const char zeros[align] = {};
+          os.write(zeros, to - at);
+          os.write(static_cast<const char *>(p), len);
+          at = to + len;
+        };
+
+        put (0, &h, sizeof(h));
+        put (h.words_off, words.data(), words.size() * 4);
+        put (h.disp_off, disp.data(), disp.size() * 4);
+        put (h.slot_key_off, slot_key.data(), slot_key.size() * 8);
+        put (h.slot_word_off, slot_word.data(), slot_word.size() * 4);
+        for (i = 0; i != nsets; ++i)
+          put (h.set_off[i], sets[i].slots().data(), h.set_cap[i] * 8);
+        put (h.file_size, nullptr, 0);
+
+        if (!os)
+          throw std::runtime_error("Can not write snapshot " + tmp);
+      }
+      if (std::rename(tmp.c_str(), path.c_str()) != 0)
+        throw std::runtime_error("Can not rename snapshot to " + path);
+    }
+};
+
+#endif
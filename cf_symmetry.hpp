@@ -0,0 +1,204 @@
+//===------- cf_symmetry.hpp -- alphabet and reversal symmetries ----------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains definition and implementation of ClassSymmetry class
+// which finds symmetries of set of cyclic classes: permutations of alphabet,
+// optionally combined with reversal of all words. Comma-free property is
+// invariant under both, so every symmetry maps comma-free code to
+// comma-free code
+//
+// Symmetry g is kept only if it maps every input class onto some input
+// class. Then g acts on routes (class i -> rotation r_i): word
+// rot(c_i, r_i) goes to rot(c_j, r'), where j = g(i), so g(route)[j] = r'.
+// Rotation rot(c, r) is left cyclic shift of c by r letters, as in
+// cf_all_paths and CfSearch
+//
+// Route is canonical if it is lexicographically minimal in its orbit.
+// Every orbit has exactly one canonical route, of size
+// size() / stabilizer(route), so summing orbit sizes over canonical routes
+// gives exact totals
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_SYMMETRY_GUARD_
+#define CF_SYMMETRY_GUARD_
+
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <stdexcept>
+
+#include "cf_canon.hpp"
+
+using std::vector;
+
+class ClassSymmetry
+{
+  size_t m_nclasses, m_n;
+  vector< vector<int> > m_img;   /* g -> class i -> class g(i) */
+  vector< vector<int> > m_pre;   /* g -> class j -> class i, g(i) = j */
+  vector< vector<int> > m_rot;   /* g -> i * n + r -> rotation of g(i) */
+
+  static size_t least_rotation (const vector<int> &w)
+    {
+      return canonical_rotation(w).offset;
+    }
+
+  static vector<int> rotated (const vector<int> &w, size_t r)
+    {
+      vector<int> res(w.size());
+      for (size_t i = 0; i != w.size(); ++i)
+        res[i] = w[(i + r) % w.size()];
+      return res;
+    }
+
+public:
+  /* classes are words of equal length, every given in any rotation
+     letter permutations are tried only if there are at most maxletters
+     distinct letters, otherwise only reversal is tried */
+  ClassSymmetry (const vector< vector<int> > &classes, size_t maxletters = 8)
+    : m_nclasses(classes.size()), m_n(0)
+    {
+      vector<int> letters;
+      std::map< vector<int>, std::pair<size_t, size_t> > canon;
+      size_t i, r;
+
+      if (classes.empty())
+        {
+          m_img.resize(1);
+          m_pre.resize(1);
+          m_rot.resize(1);
+          return;
+        }
+
+      m_n = classes[0].size();
+      for (i = 0; i != m_nclasses; ++i)
+        {
+          if (classes[i].size() != m_n)
+            throw std::runtime_error("ClassSymmetry: words of different size");
+          size_t t = least_rotation(classes[i]);
+          if (!canon.insert(std::make_pair(rotated(classes[i], t),
+                                           std::make_pair(i, t))).second)
+            throw std::runtime_error("ClassSymmetry: repeated class");
+          letters.insert(letters.end(), classes[i].begin(), classes[i].end());
+        }
+
+      std::sort(letters.begin(), letters.end());
+      letters.erase(std::unique(letters.begin(), letters.end()), letters.end());
+
+      vector<int> perm(letters);
+      do {
+        for (int rev = 0; rev != 2; ++rev)
+          {
+            vector<int> img(m_nclasses), pre(m_nclasses, -1);
+            vector<int> rot(m_nclasses * m_n);
+            bool sym = true;
+
+            for (i = 0; sym && (i != m_nclasses); ++i)
+              for (r = 0; sym && (r != m_n); ++r)
+                {
+                  vector<int> u = rotated(classes[i], r);
+                  for (int &c : u)
+                    c = perm[std::lower_bound(letters.begin(), letters.end(), c)
+                             - letters.begin()];
+                  if (rev)
+                    std::reverse(u.begin(), u.end());
+
+                  size_t s = least_rotation(u);
+                  auto it = canon.find(rotated(u, s));
+                  if (it == canon.end())
+                    {
+                      sym = false;
+                      break;
+                    }
+
+                  size_t j = it->second.first, t = it->second.second;
+                  if (r == 0)
+                    {
+                      if (pre[j] >= 0)
+                        sym = false;
+                      img[i] = j;
+                      pre[j] = i;
+                    }
+                  rot[i * m_n + r] = (t + m_n - s) % m_n;
+                }
+
+            if (sym)
+              {
+                m_img.push_back(img);
+                m_pre.push_back(pre);
+                m_rot.push_back(rot);
+              }
+          }
+      } while ((letters.size() <= maxletters)
+               && std::next_permutation(perm.begin(), perm.end()));
+    }
+
+  /* number of symmetries, element 0 is identity */
+  size_t size () const { return m_img.size(); }
+
+  int image_class (size_t g, size_t i) const { return m_img[g][i]; }
+
+  int image_rotation (size_t g, size_t i, size_t r) const
+    {
+      return m_rot[g][i * m_n + r];
+    }
+
+  /* compares g(route) with route on first p classes (others unknown):
+     -1 if g(route) is less for every completion, 1 if greater, 0 if
+     equal or not yet known */
+  int compare (size_t g, const vector<int> &route, size_t p) const
+    {
+      size_t j;
+
+      for (j = 0; j != p; ++j)
+        {
+          size_t i = m_pre[g][j];
+          if (i >= p)
+            return 0;
+          int v = m_rot[g][i * m_n + route[i]];
+          if (v != route[j])
+            return (v < route[j]) ? -1 : 1;
+        }
+
+      return 0;
+    }
+
+  /* false if no completion of first p classes of route is canonical */
+  bool maybe_canonical (const vector<int> &route, size_t p) const
+    {
+      for (size_t g = 1; g < size(); ++g)
+        if (compare(g, route, p) < 0)
+          return false;
+      return true;
+    }
+
+  /* number of symmetries fixing complete route */
+  size_t stabilizer (const vector<int> &route) const
+    {
+      size_t g, j, cnt = 0;
+
+      for (g = 0; g != size(); ++g)
+        {
+          for (j = 0; j != m_nclasses; ++j)
+            if (m_rot[g][m_pre[g][j] * m_n + route[m_pre[g][j]]] != route[j])
+              break;
+          if (j == m_nclasses)
+            cnt += 1;
+        }
+
+      return cnt;
+    }
+
+  /* orbit size of complete route */
+  size_t orbit (const vector<int> &route) const
+    {
+      return size() / stabilizer(route);
+    }
+};
+
+#endif
@@ -0,0 +1,166 @@
+//===-- cf_tables_gen.cpp -- build-time tables of small Eastman codes -----===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains an executable programm which runs PrimeGen and
+// do_eastman for every given (m, n) and prints C++ header with the codes,
+// so code of shipped parameters is compiled in (see cf_fixed.hpp):
+//
+// ./cf_tables_gen 3 3  3 5  3 7  4 3  4 5 > cf_tables.inc
+//
+// For every code: words in PrimeGen order (unrank) followed by 8 zero
+// bytes, so 8-byte load of any word stays inside, membership bitmap and
+// rank table over all m^n words, word is index by base m digits, first
+// letter most significant. Template for_each_fixed_code visits all codes,
+// so users do not list them. Makefile builds cf_tables.inc this way
+//
+//===----------------------------------------------------------------------===//
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <type_traits>
+#include <cstdlib>
+#include <cstdint>
+#include <stdexcept>
+
+#include "tuples.hpp"
+#include "cf_eastman.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::vector;
+
+enum { max_space = 1 << 16 };
+
+void process_command_line (int argc, char **argv,
+                           vector< std::pair<int, int> > &params);
+
+/* prints numbers of v, 12 per line */
+template <typename T> static void
+put_array (const vector<T> &v, const char *type, const std::string &name)
+{
+  cout << "static const " << type << " " << name << "[" << v.size()
+       << "] = {";
+  for (size_t i = 0; i != v.size(); ++i)
+    {
+      cout << ((i % 12 == 0) ? "\n  " : " ") << +v[i];
+      if (std::is_same<T, uint64_t>::value)
+        cout << "ull";
+      if (i + 1 != v.size())
+        cout << ",";
+    }
+  cout << "\n};\n\n";
+}
+
+static void
+put_code (int m, int n)
+{
+  vector<uint8_t> code;
+  vector<int> x;
+  uint32_t space = 1;
+
+  for (int i = 0; i != n; ++i)
+    space *= m;
+
+  vector<int16_t> rank(space, -1);
+  vector<uint64_t> member((space + 63) / 64, 0);
+  PrimeGen pg(m, n);
+  int16_t k = 0;
+
+  for (const vector<int> &p : pg.range())
+    {
+      vector<int> w(p);
+      x = p;
+      int s = do_eastman(x);
+      std::rotate(w.begin(), w.begin() + s, w.end());
+
+      uint32_t idx = 0;
+      for (int a : w)
+        {
+          idx = idx * m + a;
+          code.push_back(a);
+        }
+      rank[idx] = k++;
+      member[idx / 64] |= uint64_t(1) << (idx % 64);
+    }
+  code.resize(code.size() + 8, 0);
+
+  std::string sfx = std::to_string(m) + "_" + std::to_string(n);
+  cout << "/* m = " << m << ", n = " << n << ": " << k << " words */\n\n";
+  put_array (code, "uint8_t", "cf_code_" + sfx);
+  put_array (member, "uint64_t", "cf_member_" + sfx);
+  put_array (rank, "int16_t", "cf_rank_" + sfx);
+
+  cout << "template <> struct FixedTables<" << m << ", " << n << ">\n"
+       << "{\n"
+       << "  enum { size = " << k << ", space = " << space << " };\n"
+       << "  static const uint8_t *code () { return cf_code_" << sfx
+       << "; }\n"
+       << "  static const uint64_t *member () { return cf_member_" << sfx
+       << "; }\n"
+       << "  static const int16_t *rank () { return cf_rank_" << sfx
+       << "; }\n"
+       << "};\n\n";
+}
+
+int
+main (int argc, char **argv)
+{
+  vector< std::pair<int, int> > params;
+
+  process_command_line (argc, argv, params);
+
+  cout << "/* generated by cf_tables_gen, do not edit */\n\n"
+       << "template <int M, int N> struct FixedTables;\n\n";
+
+  for (const auto &p : params)
+    put_code (p.first, p.second);
+
+  /* dispatch over all codes, for runtime choice and for checks */
+  cout << "/* f.template run<M, N> () for every compiled in (M, N) */\n"
+       << "template <typename F> inline void\n"
+       << "for_each_fixed_code (F &f)\n"
+       << "{\n";
+  for (const auto &p : params)
+    cout << "  f.template run<" << p.first << ", " << p.second << "> ();\n";
+  cout << "}\n";
+
+  return 0;
+}
+
+void
+process_command_line (int argc, char **argv,
+                      vector< std::pair<int, int> > &params)
+{
+  if ((argc < 3) || (argc % 2 == 0))
+    {
+      cerr << "usage: \"" << argv[0] << " m1 n1 [m2 n2 ...]\" where m is"
+              " alphabet size and n is odd word length" << endl;
+      throw std::runtime_error("incorrect command line");
+    }
+
+  for (int idx = 1; idx + 1 < argc; idx += 2)
+    {
+      int m = std::atoi(argv[idx]), n = std::atoi(argv[idx + 1]);
+      uint64_t space = 1;
+
+      for (int i = 0; (i != n) && (space <= max_space); ++i)
+        space *= std::max(m, 1);
+      if ((m < 2) || (m > 256) || (n < 3) || (n % 2 == 0)
+          || (space > max_space))
+        {
+          cerr << "need 2 <= m <= 256, odd n > 1 and m^n <= " << max_space
+               << endl;
+          throw std::runtime_error("incorrect command line");
+        }
+      if (std::find(params.begin(), params.end(), std::make_pair(m, n))
+          == params.end())
+        params.push_back(std::make_pair(m, n));
+    }
+}
@@ -0,0 +1,233 @@
+//===------- cf_trace.hpp -- Eastman phase tracing ------------------------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains definition and implementation of EastmanTrace class
+// which collects per-call counters of do_eastman: phases, boundaries
+// entering and leaving every phase, subword comparisons, letters compared
+// and time per phase
+//
+// Tracing is switched at runtime, either by eastman_trace_enable or by
+// environment variable CF_EASTMAN_TRACE=stderr|<file>. Every call is written
+// as one JSON line:
+//
+// {"engine": "basin", "x": [3, 0, 1], "shift": 1, "cmp": 4, "letters": 4,
+//  "ns": 310, "phases": [{"in": 3, "out": 1, "cmp": 4, "letters": 4,
+//  "ns": 250}]}
+//
+// and on disable one summary line with totals and worst input is written
+//
+// Disabled tracing costs one check per do_eastman call: engines keep
+// traced and untraced instantiations of their main loop
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_TRACE_GUARD_
+#define CF_TRACE_GUARD_
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+
+/* counters of one Eastman phase */
+struct EastmanPhaseStats
+{
+  size_t in = 0, out = 0;
+  uint64_t cmp = 0, letters = 0, ns = 0;
+};
+
+/* counters of one do_eastman call, filled by engine */
+class EastmanCallStats
+{
+  typedef std::chrono::steady_clock clock;
+  clock::time_point m_start, m_phase_start;
+
+public:
+  std::vector<int> x;
+  std::vector<EastmanPhaseStats> phases;
+  uint64_t cmp = 0, letters = 0, ns = 0;
+  int shift = -1;
+
+  void begin (const std::vector<int> &xs)
+    {
+      x = xs;
+      m_start = clock::now();
+    }
+
+  void phase_begin (size_t boundaries)
+    {
+      EastmanPhaseStats p;
+      p.in = boundaries;
+      phases.push_back(p);
+      m_phase_start = clock::now();
+    }
+
+  /* one comparison of subwords which examined given number of letters */
+  void compared (uint64_t nletters)
+    {
+      phases.back().cmp += 1;
+      phases.back().letters += nletters;
+    }
+
+  void phase_end (size_t retained)
+    {
+      EastmanPhaseStats &p = phases.back();
+      p.out = retained;
+      p.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+               clock::now() - m_phase_start).count();
+      cmp += p.cmp;
+      letters += p.letters;
+    }
+
+  void end (int s)
+    {
+      shift = s;
+      ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+             clock::now() - m_start).count();
+    }
+};
+
+class EastmanTrace
+{
+  std::mutex m_mut;
+  std::ofstream m_file;
+  std::ostream *m_os = nullptr;
+  std::atomic<bool> m_enabled{false};
+
+  /* summary over calls since enable */
+  uint64_t m_calls = 0, m_cmp = 0, m_letters = 0, m_ns = 0, m_max_cmp = 0;
+  std::vector<int> m_max_x;
+
+  static void print_word (std::ostream &os, const std::vector<int> &x)
+    {
+      os << "[";
+      for (size_t i = 0; i != x.size(); ++i)
+        os << (i ? ", " : "") << x[i];
+      os << "]";
+    }
+
+  EastmanTrace ()
+    {
+      const char *env = std::getenv("CF_EASTMAN_TRACE");
+      if (env && *env)
+        enable(env);
+    }
+
+  ~EastmanTrace () { disable(); }
+
+public:
+  static EastmanTrace &instance ()
+    {
+      static EastmanTrace tr;
+      return tr;
+    }
+
+  bool enabled () const
+    {
+      return m_enabled.load(std::memory_order_relaxed);
+    }
+
+  /* dest is "stderr" or file name */
+  void enable (const std::string &dest)
+    {
+      std::lock_guard<std::mutex> lk(m_mut);
+      if (m_file.is_open())
+        m_file.close();
+      if (dest == "stderr")
+        m_os = &std::cerr;
+      else
+        {
+          m_file.open(dest);
+          if (!m_file)
+            throw std::runtime_error("Can not open trace file " + dest);
+          m_os = &m_file;
+        }
+      m_calls = m_cmp = m_letters = m_ns = m_max_cmp = 0;
+      m_max_x.clear();
+      m_enabled = true;
+    }
+
+  /* writes summary and stops tracing */
+  void disable ()
+    {
+      std::lock_guard<std::mutex> lk(m_mut);
+      if (!m_enabled)
+        return;
+
+      std::ostream &os = *m_os;
+      os << "{\"summary\": {\"calls\": " << m_calls << ", \"cmp\": " << m_cmp
+         << ", \"letters\": " << m_letters << ", \"ns\": " << m_ns
+         << ", \"max_cmp\": " << m_max_cmp << ", \"max_cmp_x\": ";
+      print_word(os, m_max_x);
+      os << "}}" << std::endl;
+
+      if (m_file.is_open())
+        m_file.close();
+      m_os = nullptr;
+      m_enabled = false;
+    }
+
+  void record (const char *engine, const EastmanCallStats &st)
+    {
+      std::lock_guard<std::mutex> lk(m_mut);
+      if (!m_enabled)
+        return;
+
+      std::ostream &os = *m_os;
+      os << "{\"engine\": \"" << engine << "\", \"x\": ";
+      print_word(os, st.x);
+      os << ", \"shift\": " << st.shift << ", \"cmp\": " << st.cmp
+         << ", \"letters\": " << st.letters << ", \"ns\": " << st.ns
+         << ", \"phases\": [";
+      for (size_t i = 0; i != st.phases.size(); ++i)
+        {
+          const EastmanPhaseStats &p = st.phases[i];
+          os << (i ? ", " : "") << "{\"in\": " << p.in << ", \"out\": "
+             << p.out << ", \"cmp\": " << p.cmp << ", \"letters\": "
+             << p.letters << ", \"ns\": " << p.ns << "}";
+        }
+      os << "]}\n";
+
+      m_calls += 1;
+      m_cmp += st.cmp;
+      m_letters += st.letters;
+      m_ns += st.ns;
+      if (st.cmp > m_max_cmp)
+        {
+          m_max_cmp = st.cmp;
+          m_max_x = st.x;
+        }
+    }
+};
+
+/* null when tracing is disabled */
+inline EastmanTrace *
+eastman_trace ()
+{
+  EastmanTrace &tr = EastmanTrace::instance();
+  return tr.enabled() ? &tr : nullptr;
+}
+
+inline void
+eastman_trace_enable (const std::string &dest)
+{
+  EastmanTrace::instance().enable(dest);
+}
+
+inline void
+eastman_trace_disable ()
+{
+  EastmanTrace::instance().disable();
+}
+
+#endif
@@ -0,0 +1,613 @@
+//===------- cf_trie.hpp -- succinct trie of comma-free dictionary --------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains definition and implementation of TrieCfdict class:
+// compact read-only comma-free dictionary for very large codes (Eastman
+// codes with millions of words), built once from list of words, like
+// CfSnapshot. Its check gives same result as ConcurrentCfdict::check on
+// dictionary of these words, exactly (there are no hash keys)
+//
+// Words are kept in two succinct tries of fixed depth n: of words and of
+// reversed words. Nodes of depth d are numbered in lexicographic order,
+// node of depth n is word (its number in sorted order). Children of
+// depth d nodes are kept in one of two forms, whichever is smaller:
+//
+// - dense: m bits per node, bit c tells if there is child with letter c;
+//   child is rank of its bit (upper levels, where most prefixes exist)
+// - sparse: letter of every child (bits rounded up to power of two) and
+//   bit which marks first child of its parent (LOUDS), children of node
+//   x start at select of x-th mark (lower levels, one child per node)
+//
+// Bits have rank directory (ones before every 512 bits) and select
+// samples (512-bit block of every 512-th one), both O(1) up to scan of
+// block or few blocks. Word is n steps down, parent is one rank or select
+//
+// Sets of ConcurrentCfdict are nodes: S (proper suffixes) are nodes of
+// reversed trie, P (proper prefixes) nodes of trie; B (u of split u . v
+// whose v is in P) and C (v whose u is in S) are one mark bit per node of
+// trie and of reversed trie. So check is n walks down for rotations and
+// walk from every position of candidate in both tries, O(n^2) steps at
+// most, but walks stop at first missing letter
+//
+// Words with given prefix (suffix) are subtree of trie (reversed trie):
+// they are enumerated in lexicographic order (of reversed words) and
+// counted by n ranges of node numbers, without enumeration
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_TRIE_GUARD_
+#define CF_TRIE_GUARD_
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+
+#include "cf_alloc.hpp"
+#include "cf_canon.hpp"
+#include "cf_cdict.hpp"
+
+using std::vector;
+
+class TrieCfdict
+{
+public:
+  /* results of check, as ConcurrentCfdict */
+  enum
+  {
+    accepted = WordKeys::accepted,
+    cyclic = WordKeys::cyclic,
+    conflict = WordKeys::conflict
+  };
+
+private:
+  enum : size_t { none = ~size_t(0) };
+  enum { stack_len = 64 };
+
+  /* bit vector, rank and select of ones after build */
+  class Bits
+  {
+    enum { block = 512, sample = 512 };
+
+    vector<uint64_t> m_w;
+    vector<uint32_t> m_rank;        /* ones before every block, and all */
+    vector<uint32_t> m_sel;         /* block of every sample-th one */
+    size_t m_size;
+
+    static unsigned ones (uint64_t x) { return __builtin_popcountll(x); }
+
+  public:
+    Bits () : m_size(0) {}
+
+    size_t size () const { return m_size; }
+
+    void resize (size_t size)
+      {
+        m_w.resize((size + 63) / 64, 0);
+        m_size = size;
+      }
+
+    void set (size_t i) { m_w[i / 64] |= uint64_t(1) << (i % 64); }
+
+    void push_back (bool b)
+      {
+        resize (m_size + 1);
+        if (b)
+          set (m_size - 1);
+      }
+
+    bool operator[] (size_t i) const
+      {
+        return (m_w[i / 64] >> (i % 64)) & 1;
+      }
+
+    /* directories for rank and select, after last change */
+    void build ()
+      {
+        size_t total = 0, next = 0, i;
+
+        if (m_size >= (uint64_t(1) << 32))
+          throw std::runtime_error("TrieCfdict: too many nodes");
+        m_w.shrink_to_fit();
+        m_rank.clear();
+        m_sel.clear();
+        for (i = 0; i != m_w.size(); ++i)
+          {
+            if (i % (block / 64) == 0)
+              m_rank.push_back(total);
+            total += ones(m_w[i]);
+            for (; next < total; next += sample)
+              m_sel.push_back(i / (block / 64));
+          }
+        m_rank.push_back(total);
+        m_rank.shrink_to_fit();
+        m_sel.shrink_to_fit();
+      }
+
+    /* ones in [0, i) */
+    size_t rank1 (size_t i) const
+      {
+        size_t w = i / 64, r = m_rank[i / block], k;
+        for (k = i / block * (block / 64); k != w; ++k)
+          r += ones(m_w[k]);
+        if (i % 64 != 0)
+          r += ones(m_w[w] & ((uint64_t(1) << (i % 64)) - 1));
+        return r;
+      }
+
+    /* position of one number k (from 0), there shall be such one */
+    size_t select1 (size_t k) const
+      {
+        size_t b = m_sel[k / sample], w;
+        while (m_rank[b + 1] <= k)
+          b += 1;
+        k -= m_rank[b];
+        for (w = b * (block / 64); ones(m_w[w]) <= k; ++w)
+          k -= ones(m_w[w]);
+        uint64_t x = m_w[w];
+        for (; k != 0; --k)
+          x &= x - 1;
+        return w * 64 + __builtin_ctzll(x);
+      }
+
+    size_t bytes () const
+      {
+        return m_w.capacity() * 8 + (m_rank.capacity()
+                                     + m_sel.capacity()) * 4;
+      }
+  };
+
+  /* children of nodes of one depth, see header comment */
+  struct Level
+  {
+    bool dense;
+    Bits bits;                  /* dense: child bits, sparse: first marks */
+    vector<uint64_t> labels;    /* sparse: letters of children */
+  };
+
+  /* trie of k words of n letters, its nodes might be marked */
+  class Trie
+  {
+    size_t m_n, m_m;
+    unsigned m_lbits;
+    vector<size_t> m_nodes;     /* at depth 0 .. n */
+    vector<Level> m_levels;     /* children of depth 0 .. n - 1 */
+    vector<Bits> m_marks;       /* of depth 0 .. n, no rank */
+
+    size_t label (const Level &lv, size_t i) const
+      {
+        size_t per = 64 / m_lbits;
+        return (lv.labels[i / per] >> (i % per * m_lbits))
+               & ((uint64_t(1) << m_lbits) - 1);
+      }
+
+    /* first child of x, or end of depth d + 1 for x = end of depth d */
+    size_t first_child (size_t d, size_t x) const
+      {
+        const Level &lv = m_levels[d];
+        if (lv.dense)
+          return lv.bits.rank1(x * m_m);
+        return (x == m_nodes[d]) ? m_nodes[d + 1] : lv.bits.select1(x);
+      }
+
+    template <typename F>
+    void visit (size_t d, size_t x, int *buf, bool rev, F &f) const
+      {
+        if (d == m_n)
+          {
+            f(static_cast<const int *>(buf));
+            return;
+          }
+
+        const Level &lv = m_levels[d];
+        int &slot = buf[rev ? (m_n - 1 - d) : d];
+        size_t y = first_child(d, x);
+        if (lv.dense)
+          {
+            for (size_t c = 0; c != m_m; ++c)
+              if (lv.bits[x * m_m + c])
+                {
+                  slot = c;
+                  visit (d + 1, y++, buf, rev, f);
+                }
+            return;
+          }
+
+        do
+          {
+            slot = label(lv, y);
+            visit (d + 1, y, buf, rev, f);
+            y += 1;
+          }
+        while ((y != m_nodes[d + 1]) && !lv.bits[y]);
+      }
+
+  public:
+    Trie () : m_n(0), m_m(0), m_lbits(1) {}
+
+    /* letter (i, d) is letter d of word i, words are distinct and sorted
+       by it; letters are in [0, m) */
+    template <typename L>
+    void build (size_t n, size_t m, size_t k, L letter)
+      {
+        size_t i, d, l;
+
+        m_n = n;
+        m_m = m;
+        for (m_lbits = 1; (m_lbits < 32) && ((size_t(1) << m_lbits) < m);
+             m_lbits *= 2)
+          ;
+
+        /* nodes of depth d + 1 are words which differ from previous one
+           in first d + 1 letters */
+        m_nodes.assign(n + 1, 0);
+        m_nodes[0] = 1;
+        for (i = 0; i != k; ++i)
+          {
+            for (l = 0; (i != 0) && (l != n)
+                        && (letter(i, l) == letter(i - 1, l)); ++l)
+              ;
+            for (d = l; d != n; ++d)
+              m_nodes[d + 1] += 1;
+          }
+
+        m_levels.assign(n, Level());
+        for (d = 0; d != n; ++d)
+          {
+            Level &lv = m_levels[d];
+            lv.dense = (m_nodes[d + 1] == 0)
+                       || (m_nodes[d] * m <= m_nodes[d + 1] * (m_lbits + 1));
+            if (lv.dense)
+              lv.bits.resize(m_nodes[d] * m);
+            else
+              lv.labels.assign((m_nodes[d + 1] + 64 / m_lbits - 1)
+                               / (64 / m_lbits), 0);
+          }
+
+        /* new child at depth d + 1 has parent which is last node of
+           depth d, it is first child of it if parent is new too */
+        vector<size_t> count(n + 1, 0);
+        count[0] = 1;
+        for (i = 0; i != k; ++i)
+          {
+            for (l = 0; (i != 0) && (l != n)
+                        && (letter(i, l) == letter(i - 1, l)); ++l)
+              ;
+            for (d = l; d != n; ++d)
+              {
+                Level &lv = m_levels[d];
+                size_t c = letter(i, d), y = count[d + 1]++;
+                if (lv.dense)
+                  lv.bits.set((count[d] - 1) * m + c);
+                else
+                  {
+                    size_t per = 64 / m_lbits;
+                    lv.labels[y / per] |= uint64_t(c) << (y % per * m_lbits);
+                    lv.bits.push_back((d > l) || (i == 0));
+                  }
+              }
+          }
+
+        for (Level &lv : m_levels)
+          lv.bits.build();
+
+        m_marks.assign(n + 1, Bits());
+        for (d = 0; d <= n; ++d)
+          m_marks[d].resize(m_nodes[d]);
+      }
+
+    size_t length () const { return m_n; }
+    size_t nodes (size_t d) const { return m_nodes[d]; }
+
+    /* child of node x of depth d with letter c, none if it is not there */
+    size_t child (size_t d, size_t x, int c) const
+      {
+        const Level &lv = m_levels[d];
+        if ((c < 0) || (size_t(c) >= m_m))
+          return none;
+        if (lv.dense)
+          {
+            size_t p = x * m_m + c;
+            return lv.bits[p] ? lv.bits.rank1(p) : none;
+          }
+
+        size_t y = lv.bits.select1(x);
+        for (;;)
+          {
+            size_t l = label(lv, y);
+            if (l >= size_t(c))
+              return (l == size_t(c)) ? y : none;
+            y += 1;
+            if ((y == m_nodes[d + 1]) || lv.bits[y])
+              return none;
+          }
+      }
+
+    /* node reached from x of depth d by len letters s[0], s[step] ... */
+    size_t descend (size_t d, size_t x, const int *s, size_t len,
+                    ptrdiff_t step) const
+      {
+        for (size_t i = 0; (i != len) && (x != none); ++i, s += step)
+          x = child(d + i, x, *s);
+        return x;
+      }
+
+    /* parent of node y of depth d + 1, c gets letter of y */
+    size_t parent (size_t d, size_t y, int &c) const
+      {
+        const Level &lv = m_levels[d];
+        if (lv.dense)
+          {
+            size_t p = lv.bits.select1(y);
+            c = p % m_m;
+            return p / m_m;
+          }
+        c = label(lv, y);
+        return lv.bits.rank1(y + 1) - 1;
+      }
+
+    /* nodes of depth n under node x of depth d: [first, last) */
+    void leaves (size_t d, size_t x, size_t &first, size_t &last) const
+      {
+        first = x;
+        last = x + 1;
+        for (; d != m_n; ++d)
+          {
+            first = first_child(d, first);
+            last = first_child(d, last);
+          }
+      }
+
+    /* f (word) for every leaf under x of depth d, buf holds letters of
+       path to x (at their places of reversed word if rev) */
+    template <typename F>
+    void enumerate (size_t d, size_t x, int *buf, bool rev, F &f) const
+      {
+        visit (d, x, buf, rev, f);
+      }
+
+    void mark (size_t d, size_t x) { m_marks[d].set(x); }
+    bool marked (size_t d, size_t x) const { return m_marks[d][x]; }
+
+    size_t bytes () const
+      {
+        size_t s = m_nodes.capacity() * sizeof(size_t);
+        for (const Level &lv : m_levels)
+          s += sizeof(Level) + lv.bits.bytes() + lv.labels.capacity() * 8;
+        for (const Bits &b : m_marks)
+          s += sizeof(Bits) + b.bytes();
+        return s;
+      }
+  };
+
+  size_t m_n, m_k;
+  Trie m_fwd, m_rev;            /* words with B marks, reversed with C */
+
+  void check_size (const vector<int> &w) const
+    {
+      if (w.size() != m_n)
+        throw std::runtime_error("Incorrect size of candidate");
+    }
+
+  /* B: prefix u of word whose rest v is in P; C: suffix v of word whose
+     rest u is in S. Words go in order of reversed words for B (and of
+     words for C), so part shared with previous word keeps its answer */
+  void mark_splits (const int *w, const vector<uint32_t> &order,
+                    const vector<uint32_t> &rorder)
+    {
+      size_t n = m_n, i, k, l;
+      vector<size_t> path(n + 1);
+      vector<char> in(n + 1, 0);
+
+      for (i = 0; i != m_k; ++i)
+        {
+          const int *z = w + size_t(rorder[i]) * n;
+          const int *y = (i != 0) ? (w + size_t(rorder[i - 1]) * n) : z;
+
+          for (l = 0; (i != 0) && (l != n) && (z[n - 1 - l] == y[n - 1 - l]);
+               ++l)
+            ;
+          for (k = 1; k < n - l; ++k)
+            in[k] = (m_fwd.descend(0, 0, z + k, n - k, 1) != none);
+
+          path[0] = 0;
+          for (k = 1; k != n; ++k)
+            {
+              path[k] = m_fwd.child(k - 1, path[k - 1], z[k - 1]);
+              if (in[k])
+                m_fwd.mark(k, path[k]);
+            }
+        }
+
+      for (i = 0; i != m_k; ++i)
+        {
+          const int *z = w + size_t(order[i]) * n;
+          const int *y = (i != 0) ? (w + size_t(order[i - 1]) * n) : z;
+
+          for (l = 0; (i != 0) && (l != n) && (z[l] == y[l]); ++l)
+            ;
+          for (k = l + 1; k < n; ++k)
+            in[k] = (m_rev.descend(0, 0, z + k - 1, k, -1) != none);
+
+          path[0] = 0;
+          for (k = 1; k != n; ++k)
+            {
+              path[k] = m_rev.child(k - 1, path[k - 1], z[n - k]);
+              if (in[n - k])
+                m_rev.mark(k, path[k]);
+            }
+        }
+    }
+
+public:
+  /* words.size () / n words of n letters, they shall be distinct (code
+     is not checked to be comma-free, as for CfSnapshot) */
+  TrieCfdict (size_t n, const vector<int> &words) : m_n(n), m_k(0)
+    {
+      CF_ALLOC_SCOPE("TrieCfdict::build");
+      size_t m = 1, i;
+
+      if ((n == 0) || (words.size() % n != 0)
+          || (words.size() / n > 0xffffffffull))
+        throw std::runtime_error("TrieCfdict: incorrect dictionary");
+      for (int c : words)
+        {
+          if (c < 0)
+            throw std::runtime_error("TrieCfdict: negative letter");
+          m = std::max(m, size_t(c) + 1);
+        }
+      m_k = words.size() / n;
+
+      vector<uint32_t> idx(m_k), ridx;
+      for (i = 0; i != m_k; ++i)
+        idx[i] = i;
+
+      const int *w = words.data();
+      std::sort(idx.begin(), idx.end(), [w, n] (uint32_t a, uint32_t b) {
+        return std::lexicographical_compare(w + a * n, w + a * n + n,
+                                            w + b * n, w + b * n + n);
+      });
+      for (i = 1; i < m_k; ++i)
+        if (std::equal(w + idx[i] * n, w + idx[i] * n + n, w + idx[i - 1] * n))
+          throw std::runtime_error("TrieCfdict: repeated word");
+      m_fwd.build(n, m, m_k, [w, n, &idx] (size_t i, size_t d) {
+        return w[idx[i] * n + d];
+      });
+
+      ridx = idx;
+      std::sort(ridx.begin(), ridx.end(), [w, n] (uint32_t a, uint32_t b) {
+        for (size_t d = n; d-- != 0; )
+          if (w[a * n + d] != w[b * n + d])
+            return w[a * n + d] < w[b * n + d];
+        return false;
+      });
+      m_rev.build(n, m, m_k, [w, n, &ridx] (size_t i, size_t d) {
+        return w[ridx[i] * n + n - 1 - d];
+      });
+
+      mark_splits (w, idx, ridx);
+    }
+
+  size_t length () const { return m_n; }
+  size_t size () const { return m_k; }
+
+  /* memory of both tries, bytes */
+  size_t bytes () const
+    {
+      return sizeof(*this) + m_fwd.bytes() + m_rev.bytes();
+    }
+
+  /* number of w in lexicographic order of words, -1 if it is not there */
+  long find (const vector<int> &w) const
+    {
+      check_size (w);
+      size_t x = m_fwd.descend(0, 0, w.data(), m_n, 1);
+      return (x == none) ? -1 : long(x);
+    }
+
+  /* word number i in lexicographic order */
+  vector<int> word (size_t i) const
+    {
+      vector<int> w(m_n);
+      if (i >= m_k)
+        throw std::runtime_error("TrieCfdict: no such word");
+      for (size_t d = m_n; d-- != 0; )
+        i = m_fwd.parent(d, i, w[d]);
+      return w;
+    }
+
+  /* result of insert of w, as ConcurrentCfdict::check */
+  int check (const vector<int> &w) const
+    {
+      size_t n = m_n, k, r;
+      size_t stack[2 * stack_len];
+      vector<size_t> heap;
+      size_t *fwd = stack, *rev = stack + stack_len;
+
+      check_size (w);
+      if (!canonical_rotation(w.data(), n).primitive)
+        return cyclic;
+
+      /* rotation of w is in dictionary */
+      const int *p = w.data();
+      for (r = 0; r != n; ++r)
+        if (m_fwd.descend(n - r, m_fwd.descend(0, 0, p + r, n - r, 1),
+                          p, r, 1) != none)
+          return conflict;
+
+      if (n > stack_len)
+        {
+          heap.resize(2 * n);
+          fwd = heap.data();
+          rev = fwd + n;
+        }
+
+      /* fwd[k]: node of w[k .. n) in trie, rev[k]: of w[0 .. k) in
+         reversed trie */
+      for (k = 1; k != n; ++k)
+        {
+          fwd[k] = m_fwd.descend(0, 0, p + k, n - k, 1);
+          rev[k] = m_rev.descend(0, 0, p + k - 1, k, -1);
+        }
+
+      for (k = 1; k != n; ++k)
+        {
+          /* z = w; u (v) might be suffix (prefix) of w itself */
+          if (((rev[k] != none) || std::equal(p, p + k, p + n - k))
+              && ((fwd[k] != none) || std::equal(p + k, p + n, p)))
+            return conflict;
+
+          /* x = w: suffix of w as u; y = w: prefix of w as v */
+          if (((fwd[n - k] != none) && m_fwd.marked(k, fwd[n - k]))
+              || ((rev[k] != none) && m_rev.marked(k, rev[k])))
+            return conflict;
+        }
+
+      return accepted;
+    }
+
+  /* number of words starting with s (ending with s, if suffix) */
+  size_t count (const vector<int> &s, bool suffix = false) const
+    {
+      size_t first, last, x;
+      if (s.size() > m_n)
+        return 0;
+      const Trie &t = suffix ? m_rev : m_fwd;
+      x = suffix ? t.descend(0, 0, s.data() + s.size() - 1, s.size(), -1)
+                 : t.descend(0, 0, s.data(), s.size(), 1);
+      if (x == none)
+        return 0;
+      t.leaves(s.size(), x, first, last);
+      return last - first;
+    }
+
+  /* f (const int *word) for every word starting with s, in lexicographic
+     order (ending with s if suffix, in order of reversed words) */
+  template <typename F>
+  void enumerate (const vector<int> &s, F f, bool suffix = false) const
+    {
+      size_t len = s.size(), x;
+      if (len > m_n)
+        return;
+      vector<int> buf(m_n);
+      if (suffix)
+        {
+          x = m_rev.descend(0, 0, s.data() + len - 1, len, -1);
+          std::copy(s.begin(), s.end(), buf.end() - len);
+        }
+      else
+        {
+          x = m_fwd.descend(0, 0, s.data(), len, 1);
+          std::copy(s.begin(), s.end(), buf.begin());
+        }
+      if (x != none)
+        (suffix ? m_rev : m_fwd).enumerate(len, x, buf.data(), suffix, f);
+    }
+};
+
+#endif
@@ -0,0 +1,508 @@
+//===------- cf_verify.hpp -- bulk parallel verifier of whole codes -------===//
+//
+// This file is distributed under the GNU GPL v3 License.
+// See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains definition and implementation of CodeVerifier class
+// which checks complete code of millions of words for comma-freeness,
+// when word by word Cfdict::add_tuple (quadratic in code size) is hopeless
+//
+// Code is not comma-free iff some word z splits as z = u . v (both parts
+// nonempty) where u is suffix of some code word x and v is prefix of some
+// code word y: then z occurs in x . y at offset n - |u|. Words x, y, z
+// need not be distinct, so periodic words and rotations of other words
+// are found by the same test. So verifier builds:
+//
+// - S: set of all proper suffixes of all code words
+// - P: set of all proper prefixes of all code words
+//
+// and checks n - 1 internal splits of every word against them, O(N n)
+// lookups in total, all on all cores. Sets keep 64-bit keys (polynomial
+// hash of part, mixed with its length) in sorted arrays with directory
+// by high bits, built in parallel by radix scatter and per-bucket sort.
+// Hash collision can only flag split which is not violation, so every
+// flagged split is confirmed by search of real x and y before reported
+//
+// If sets do not fit into memory budget, keys are partitioned by high
+// bits into several passes, every pass keeps one partition of one set:
+//
+// - phase 1, pass p: splits with u key in partition p are looked up in
+//   S_p, survivors (z, split) go to temporary file by partition of v key
+// - phase 2, pass q: survivors of file q are looked up in P_q
+//
+// so memory is about 16 bytes per key of one partition, rest is on disk
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef CF_VERIFY_GUARD_
+#define CF_VERIFY_GUARD_
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <stdexcept>
+
+#include <unistd.h>
+
+using std::vector;
+
+/* sorted set of 64-bit keys with directory by high bits; bits above
+   directory (partition bits) are same for all keys and skipped */
+class KeySet
+{
+  vector<uint64_t> m_keys;
+  vector<size_t> m_dir;           /* bucket -> first key, one past end */
+  int m_skip, m_dbits;
+
+  size_t bucket (uint64_t key) const
+    {
+      return size_t((key << m_skip) >> (64 - m_dbits));
+    }
+
+public:
+  KeySet () : m_dir(3, 0), m_skip(0), m_dbits(1) {}
+
+  size_t size () const { return m_keys.size(); }
+
+  /* builds set from per-thread parts (emptied), all keys share top skip
+     bits; every thread sorts its share of buckets */
+  void build (vector< vector<uint64_t> > &parts, int skip)
+    {
+      size_t nthreads = parts.size(), total = 0, t, b;
+
+      for (t = 0; t != nthreads; ++t)
+        total += parts[t].size();
+
+      m_skip = skip;
+      m_dbits = 1;
+      while ((m_dbits < 24) && (m_skip + m_dbits < 64)
+             && ((size_t(1) << (m_dbits + 2)) < total))
+        m_dbits += 1;
+
+      size_t nb = size_t(1) << m_dbits;
+      vector< vector<size_t> > pos(nthreads, vector<size_t>(nb + 1, 0));
+      vector<std::thread> threads;
+
+      /* histograms, then offsets: bucket major, thread minor */
+      for (t = 0; t != nthreads; ++t)
+        threads.emplace_back([&, t] () {
+          for (uint64_t k : parts[t])
+            pos[t][bucket(k)] += 1;
+        });
+      for (auto &th : threads)
+        th.join();
+      threads.clear();
+
+      m_dir.assign(nb + 1, 0);
+      size_t acc = 0;
+      for (b = 0; b != nb; ++b)
+        {
+          m_dir[b] = acc;
+          for (t = 0; t != nthreads; ++t)
+            {
+              size_t c = pos[t][b];
+              pos[t][b] = acc;
+              acc += c;
+            }
+        }
+      m_dir[nb] = acc;
+
+      m_keys.clear();
+      m_keys.shrink_to_fit();
+      m_keys.resize(total);
+
+      for (t = 0; t != nthreads; ++t)
+        threads.emplace_back([&, t] () {
+          for (uint64_t k : parts[t])
+            m_keys[pos[t][bucket(k)]++] = k;
+          vector<uint64_t>().swap(parts[t]);
+        });
+      for (auto &th : threads)
+        th.join();
+      threads.clear();
+
+      /* sort and unique buckets, sizes go to pos[0] */
+      std::atomic<size_t> next(0);
+      for (t = 0; t != nthreads; ++t)
+        threads.emplace_back([&] () {
+          for (;;)
+            {
+              size_t lo = next.fetch_add(64);
+              if (lo >= nb)
+                break;
+              for (size_t bb = lo; bb != std::min(nb, lo + 64); ++bb)
+                {
+                  uint64_t *s = m_keys.data() + m_dir[bb];
+                  uint64_t *e = m_keys.data() + m_dir[bb + 1];
+                  std::sort(s, e);
+                  pos[0][bb] = std::unique(s, e) - s;
+                }
+            }
+        });
+      for (auto &th : threads)
+        th.join();
+
+      /* compact */
+      acc = 0;
+      for (b = 0; b != nb; ++b)
+        {
+          size_t from = m_dir[b];
+          m_dir[b] = acc;
+          std::copy(m_keys.begin() + from, m_keys.begin() + from + pos[0][b],
+                    m_keys.begin() + acc);
+          acc += pos[0][b];
+        }
+      m_dir[nb] = acc;
+      m_keys.resize(acc);
+      m_keys.shrink_to_fit();
+    }
+
+  bool contains (uint64_t key) const
+    {
+      size_t b = bucket(key);
+      return std::binary_search(m_keys.begin() + m_dir[b],
+                                m_keys.begin() + m_dir[b + 1], key);
+    }
+};
+
+class CodeVerifier
+{
+public:
+  /* z occurs in x . y at offset (1 .. n-1), indices of words in code */
+  struct Triple
+  {
+    size_t x, y, z, offset;
+  };
+
+  struct Result
+  {
+    bool comma_free = true;
+    uint64_t flagged = 0;         /* violating splits (by keys) */
+    vector<Triple> triples;       /* first confirmed violations */
+    unsigned passes = 1;          /* passes over every set */
+  };
+
+private:
+  enum : uint64_t { base = 0x100000001b3ull };
+  enum { max_passes = 256, flush_size = 1 << 14 };
+
+  size_t m_n, m_count;
+  vector<int> m_words;
+  vector<uint64_t> m_pow;
+  unsigned m_threads;
+  size_t m_budget;
+  std::string m_tmpdir;
+
+  static uint64_t mix (uint64_t k)
+    {
+      k ^= k >> 33;
+      k *= 0xff51afd7ed558ccdull;
+      k ^= k >> 33;
+      k *= 0xc4ceb9fe1a85ec53ull;
+      k ^= k >> 33;
+      return k;
+    }
+
+  static uint64_t key (uint64_t h, size_t len)
+    {
+      return mix(h + len * 0x9e3779b97f4a7c15ull);
+    }
+
+  /* h[i] is hash of w[0 .. i), i = 0 .. n */
+  void hashes (const int *w, uint64_t *h) const
+    {
+      h[0] = 0;
+      for (size_t i = 0; i != m_n; ++i)
+        h[i + 1] = h[i] * base + uint64_t(w[i]) + 1;
+    }
+
+  /* key of w[a .. n) */
+  uint64_t tail_key (const uint64_t *h, size_t a) const
+    {
+      return key(h[m_n] - h[a] * m_pow[m_n - a], m_n - a);
+    }
+
+  static int part (uint64_t key, int pbits)
+    {
+      return pbits ? int(key >> (64 - pbits)) : 0;
+    }
+
+  /* runs f(t, begin, end) over word ranges on all threads */
+  template <typename F> void parallel (size_t count, F f) const
+    {
+      vector<std::thread> threads;
+      for (unsigned t = 0; t != m_threads; ++t)
+        threads.emplace_back([&, t] () {
+          f(t, count * t / m_threads, count * (t + 1) / m_threads);
+        });
+      for (auto &th : threads)
+        th.join();
+    }
+
+  /* set of suffix (or prefix) keys of partition p */
+  void build_set (KeySet &set, bool suffixes, int pbits, int p) const
+    {
+      vector< vector<uint64_t> > parts(m_threads);
+
+      parallel(m_count, [&] (unsigned t, size_t lo, size_t hi) {
+        vector<uint64_t> h(m_n + 1);
+        for (size_t i = lo; i != hi; ++i)
+          {
+            hashes(word(i), h.data());
+            for (size_t k = 1; k != m_n; ++k)
+              {
+                uint64_t kk = suffixes ? tail_key(h.data(), m_n - k)
+                                       : key(h[k], k);
+                if (part(kk, pbits) == p)
+                  parts[t].push_back(kk);
+              }
+          }
+      });
+
+      set.build(parts, pbits);
+    }
+
+  /* exact search of x and y for flagged split (z, k): z[0 .. k) is suffix
+     of x, z[k .. n) is prefix of y */
+  bool confirm (uint64_t flag, Triple &res) const
+    {
+      size_t z = flag / m_n, k = flag % m_n, i;
+      const int *zw = word(z);
+      bool hasx = false, hasy = false;
+
+      for (i = 0; (i != m_count) && !(hasx && hasy); ++i)
+        {
+          const int *w = word(i);
+          if (!hasx && std::equal(zw, zw + k, w + m_n - k))
+            {
+              res.x = i;
+              hasx = true;
+            }
+          if (!hasy && std::equal(zw + k, zw + m_n, w))
+            {
+              res.y = i;
+              hasy = true;
+            }
+        }
+
+      res.z = z;
+      res.offset = m_n - k;
+      return hasx && hasy;
+    }
+
+  void check_in_core (vector<uint64_t> &flags) const
+    {
+      KeySet sufs, prefs;
+      build_set (sufs, true, 0, 0);
+      build_set (prefs, false, 0, 0);
+
+      vector< vector<uint64_t> > found(m_threads);
+      parallel(m_count, [&] (unsigned t, size_t lo, size_t hi) {
+        vector<uint64_t> h(m_n + 1);
+        for (size_t z = lo; z != hi; ++z)
+          {
+            hashes(word(z), h.data());
+            for (size_t k = 1; k != m_n; ++k)
+              if (sufs.contains(key(h[k], k))
+                  && prefs.contains(tail_key(h.data(), k)))
+                found[t].push_back(z * m_n + k);
+          }
+      });
+
+      for (auto &f : found)
+        flags.insert(flags.end(), f.begin(), f.end());
+    }
+
+  FILE *temp_file () const
+    {
+      std::string name = m_tmpdir + "/cf_verify.XXXXXX";
+      vector<char> buf(name.begin(), name.end());
+      buf.push_back(0);
+
+      int fd = mkstemp(buf.data());
+      if (fd < 0)
+        throw std::runtime_error("CodeVerifier: can not create file in "
+                                 + m_tmpdir);
+      unlink(buf.data());
+      FILE *f = fdopen(fd, "w+b");
+      if (f == nullptr)
+        {
+          close(fd);
+          throw std::runtime_error("CodeVerifier: can not open temp file");
+        }
+      return f;
+    }
+
+  static void write_all (FILE *f, const vector<uint64_t> &v)
+    {
+      if (std::fwrite(v.data(), sizeof(uint64_t), v.size(), f) != v.size())
+        throw std::runtime_error("CodeVerifier: temp file write failed");
+    }
+
+  void check_out_of_core (int pbits, vector<uint64_t> &flags) const
+    {
+      int np = 1 << pbits, p;
+      vector<FILE *> files;
+      std::mutex mut;
+
+      try
+        {
+          for (p = 0; p != np; ++p)
+            files.push_back(temp_file());
+
+          /* phase 1: u in S, survivors by partition of v key */
+          for (p = 0; p != np; ++p)
+            {
+              KeySet sufs;
+              build_set (sufs, true, pbits, p);
+
+              parallel(m_count, [&] (unsigned, size_t lo, size_t hi) {
+                vector<uint64_t> h(m_n + 1);
+                vector< vector<uint64_t> > out(np);
+                for (size_t z = lo; z != hi; ++z)
+                  {
+                    hashes(word(z), h.data());
+                    for (size_t k = 1; k != m_n; ++k)
+                      {
+                        uint64_t u = key(h[k], k);
+                        if ((part(u, pbits) != p) || !sufs.contains(u))
+                          continue;
+                        int q = part(tail_key(h.data(), k), pbits);
+                        out[q].push_back(z * m_n + k);
+                        if (out[q].size() == flush_size)
+                          {
+                            std::lock_guard<std::mutex> lock(mut);
+                            write_all (files[q], out[q]);
+                            out[q].clear();
+                          }
+                      }
+                  }
+                std::lock_guard<std::mutex> lock(mut);
+                for (int q = 0; q != np; ++q)
+                  write_all (files[q], out[q]);
+              });
+            }
+
+          /* phase 2: v in P */
+          for (p = 0; p != np; ++p)
+            {
+              KeySet prefs;
+              build_set (prefs, false, pbits, p);
+
+              vector<uint64_t> cand(1 << 20);
+              std::rewind(files[p]);
+              for (;;)
+                {
+                  size_t got = std::fread(cand.data(), sizeof(uint64_t),
+                                          cand.size(), files[p]);
+                  if (got == 0)
+                    break;
+
+                  vector< vector<uint64_t> > found(m_threads);
+                  parallel(got, [&] (unsigned t, size_t lo, size_t hi) {
+                    vector<uint64_t> h(m_n + 1);
+                    for (size_t i = lo; i != hi; ++i)
+                      {
+                        size_t z = cand[i] / m_n, k = cand[i] % m_n;
+                        hashes(word(z), h.data());
+                        if (prefs.contains(tail_key(h.data(), k)))
+                          found[t].push_back(cand[i]);
+                      }
+                  });
+                  for (auto &f : found)
+                    flags.insert(flags.end(), f.begin(), f.end());
+                }
+
+              std::fclose(files[p]);
+              files[p] = nullptr;
+            }
+        }
+      catch (...)
+        {
+          for (FILE *f : files)
+            if (f)
+              std::fclose(f);
+          throw;
+        }
+    }
+
+public:
+  /* words is flat code of words of length n */
+  CodeVerifier (size_t n, vector<int> words) :
+    m_n(n), m_count(0), m_words(std::move(words)), m_pow(n + 1, 1),
+    m_threads(std::max(1u, std::thread::hardware_concurrency())),
+    m_budget(size_t(1) << 32), m_tmpdir("/tmp")
+    {
+      if ((n < 2) || (m_words.size() % n != 0))
+        throw std::runtime_error("CodeVerifier: need n > 1 and whole words");
+      m_count = m_words.size() / n;
+      for (size_t i = 1; i <= n; ++i)
+        m_pow[i] = m_pow[i - 1] * base;
+      if (const char *tmp = std::getenv("TMPDIR"))
+        m_tmpdir = tmp;
+    }
+
+  size_t size () const { return m_count; }
+  size_t length () const { return m_n; }
+  const int *word (size_t i) const { return &m_words[i * m_n]; }
+
+  void set_threads (unsigned t) { m_threads = std::max(1u, t); }
+
+  /* memory for key sets in bytes, temporary files go to dir */
+  void set_memory (size_t bytes, const std::string &dir)
+    {
+      m_budget = bytes;
+      if (!dir.empty())
+        m_tmpdir = dir;
+    }
+
+  /* checks whole code, reports up to limit violating triples */
+  Result verify (size_t limit = 10) const
+    {
+      Result res;
+      vector<uint64_t> flags;
+      uint64_t keys = uint64_t(m_count) * (m_n - 1);
+      int pbits = 0;
+
+      /* in core: both sets, 8 bytes per key, and scatter buffers */
+      if (keys * 24 > m_budget)
+        {
+          pbits = 1;
+          while (((1 << pbits) < max_passes)
+                 && ((keys >> pbits) * 16 > m_budget))
+            pbits += 1;
+          res.passes = 1u << pbits;
+          check_out_of_core (pbits, flags);
+        }
+      else
+        check_in_core (flags);
+
+      std::sort(flags.begin(), flags.end());
+      res.flagged = flags.size();
+
+      for (uint64_t f : flags)
+        {
+          Triple tr;
+          if (res.triples.size() >= limit)
+            break;
+          if (confirm(f, tr))
+            res.triples.push_back(tr);
+          else
+            res.flagged -= 1;
+        }
+
+      /* all flagged splits seen and none confirmed: only hash collisions */
+      res.comma_free = (res.flagged == 0);
+      return res;
+    }
+};
+
+#endif
@@ -17,14 +17,22 @@
 // because beafaced contains face in the midst
 // i. e. suffix "ace" is both head of "aced" and tail of "face"
 //
+// Words are read as bytes (whitespace inside line is skipped), every
+// word of n letters is checked by ByteCfdict (cf_bdict.hpp), so long text
+// words and long lists are cheap
+//
+// option --stats (or --stats=secs for periodic reports) prints latency of
+// every dictionary insert to stderr, see cf_stats.hpp
+//
 //===----------------------------------------------------------------------===//
 
 #include <iostream>
-#include <sstream>
 #include <vector>
 #include <string>
+#include <cctype>
 
-#include "cf_dict.hpp"
+#include "cf_bdict.hpp"
+#include "cf_stats.hpp"
 
 using std::cout;
 using std::cin;
@@ -32,48 +40,49 @@ using std::cerr;
 using std::endl;
 using std::vector;
 
-void process_command_line (int argc, char **argv, int &n);
+void process_command_line (int argc, char **argv, int &n, bool &stats,
+                           double &interval);
 
 int
 main (int argc, char **argv)
 {
   int n, total = 0, accepted = 0;
+  bool stats = false;
+  double interval = 0.0;
 
-  process_command_line (argc, argv, n);
+  process_command_line (argc, argv, n, stats, interval);
 
-  std::vector<int> nxt(n);
-  Cfdict d(n);
+  std::string char_str, nxt;
+  ByteCfdict d(n);
+  OpStats st("insert", interval);
 
+  std::ios::sync_with_stdio(false);
   cout << "Comma-free checker. Input comma-free words of size " << n << endl;
 
-  while (cin)
+  /* cout is tied to cin, so answers are flushed before next read */
+  while (getline(cin, char_str, '\n'))
     {
-      std::string char_str;
-      getline(cin, char_str, '\n');
-
-      if (!cin)
-        break;
-
-      char c;
-      int idx = 0;
-      for ( std::istringstream char_iss (char_str);
-            char_iss >> c; ) 
-        {
-          if (idx < n)
-            nxt[idx] = c;
-
-          ++idx;
-        }
+      nxt.clear();
+      for (char c : char_str)
+        if (!std::isspace((unsigned char) c))
+          nxt.push_back(c);
 
-      if (idx != n)
+      if (nxt.size() != size_t(n))
         {
-          cout << "You should enter word of size " << n << endl;
+          cout << "You should enter word of size " << n << '\n';
           continue;
         }
       
       total += 1;
 
-      int res = d.add_tuple(nxt, true);
+      OpStats::clock::time_point t0;
+      if (stats)
+        t0 = OpStats::now();
+
+      int res = d.add_word(nxt);
+
+      if (stats)
+        st.record(t0);
 
       if (0 == res)
         {
@@ -83,32 +92,46 @@ main (int argc, char **argv)
 
       if (-1 == res)
         {
-          cout << "  rejecting: input is cyclic" << endl;
+          cout << "  rejecting: input is cyclic" << '\n';
           continue;
         }
 
-      cout << "  rejecting: ";
-      for (const auto& x: d.m_lasterr)
-        cout << (char)x;
-      cout << endl;
+      cout << "  rejecting: " << d.m_lasterr << '\n';
     }
   
   cout << "Accepted " << accepted << " of " << total << " words." << endl;
 
+  if (stats)
+    st.finish();
+
   return 0;
 }
 
 void 
-process_command_line (int argc, char **argv, int &n)
+process_command_line (int argc, char **argv, int &n, bool &stats,
+                      double &interval)
 {
-  if (argc < 2)
+  int idx;
+  const char *npos = nullptr;
+
+  for (idx = 1; idx < argc; ++idx)
+    {
+      if (parse_stats_option (argv[idx], stats, interval))
+        continue;
+      if (npos == nullptr)
+        npos = argv[idx];
+      else
+        npos = "";
+    }
+
+  if ((npos == nullptr) || (*npos == 0))
     {
-      cerr << "usage: \"" << argv[0] << " n\" where n "
+      cerr << "usage: \"" << argv[0] << " [--stats[=secs]] n\" where n "
               "is word size" << endl;
       throw std::runtime_error("incorrect command line");
     }
 
-  n = atoi (argv[1]);
+  n = atoi (npos);
 
   if (n <= 0)
     {
@@ -17,63 +17,244 @@
 // this file rewritten in C++ from commafree-eastman.w programm:
 // http://www-cs-faculty.stanford.edu/~uno/programs/commafree-eastman.w 
 //
+// output is input sequence and shift: 
+//
+// 3 0 1 2 0 1 2 3 0 3 1 2 4 3 3 0 3 1 3 2 0 : 12
+//
+// without sequence on command line, works in batch mode: reads sequences
+// from stdin, one per line, and outputs line per sequence as above
+//
+// option --trace (or --trace=file) writes phase counters of every
+// do_eastman call as JSON lines to stderr (or file), see cf_trace.hpp
+//
+// option --stats (or --stats=secs for periodic reports) prints latency of
+// every do_eastman call to stderr, see cf_stats.hpp
+//
+// option --batch (batch mode only) groups sequences by length and runs
+// every group through do_eastman_batch, many words in SIMD lanes at once,
+// on --threads t worker threads (all cores by default); sequence waits
+// --delay ms (10 by default) at most for its group, see cf_schedule.hpp;
+// output is the same, in input order
+//
+// option --window n reads stdin as one stream of numbers (any line
+// breaks) and outputs shift of every window of n numbers, as do_eastman
+// would, by SlidingEastman (cf_sliding.hpp); eastman_new (dip variant,
+// which SlidingEastman does not follow) runs do_eastman on every window:
+//
+// 5 : 3
+//
+// is window starting at 5th (from 0) number, "5 : Input is cyclic" if it
+// is cyclic
+//
 //===----------------------------------------------------------------------===//
 
 #include <algorithm>
+#include <memory>
 #include <vector>
+#include <string>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
+#include <cstdlib>
+#include <cstdint>
 
 #include "cf_eastman.h"
+#include "cf_sliding.hpp"
+#include "cf_schedule.hpp"
+#include "cf_trace.hpp"
+#include "cf_stats.hpp"
 
 using std::cout;
+using std::cin;
 using std::cerr;
 using std::endl;
 
-void process_command_line (int argc, char **argv, std::vector<int> &xs);
+struct BatchOptions
+{
+  bool on = false;
+  unsigned threads = 0;
+  double delay = 0.01;
+};
+
+void process_command_line (int argc, char **argv, std::vector<int> &xs,
+                           bool &stats, double &interval, BatchOptions &batch,
+                           size_t &window);
 
-int 
-main (int argc, char **argv)
+static bool parse_sequence (const std::vector<std::string> &items,
+                            std::vector<int> &xs);
+
+static void
+run_eastman (std::vector<int> &xs, bool stats, OpStats &st)
 {
-  std::vector<int> xs;  
+  for (auto x : xs)
+    cout << x << " ";
 
-  process_command_line (argc, argv, xs);
+  OpStats::clock::time_point t0;
+  if (stats)
+    t0 = OpStats::now();
 
-  (void) do_eastman (xs);
+  int shift = do_eastman (xs);
 
-  return 0;
+  if (stats)
+    st.record(t0);
+
+  cout << ": " << shift << endl;
 }
 
-void 
-process_command_line (int argc, char **argv, std::vector<int> &xs)
+/* shift of window, as do_eastman gives it, -1 if it is cyclic */
+static int
+window_shift (const std::vector<int> &ring, size_t pos, std::vector<int> &w)
+{
+  size_t n = ring.size();
+  w.resize(n);
+  for (size_t i = 0; i != n; ++i)
+    w[i] = ring[(pos + i) % n];
+  try
+    {
+      return do_eastman (w);
+    }
+  catch (std::runtime_error &)
+    {
+      return -1;
+    }
+}
+
+/* shift of every window of stdin stream */
+static void
+run_windows (size_t n)
 {
-  int n, idx;
+  SlidingEastman se(n);
+  bool sliding = eastman_sliding ();
+  std::vector<int> ring(n), w;
+  uint64_t pushed = 0;
+  int x;
 
-  if (argc < 4)
+  while (cin >> x)
     {
-      cerr << "Usage " << argv[0] << " x1 x2 ... xn" << endl;
-      throw std::runtime_error("incorrect command line");
+      if (x < 0)
+        throw std::runtime_error("Stream shall be nonnegative integers");
+      ring[pushed % n] = x;
+      pushed += 1;
+      if (sliding)
+        se.push(x);
+      if (pushed < n)
+        continue;
+
+      int shift = sliding ? se.shift() : window_shift(ring, pushed % n, w);
+      cout << pushed - n << " : ";
+      if (shift < 0)
+        cout << "Input is cyclic" << "\n";
+      else
+        cout << shift << "\n";
     }
 
-  n = argc - 1;
+  if (!cin.eof())
+    throw std::runtime_error("Stream shall be nonnegative integers");
+}
+
+/* line of batch mode */
+static void
+put_shift (const int *xs, size_t n, int shift)
+{
+  for (size_t i = 0; i != n; ++i)
+    cout << xs[i] << " ";
+  if (shift < 0)
+    cout << ": Input is cyclic" << "\n";
+  else
+    cout << ": " << shift << "\n";
+}
+
+int 
+main (int argc, char **argv)
+{
+  std::vector<int> xs;  
+  bool stats = false;
+  double interval = 0.0;
+  size_t window = 0;
+  BatchOptions batch;
+
+  process_command_line (argc, argv, xs, stats, interval, batch, window);
 
-  if ((n % 2) == 0)
+  OpStats st("eastman", interval);
+  std::unique_ptr<EastmanScheduler> sched;
+  if (batch.on)
     {
-      cerr << "Number of items n should be odd, not " << n << endl;
-      throw std::runtime_error("incorrect command line");
+      sched.reset(new EastmanScheduler(put_shift, batch.threads, batch.delay));
+      /* words within --delay shall reach reader */
+      sched->set_flush([] { cout.flush(); });
     }
 
+  if (window != 0)
+    run_windows (window);
+  else if (!xs.empty())
+    run_eastman (xs, stats, st);
+  else
+    while (cin)
+      {
+        std::string numbers_str, item;
+        std::vector<std::string> items;
+        getline(cin, numbers_str, '\n');
+
+        if (!cin)
+          break;
+
+        for (std::istringstream numbers_iss (numbers_str);
+             numbers_iss >> item; )
+          items.push_back(item);
+
+        if (items.empty() || !parse_sequence (items, xs))
+          continue;
+
+        if (sched)
+          {
+            sched->add (xs);
+            continue;
+          }
+
+        try
+          {
+            run_eastman (xs, stats, st);
+          }
+        catch (std::runtime_error &e)
+          {
+            cout << ": " << e.what() << endl;
+          }
+      }
+
+  if (sched)
+    sched->finish ();
+
+  if (stats)
+    st.finish();
+
+  eastman_trace_disable ();
+
+  return 0;
+}
+
+/* validates items, reports problems to cerr */
+static bool
+parse_sequence (const std::vector<std::string> &items, std::vector<int> &xs)
+{
+  size_t n = items.size(), idx;
   bool corr = true;
 
-  for (idx = 1; idx != argc; ++idx)
+  xs.clear();
+
+  if ((n < 3) || ((n % 2) == 0))
+    {
+      cerr << "Number of items n should be odd and > 1, not " << n << endl;
+      return false;
+    }
+
+  for (idx = 0; idx != n; ++idx)
     {
       int x;
-      std::istringstream ss(argv[idx]);
+      std::istringstream ss(items[idx]);
       if (!(ss >> x) || (x < 0))
         {
-          cerr << "Argument #" << idx 
-               << " should be a nonnegative integer, not " << argv[idx] 
+          cerr << "Argument #" << idx + 1
+               << " should be a nonnegative integer, not " << items[idx] 
                << endl;
           corr = false;
         }
@@ -81,8 +262,72 @@ process_command_line (int argc, char **argv, std::vector<int> &xs)
       xs.push_back(x);
     }
 
-  if (!corr)
-    throw std::runtime_error("incorrect command line");
+  return corr;
 }
 
+void 
+process_command_line (int argc, char **argv, std::vector<int> &xs,
+                      bool &stats, double &interval, BatchOptions &batch,
+                      size_t &window)
+{
+  int idx;
+  std::vector<std::string> items;
+
+  for (idx = 1; idx != argc; ++idx)
+    {
+      std::string opt = argv[idx];
+
+      if (parse_stats_option (opt, stats, interval))
+        continue;
+
+      if (opt == "--batch")
+        batch.on = true;
+      else if ((opt == "--threads") && (idx + 1 != argc))
+        batch.threads = std::max(1, atoi(argv[++idx]));
+      else if ((opt == "--delay") && (idx + 1 != argc))
+        batch.delay = std::max(0.0, atof(argv[++idx])) / 1000;
+      else if ((opt == "--window") && (idx + 1 != argc))
+        {
+          int n = atoi(argv[++idx]);
+          if ((n < 3) || (n % 2 == 0))
+            {
+              cerr << "--window n needs odd n > 1" << endl;
+              throw std::runtime_error("incorrect command line");
+            }
+          window = n;
+        }
+      else if (opt == "--trace")
+        eastman_trace_enable ("stderr");
+      else if (opt.compare(0, 8, "--trace=") == 0)
+        eastman_trace_enable (opt.substr(8));
+      else if (opt.compare(0, 2, "--") == 0)
+        {
+          cerr << "Usage " << argv[0] << " [--trace[=file]] [--stats[=secs]]"
+                  " [--batch [--threads t] [--delay ms] | --window n]"
+                  " [x1 x2 ... xn]" << endl;
+          throw std::runtime_error("incorrect command line");
+        }
+      else
+        items.push_back(opt);
+    }
+
+  if ((batch.on || window) && (stats || eastman_trace ()))
+    {
+      cerr << "--batch and --window have no per-call --trace and --stats"
+           << endl;
+      throw std::runtime_error("incorrect command line");
+    }
+
+  if (window && (batch.on || !items.empty()))
+    {
+      cerr << "--window reads stream from stdin only" << endl;
+      throw std::runtime_error("incorrect command line");
+    }
+
+  /* batch mode */
+  if (items.empty())
+    return;
 
+  if (!parse_sequence (items, xs))
+    throw std::runtime_error("incorrect command line");
+}
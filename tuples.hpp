@@ -8,6 +8,20 @@
 // This file contains definition and implementation of Tuples class
 // which generates all n-tuples for given configuration array
 //
+// Both generators might save and restore their position (Tuples by index
+// of next tuple, PrimeGen by its state), so long runs are checkpointed
+// and split into shards, see cf_checkpoint.hpp
+//
+// Besides get_next, which copies word into caller's vector, both might be
+// walked by range (single pass input iterators, like istream_iterator):
+// *it is view of generator's own buffer, valid until ++it, nothing is
+// copied or allocated per word. So pipelines are plain loops or standard
+// algorithms over input iterators:
+//
+//   PrimeGen pg(2, 7);
+//   auto r = pg.range();
+//   size_t cnt = std::count_if(r.begin(), r.end(), pred);
+//
 //===----------------------------------------------------------------------===//
 
 
@@ -16,13 +30,69 @@
 
 #include <vector>
 #include <cassert>
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
 #include <algorithm>
+#include <stdexcept>
 
 #include "cf_dict.hpp"
+#include "cf_alloc.hpp"
 
 using std::vector;
 using std::search;
 
+/* single pass iterator over words of generator G: G::advance moves to
+   next word (false if there is none), G::current is the word; at most
+   left words are walked */
+template <typename G> class WordIterator
+{
+  G *m_gen;
+  uint64_t m_left;
+
+public:
+  typedef std::input_iterator_tag iterator_category;
+  typedef vector<int> value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef const vector<int> *pointer;
+  typedef const vector<int> &reference;
+
+  WordIterator () : m_gen(nullptr), m_left(0) {}
+
+  /* gen is on its first word already, unless left is 0 */
+  WordIterator (G *gen, uint64_t left) : m_gen(gen), m_left(left) {}
+
+  reference operator* () const { return m_gen->current(); }
+  pointer operator-> () const { return &m_gen->current(); }
+
+  /* generator moves on, as get_next does after copy */
+  WordIterator &operator++ ()
+    {
+      bool more = m_gen->advance();
+      m_left = more ? (m_left - 1) : 0;
+      return *this;
+    }
+
+  /* only end is compared to */
+  bool operator== (const WordIterator &rhs) const
+    {
+      return m_left == rhs.m_left;
+    }
+
+  bool operator!= (const WordIterator &rhs) const { return !(*this == rhs); }
+};
+
+template <typename G> class WordRange
+{
+  WordIterator<G> m_begin;
+
+public:
+  explicit WordRange (const WordIterator<G> &b) : m_begin(b) {}
+
+  WordIterator<G> begin () const { return m_begin; }
+  WordIterator<G> end () const { return WordIterator<G>(); }
+};
+
 /* simple n-tuple holder */
 class Tuples
 {
@@ -34,13 +104,22 @@ public:
   Tuples (vector<int> config) : bufsize(config.size()), 
     buffer(bufsize), maxvals(config) {}
 
-  /* nxt is pure output parameter it will be discarded on entry */
+  /* nxt is pure output parameter it will be discarded on entry; false
+     if nxt is the last tuple */
   bool get_next (vector<int> &nxt)
     {
-      int j;
-
+      CF_ALLOC_SCOPE("Tuples::get_next");
       nxt = buffer;
-      j = bufsize - 1;
+      return advance();
+    }
+
+  /* tuple which next get_next yields */
+  const vector<int> &current () const { return buffer; }
+
+  /* moves to next tuple; false after the last one, it wraps to first */
+  bool advance ()
+    {
+      int j = bufsize - 1;
 
       while ((j > -1) && (buffer[j] == maxvals[j]))
         {
@@ -54,42 +133,100 @@ public:
       buffer[j] += 1;
       return true;
     }
+
+  /* number of all tuples, 0 if it does not fit into 64 bits */
+  uint64_t count () const
+    {
+      uint64_t res = 1;
+      for (int m : maxvals)
+        {
+          uint64_t base = uint64_t(m) + 1;
+          if (res > ~uint64_t(0) / base)
+            return 0;
+          res *= base;
+        }
+      return res;
+    }
+
+  /* index of tuple which next get_next yields, last element is least
+     significant digit; after last tuple it wraps to 0 */
+  uint64_t position () const
+    {
+      uint64_t res = 0;
+      for (int j = 0; j != bufsize; ++j)
+        res = res * (uint64_t(maxvals[j]) + 1) + buffer[j];
+      return res;
+    }
+
+  /* at most n tuples from current one, without wrap to first */
+  WordRange<Tuples> range (uint64_t n = ~uint64_t(0))
+    {
+      return WordRange<Tuples>(WordIterator<Tuples>(this, n));
+    }
+
+  /* next get_next yields tuple number idx, see position */
+  void seek (uint64_t idx)
+    {
+      for (int j = bufsize - 1; j >= 0; --j)
+        {
+          uint64_t base = uint64_t(maxvals[j]) + 1;
+          buffer[j] = idx % base;
+          idx /= base;
+        }
+    }
 };
 
 /* [0 - n)-alphabet, k-position prime strings generator 
    based on 7.2.1.1-F */
 class PrimeGen
 {
-  int suffix_len, string_len, max_letter;
-  std::vector<int> buffer;
+  int suffix_len, string_len, max_letter, changed_from;
+  std::vector<int> word;      /* a[1] .. a[k] of algorithm F */
 
 public:
   PrimeGen(int n, int k) : suffix_len(1), string_len(k), 
-                           max_letter(n - 1), buffer(k+1) 
+                           max_letter(n - 1), changed_from(0), word(k) 
     { 
       assert (k > 1);
       assert (n > 1);
-      buffer[0] = -1; 
     }
 
   bool get_next (std::vector<int>& out)
+    {
+      CF_ALLOC_SCOPE("PrimeGen::get_next");
+
+      if (!advance())
+        return false;
+      assert (out.size() == static_cast<size_t>(string_len));
+      std::copy(word.begin(), word.end(), out.begin());
+      return true;
+    }
+
+  /* word found by last advance */
+  const std::vector<int> &current () const { return word; }
+
+  /* letters before this one are same as in word before last advance,
+     so per-word work on prefix might be kept */
+  int changed () const { return changed_from; }
+
+  /* moves to next prime word, false if there is none */
+  bool advance ()
     {
       /* See Knuth-7.2.1.1-F for details */
+      changed_from = string_len;
       for (;;)
         {
           int ext;
 
           if (suffix_len == string_len)
             {
-              assert (out.size() == static_cast<size_t>(string_len));
-              std::copy(buffer.begin() + 1, buffer.end(), out.begin());
               suffix_len = 0; 
               return true;
             }
 
           /* find proper suffix lenght */
           suffix_len = string_len;
-          while (buffer[suffix_len] == max_letter)
+          while ((suffix_len > 0) && (word[suffix_len - 1] == max_letter))
             suffix_len -= 1;          
 
           /* here a[0] .. a[j] is pre-prime 
@@ -98,13 +235,43 @@ public:
             return false;
 
           /* increment pre-prime to make prime */
-          buffer[suffix_len] += 1;
+          word[suffix_len - 1] += 1;
+          changed_from = std::min(changed_from, suffix_len - 1);
 
           /* k-extension of string */
-          for (ext = suffix_len + 1; ext <= string_len; ext++)
-            buffer[ext] = buffer[ext - suffix_len];
+          for (ext = suffix_len; ext < string_len; ext++)
+            word[ext] = word[ext - suffix_len];
         }
     }
+
+  /* words after current one; generator moves to first of them now */
+  WordRange<PrimeGen> range ()
+    {
+      bool any = advance();
+      return WordRange<PrimeGen>(
+        WordIterator<PrimeGen>(this, any ? ~uint64_t(0) : 0));
+    }
+
+  /* position of generator: suffix length and current string, so
+     restore(state()) continues with the same words */
+  std::vector<int> state () const
+    {
+      std::vector<int> res(1, suffix_len);
+      res.insert(res.end(), word.begin(), word.end());
+      return res;
+    }
+
+  void restore (const std::vector<int> &st)
+    {
+      if ((st.size() != word.size() + 1) || (st[0] < 0)
+          || (st[0] > string_len))
+        throw std::runtime_error("PrimeGen: incorrect state");
+      for (size_t i = 1; i != st.size(); ++i)
+        if ((st[i] < 0) || (st[i] > max_letter))
+          throw std::runtime_error("PrimeGen: incorrect state");
+      suffix_len = st[0];
+      std::copy(st.begin() + 1, st.end(), word.begin());
+    }
 };
 
 #endif